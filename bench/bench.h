@@ -0,0 +1,86 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// harness of the benchmarks that build the programs in bench/kat with kat, and time running them
+// a benchmark works in a temporary directory, where every build leaves its program,
+// and every run leaves its output, to be compared with the outputs of the other builds
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 3
+
+static inline double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void run(char *cmd)
+{
+  if (system(cmd)) {
+    fprintf(stderr, "failed: %s\n", cmd);
+    exit(1);
+  }
+}
+
+// run cmd with its output to dir/name.out, return its best time of ROUNDS
+static inline double best_time(char *dir, char *name, char *cmd)
+{
+  char line[1024];
+  snprintf(line, sizeof(line), "%s > %s/%s.out", cmd, dir, name);
+  double best = 1e30;
+  for (int round = 0; round < ROUNDS; round++) {
+    double start = now();
+    run(line);
+    double elapsed = now() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+static inline bool same_output(char *dir, char *a, char *b)
+{
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "cmp -s %s/%s.out %s/%s.out", dir, a, dir, b);
+  return system(cmd) == 0;
+}
+
+// build bench/kat/program.kat to dir/name with kat, as and ld, against the runtime assembled to dir/runtime.o
+static inline void build_asm(char *dir, char *program, char *name, char *flags, char *as_flags, char *ld_flags,
+                             char *runtime)
+{
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd),
+           "./kat --emit=asm %s bench/kat/%s.kat %s/%s && "
+           "as %s %s/%s.s -o %s/%s.o && "
+           "ld %s %s/%s.o %s/%s.o -o %s/%s",
+           flags, program, dir, name, as_flags, dir, name, dir, name, ld_flags, dir, name, dir, runtime, dir, name);
+  run(cmd);
+}
+
+// the temporary directory of benchmark
+static char bench_dir[] = "/tmp/kat-bench-XXXXXX";
+
+static inline char *make_bench_dir()
+{
+  if (!mkdtemp(bench_dir)) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  return bench_dir;
+}
+
+static inline void remove_bench_dir()
+{
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "rm -r %s", bench_dir);
+  run(cmd);
+}
+
+#endif
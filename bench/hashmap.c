@@ -0,0 +1,77 @@
+// hashmap lookup benchmark
+// usage: bench/hashmap
+// compares HASHMAP_SWISS with HASHMAP_LINEAR at several load factors,
+// for a scope-sized table and a large one, keyed by atoms as the symbol tables are
+#define _POSIX_C_SOURCE 199309L
+#include "arena.h"
+#include "hashmap.h"
+#include "intern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUPS (1 << 24)
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// look up keys in a pseudo-random order, return nanoseconds per lookup
+static double lookup(hashmap_t *map, atom_t **keys, size_t num, size_t *found)
+{
+  unsigned seed = 1;
+  *found = 0;
+  double start = now();
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    seed = seed * 1103515245 + 12345;
+    if (hashmap_get_atom(map, keys[(seed >> 8) % num]))
+      (*found)++;
+  }
+  return (now() - start) * 1e9 / LOOKUPS;
+}
+
+int main()
+{
+  static const size_t capacities[] = { 16, 1 << 16 };
+  static const double loads[] = { 0.25, 0.5, 0.7 };
+  static const char *layout_names[] = {
+    [HASHMAP_SWISS] = "swiss",
+    [HASHMAP_LINEAR] = "linear",
+  };
+
+  curr_arena = new_arena();
+
+  // present keys, then absent keys
+  size_t keys_num = 1 << 16;
+  atom_t **hits = malloc(sizeof(atom_t *) * keys_num);
+  atom_t **misses = malloc(sizeof(atom_t *) * keys_num);
+  char name[32];
+  for (size_t i = 0; i < keys_num; i++) {
+    hits[i] = intern(name, sprintf(name, "symbol_%zu", i));
+    misses[i] = intern(name, sprintf(name, "missing_%zu", i));
+  }
+
+  printf("%-8s %8s %6s %10s %10s\n", "layout", "capacity", "load", "hit ns", "miss ns");
+  for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+      for (HASHMAP_LAYOUT layout = HASHMAP_SWISS; layout <= HASHMAP_LINEAR; layout++) {
+        size_t num = capacities[c] * loads[l];
+        hashmap_t *map = new_hashmap_layout(layout, capacities[c]);
+        for (size_t i = 0; i < num; i++)
+          hashmap_add_atom(map, hits[i], hits[i]);
+
+        size_t hit_found, miss_found;
+        double hit = lookup(map, hits, num, &hit_found);
+        double miss = lookup(map, misses, num, &miss_found);
+        printf("%-8s %8zu %6.2f %10.2f %10.2f%s\n", layout_names[layout], map->capcity, loads[l], hit, miss,
+               hit_found == LOOKUPS && miss_found == 0 ? "" : "  WRONG");
+      }
+    }
+  }
+
+  delete_arena(curr_arena);
+  return 0;
+}
@@ -0,0 +1,85 @@
+// lexer throughput benchmark
+// usage: bench/lex [source-file]
+// without source file, a synthetic program of about 32 MB is generated
+#define _POSIX_C_SOURCE 199309L
+#include "arena.h"
+#include "lex.h"
+#include "scan.h"
+#include "source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SYNTHETIC_SIZE (32 << 20)
+#define ROUNDS 5
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// generate a program with long identifiers, indentation, numbers, strings and comments
+static char *generate(size_t *len)
+{
+  char *buf = malloc(SYNTHETIC_SIZE + 1024 + SOURCE_PADDING);
+  char *p = buf;
+  unsigned seed = 1;
+  for (int fn = 0; p - buf < SYNTHETIC_SIZE; fn++) {
+    p += sprintf(p, "// function number %d, generated for benchmarking the lexer\n", fn);
+    p += sprintf(p, "func generated_function_%d(argument_count: int, argument_vector: str) => int {\n", fn);
+    for (int i = 0; i < 16; i++) {
+      seed = seed * 1103515245 + 12345;
+      p += sprintf(p, "        let local_variable_%d_%d: int = (accumulated_value_%d + %u) * %u;\n",
+                   fn, i, i, seed % 100000, seed % 97);
+    }
+    p += sprintf(p, "        /* block comment spanning\n           multiple lines */\n");
+    p += sprintf(p, "        let message: str = \"a reasonably long string literal in function %d\";\n", fn);
+    p += sprintf(p, "        return 0;\n}\n\n");
+  }
+  memset(p, 0, SOURCE_PADDING);
+  *len = p - buf;
+  return buf;
+}
+
+int main(int argc, char *argv[])
+{
+  char *buf;
+  size_t len;
+  if (argc >= 2) {
+    source_t *source = load_source(argv[1]);
+    buf = source->buf;
+    len = source->len;
+  } else {
+    buf = generate(&len);
+  }
+
+  SCAN_ISA best = scan_detect();
+  size_t expected = 0;
+  for (SCAN_ISA isa = SCAN_SCALAR; isa <= best; isa++) {
+    scan_select(isa);
+
+    double best_time = 1e30;
+    size_t count = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+      curr_arena = new_arena();
+      double start = now();
+      token_t *tokens = lex(buf, len);
+      double elapsed = now() - start;
+      if (elapsed < best_time)
+        best_time = elapsed;
+      for (count = 0; tokens[count].type != TK_EOF; count++)
+        ;
+      delete_arena(curr_arena);
+    }
+
+    if (isa == SCAN_SCALAR)
+      expected = count;
+    printf("%-8s %8.1f MB/s  %zu tokens%s\n", scan_isa_name(isa),
+           len / best_time / (1 << 20), count, count == expected ? "" : "  MISMATCH");
+  }
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+// register allocation benchmark
+// usage: bench/regalloc (from the root of repository, after make)
+// compiles the programs in bench/kat with and without register allocation,
+// links them with the minimal runtime bench/rt32.s, so no 32-bit libc is needed,
+// and compares the run time of the two, whose outputs must be the same
+#include "bench.h"
+
+// build the program to dir/name, return its best run time, and leave its output in dir/name.out
+static double build_and_time(char *dir, char *program, char *name, char *flags)
+{
+  build_asm(dir, program, name, flags, "--32", "-m elf_i386", "rt32");
+
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "%s/%s", dir, name);
+  return best_time(dir, name, cmd);
+}
+
+int main()
+{
+  static char *programs[] = { "arith", "poly", "fib", "gcd" };
+
+  char *dir = make_bench_dir();
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "as --32 bench/rt32.s -o %s/rt32.o", dir);
+  run(cmd);
+
+  bool ok = true;
+  printf("%-8s %12s %12s %8s\n", "program", "memory ms", "regs ms", "speedup");
+  for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+    double memory = build_and_time(dir, programs[i], "memory", "--no-regalloc");
+    double regs = build_and_time(dir, programs[i], "regs", "");
+    bool same = same_output(dir, "memory", "regs");
+    ok = ok && same;
+    printf("%-8s %12.1f %12.1f %7.2fx%s\n", programs[i], memory * 1e3, regs * 1e3, memory / regs,
+           same ? "" : "  OUTPUT DIFFERS");
+  }
+
+  remove_bench_dir();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+# minimal i386 runtime, to run the benchmark programs without a 32-bit libc
+# provides _start, and printf for the two formats kat emits,
+# the hello message of main and "%d\n" of print
+.section .bss
+rt_buf:
+  .space 16
+
+.section .text
+.globl _start
+_start:
+  call main
+  movl %eax, %ebx
+  movl $1, %eax
+  int $0x80
+
+.globl printf
+printf:
+  pushl %ebp
+  movl %esp, %ebp
+  pushl %ebx
+  pushl %esi
+  pushl %edi
+  movl 8(%ebp), %esi
+  cmpb $'%', (%esi)
+  je .Lnumber
+
+  # write the string as is
+  movl %esi, %edi
+.Llen:
+  cmpb $0, (%edi)
+  je .Lstring
+  incl %edi
+  jmp .Llen
+.Lstring:
+  movl %edi, %edx
+  subl %esi, %edx
+  movl %esi, %ecx
+  jmp .Lwrite
+
+  # format the integer backwards, from the newline at the end of buffer
+.Lnumber:
+  movl 12(%ebp), %eax
+  leal rt_buf+15, %edi
+  movb $10, (%edi)
+  movl $10, %ecx
+  xorl %esi, %esi
+  testl %eax, %eax
+  jns .Ldigit
+  negl %eax
+  movl $1, %esi
+.Ldigit:
+  xorl %edx, %edx
+  divl %ecx
+  decl %edi
+  addb $'0', %dl
+  movb %dl, (%edi)
+  testl %eax, %eax
+  jnz .Ldigit
+  testl %esi, %esi
+  jz .Lnumber_done
+  decl %edi
+  movb $'-', (%edi)
+.Lnumber_done:
+  leal rt_buf+16, %edx
+  subl %edi, %edx
+  movl %edi, %ecx
+
+.Lwrite:
+  movl $4, %eax
+  movl $1, %ebx
+  int $0x80
+  popl %edi
+  popl %esi
+  popl %ebx
+  popl %ebp
+  ret
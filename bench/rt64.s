@@ -0,0 +1,68 @@
+# minimal x86_64 runtime, the counterpart of rt32.s, so that both targets run
+# the benchmark programs on the same footing, without libc
+# provides _start, and printf for the two formats kat emits,
+# the hello message of main and "%d\n" of print
+.section .bss
+rt_buf:
+  .space 16
+
+.section .text
+.globl _start
+_start:
+  call main
+  movl %eax, %edi
+  movl $60, %eax
+  syscall
+
+.globl printf
+printf:
+  cmpb $'%', (%rdi)
+  je .Lnumber
+
+  # write the string as is
+  movq %rdi, %rsi
+.Llen:
+  cmpb $0, (%rdi)
+  je .Lstring
+  incq %rdi
+  jmp .Llen
+.Lstring:
+  movq %rdi, %rdx
+  subq %rsi, %rdx
+  jmp .Lwrite
+
+  # format the integer backwards, from the newline at the end of buffer
+.Lnumber:
+  movl %esi, %eax
+  leaq rt_buf+15(%rip), %rdi
+  movb $10, (%rdi)
+  movl $10, %ecx
+  xorl %r8d, %r8d
+  testl %eax, %eax
+  jns .Ldigit
+  negl %eax
+  movl $1, %r8d
+.Ldigit:
+  xorl %edx, %edx
+  divl %ecx
+  decq %rdi
+  addb $'0', %dl
+  movb %dl, (%rdi)
+  testl %eax, %eax
+  jnz .Ldigit
+  testl %r8d, %r8d
+  jz .Lnumber_done
+  decq %rdi
+  movb $'-', (%rdi)
+.Lnumber_done:
+  leaq rt_buf+16(%rip), %rdx
+  subq %rdi, %rdx
+  movq %rdi, %rsi
+
+.Lwrite:
+  movl $1, %eax
+  movl $1, %edi
+  syscall
+  ret
+
+.section .note.GNU-stack,"",@progbits
@@ -0,0 +1,177 @@
+// compiler stress test
+// usage: bench/stress
+// generates programs with many functions, many locals, deeply nested expressions
+// and blocks, compiles each at three sizes, and checks that compile time scales linearly
+#define _POSIX_C_SOURCE 199309L
+#include "arena.h"
+#include "codegen.h"
+#include "ir.h"
+#include "lex.h"
+#include "parse.h"
+#include "source.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 3
+
+// compile time may grow at most this much faster than the input
+#define TOLERANCE 2.0
+
+typedef struct buf_t
+{
+  char *data;
+  size_t len;
+  size_t capacity;
+} buf_t;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void put(buf_t *buf, const char *str)
+{
+  size_t len = strlen(str);
+  if (buf->len + len + SOURCE_PADDING > buf->capacity) {
+    buf->capacity = (buf->len + len + SOURCE_PADDING) * 2;
+    buf->data = realloc(buf->data, buf->capacity);
+  }
+  memcpy(buf->data + buf->len, str, len);
+  buf->len += len;
+}
+
+static void putf(buf_t *buf, const char *fmt, int n)
+{
+  char str[128];
+  snprintf(str, sizeof(str), fmt, n);
+  put(buf, str);
+}
+
+// n functions calling the previous one
+static void gen_funcs(buf_t *buf, int n)
+{
+  put(buf, "func f0(a: int) => int {\n  return a;\n}\n");
+  for (int i = 1; i < n; i++) {
+    putf(buf, "func f%d(a: int) => int {\n", i);
+    putf(buf, "  return f%d(a) + 1;\n}\n", i - 1);
+  }
+  put(buf, "func main() => int {\n  return 0;\n}\n");
+}
+
+// one function with n locals, each initialized from the previous one
+static void gen_locals(buf_t *buf, int n)
+{
+  put(buf, "func main() => int {\n  let v0: int = 1;\n");
+  for (int i = 1; i < n; i++) {
+    char str[128];
+    snprintf(str, sizeof(str), "  let v%d: int = v%d * 3 - 1;\n", i, i - 1);
+    put(buf, str);
+  }
+  put(buf, "  return 0;\n}\n");
+}
+
+// expressions nested n deep: left nested parens, right nested parens and unary minus
+static void gen_nested_expr(buf_t *buf, int n)
+{
+  put(buf, "func main() => int {\n  let x: int = ");
+  for (int i = 0; i < n; i++)
+    put(buf, "(");
+  put(buf, "1");
+  for (int i = 0; i < n; i++)
+    put(buf, " + 1)");
+  put(buf, ";\n  let y: int = ");
+  for (int i = 0; i < n; i++)
+    put(buf, "1 + (");
+  put(buf, "1");
+  for (int i = 0; i < n; i++)
+    put(buf, ")");
+  put(buf, ";\n  let z: int = ");
+  for (int i = 0; i < n; i++)
+    put(buf, "-");
+  put(buf, "1;\n  return 0;\n}\n");
+}
+
+// one expression of n operands, whose ast is n deep
+static void gen_long_expr(buf_t *buf, int n)
+{
+  put(buf, "func main() => int {\n  let x: int = 1");
+  for (int i = 1; i < n; i++)
+    put(buf, i % 2 ? " + 2" : " - 1");
+  put(buf, ";\n  return 0;\n}\n");
+}
+
+// blocks nested n deep
+static void gen_nested_blocks(buf_t *buf, int n)
+{
+  put(buf, "func main() => int {\n  let x: int = 1;\n");
+  for (int i = 0; i < n; i++)
+    put(buf, "  if (x) {\n");
+  put(buf, "  x = 2;\n");
+  for (int i = 0; i < n; i++)
+    put(buf, "  }\n");
+  put(buf, "  return 0;\n}\n");
+}
+
+// best time of compiling the program, including code generation and encoding
+static double compile(buf_t *buf)
+{
+  memset(buf->data + buf->len, 0, SOURCE_PADDING);
+  double best = 1e30;
+  for (int round = 0; round < ROUNDS; round++) {
+    double start = now();
+    curr_arena = new_arena();
+    token_t *tokens = lex(buf->data, buf->len);
+    node_t *ast = parse(tokens);
+    ir_func_t *ir = gen_ir(ast);
+    output_obj = new_obj();
+    codegen(ir);
+    output_obj = NULL;
+    delete_arena(curr_arena);
+    double elapsed = now() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+int main()
+{
+  static const struct {
+    char *name;
+    void (*gen)(buf_t *buf, int n);
+    int n;  // the largest size
+  } tests[] = {
+    { "functions", gen_funcs, 100000 },
+    { "locals", gen_locals, 10000 },
+    { "nested expression", gen_nested_expr, 10000 },
+    { "long expression", gen_long_expr, 100000 },
+    { "nested blocks", gen_nested_blocks, 10000 },
+  };
+
+  bool linear = true;
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    double times[3];
+    int sizes[3] = { tests[i].n / 4, tests[i].n / 2, tests[i].n };
+    printf("%-18s", tests[i].name);
+    for (int s = 0; s < 3; s++) {
+      buf_t buf = { NULL, 0, 0 };
+      tests[i].gen(&buf, sizes[s]);
+      times[s] = compile(&buf);
+      free(buf.data);
+      printf("  %7d: %8.2f ms", sizes[s], times[s] * 1e3);
+    }
+
+    // four times the input should not take much more than four times the time
+    double ratio = times[2] / times[0];
+    bool ok = ratio < 4 * TOLERANCE;
+    linear = linear && ok;
+    printf("  x%.1f %s\n", ratio, ok ? "ok" : "NOT LINEAR");
+  }
+
+  return linear ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+// target benchmark
+// usage: bench/target (from the root of repository, after make)
+// times each program in bench/kat as i386 and as x86_64 code, linked with bench/rt32.s and bench/rt64.s
+#include "bench.h"
+
+typedef struct target_t
+{
+  char *name;
+  char *flags;     // flags of kat
+  char *as_flags;
+  char *ld_flags;
+  char *runtime;
+} target_t;
+
+static target_t targets[] = {
+  { "i386",   "--target=i386",   "--32", "-m elf_i386",   "rt32" },
+  { "x86_64", "--target=x86_64", "--64", "-m elf_x86_64", "rt64" },
+};
+
+// build the program to dir/name, return its best run time, and leave its output in dir/name.out
+static double build_and_time(char *dir, char *program, target_t *target)
+{
+  char *name = target->name;
+  build_asm(dir, program, name, target->flags, target->as_flags, target->ld_flags, target->runtime);
+
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "%s/%s", dir, name);
+  return best_time(dir, name, cmd);
+}
+
+int main()
+{
+  static char *programs[] = { "arith", "poly", "fib", "gcd", "pressure" };
+
+  char *dir = make_bench_dir();
+  char cmd[512];
+  for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+    snprintf(cmd, sizeof(cmd), "as %s bench/%s.s -o %s/%s.o", targets[t].as_flags, targets[t].runtime, dir,
+             targets[t].runtime);
+    run(cmd);
+  }
+
+  bool ok = true;
+  printf("%-8s %12s %12s %8s\n", "program", "i386 ms", "x86_64 ms", "speedup");
+  for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+    double i386 = build_and_time(dir, programs[i], &targets[0]);
+    double x86_64 = build_and_time(dir, programs[i], &targets[1]);
+    bool same = same_output(dir, "i386", "x86_64");
+    ok = ok && same;
+    printf("%-8s %12.1f %12.1f %7.2fx%s\n", programs[i], i386 * 1e3, x86_64 * 1e3, i386 / x86_64,
+           same ? "" : "  OUTPUT DIFFERS");
+  }
+
+  remove_bench_dir();
+  return ok ? 0 : 1;
+}
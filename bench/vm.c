@@ -0,0 +1,41 @@
+// vm benchmark
+// usage: bench/vm (from the root of repository, after make)
+// compiles the programs in bench/kat to x86_64 executables and to bytecode,
+// with and without superinstructions, and compares the run time of native code
+// with the one of the vm interpreting the .katc files, whose outputs must be the same
+#include "bench.h"
+
+int main()
+{
+  static char *programs[] = { "arith", "poly", "fib", "gcd", "pressure" };
+
+  char *dir = make_bench_dir();
+
+  bool ok = true;
+  char cmd[1024];
+  printf("%-8s %10s %10s %10s %9s %7s\n", "program", "native ms", "vm ms", "unfused ms", "vm/native", "fusion");
+  for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+    char *program = programs[i];
+    snprintf(cmd, sizeof(cmd),
+             "./kat --target=x86_64 bench/kat/%s.kat %s/native && "
+             "./kat --emit=katc bench/kat/%s.kat %s/vm && "
+             "./kat --no-fuse --emit=katc bench/kat/%s.kat %s/unfused",
+             program, dir, program, dir, program, dir);
+    run(cmd);
+
+    snprintf(cmd, sizeof(cmd), "%s/native", dir);
+    double native = best_time(dir, "native", cmd);
+    snprintf(cmd, sizeof(cmd), "./kat --vm %s/vm.katc", dir);
+    double vm = best_time(dir, "vm", cmd);
+    snprintf(cmd, sizeof(cmd), "./kat --vm %s/unfused.katc", dir);
+    double unfused = best_time(dir, "unfused", cmd);
+
+    bool same = same_output(dir, "native", "vm") && same_output(dir, "native", "unfused");
+    ok = ok && same;
+    printf("%-8s %10.1f %10.1f %10.1f %8.2fx %6.2fx%s\n", program, native * 1e3, vm * 1e3, unfused * 1e3,
+           vm / native, unfused / vm, same ? "" : "  OUTPUT DIFFERS");
+  }
+
+  remove_bench_dir();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_SIZE (64 << 10)        // size of blocks for small allocations
+#define LARGE_SIZE (BLOCK_SIZE / 4)  // allocations larger than this get their own block
+#define ALIGN 16
+
+arena_t *curr_arena;
+
+static char *phase_names[PHASE_NUM] = {
+  [PHASE_LEX] = "lex",
+  [PHASE_PARSE] = "parse",
+  [PHASE_IR] = "ir",
+  [PHASE_CODEGEN] = "codegen",
+  [PHASE_LINK] = "link",
+};
+
+static size_t align_up(size_t size)
+{
+  return (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+static block_t *make_block(arena_t *arena, size_t size)
+{
+  block_t *block = malloc(sizeof(block_t) + size);
+  if (!block) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  block->prev = NULL;
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  arena->reserved += sizeof(block_t) + size;
+  return block;
+}
+
+static void free_blocks(block_t *block)
+{
+  while (block) {
+    block_t *next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+arena_t *new_arena()
+{
+  arena_t *arena = calloc(1, sizeof(arena_t));
+  return arena;
+}
+
+void delete_arena(arena_t *arena)
+{
+  free_blocks(arena->blocks);
+  free_blocks(arena->large);
+  if (curr_arena == arena)
+    curr_arena = NULL;
+  free(arena);
+}
+
+void arena_set_phase(arena_t *arena, ARENA_PHASE phase)
+{
+  arena->phase = phase;
+}
+
+static void *alloc_large(arena_t *arena, size_t size)
+{
+  block_t *block = make_block(arena, size);
+  block->used = size;
+  block->next = arena->large;
+  if (arena->large)
+    arena->large->prev = block;
+  arena->large = block;
+  return block->data;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+  arena->used[arena->phase] += size;
+
+  if (size > LARGE_SIZE)
+    return alloc_large(arena, size);
+
+  size = align_up(size);
+  block_t *block = arena->blocks;
+  if (!block || block->used + size > block->size) {
+    block = make_block(arena, BLOCK_SIZE);
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  void *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+void *arena_calloc(arena_t *arena, size_t num, size_t size)
+{
+  void *ptr = arena_alloc(arena, num * size);
+  memset(ptr, 0, num * size);
+  return ptr;
+}
+
+// resize an allocation of old_size bytes
+// large allocations are resized in place of their own block,
+// the last small allocation of current block is extended if it fits,
+// otherwise the contents are copied to a new allocation
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size)
+{
+  if (!ptr)
+    return arena_alloc(arena, new_size);
+
+  if (old_size > LARGE_SIZE && new_size > LARGE_SIZE) {
+    block_t *block = (block_t *)((unsigned char *)ptr - offsetof(block_t, data));
+    block_t *prev = block->prev;
+    block_t *next = block->next;
+    block = realloc(block, sizeof(block_t) + new_size);
+    if (!block) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    if (prev)
+      prev->next = block;
+    else
+      arena->large = block;
+    if (next)
+      next->prev = block;
+    arena->reserved += new_size - block->size;
+    arena->used[arena->phase] += new_size - old_size;
+    block->size = block->used = new_size;
+    return block->data;
+  }
+
+  block_t *block = arena->blocks;
+  if (old_size <= LARGE_SIZE && new_size <= LARGE_SIZE && block &&
+      (unsigned char *)ptr + align_up(old_size) == block->data + block->used &&
+      block->used - align_up(old_size) + align_up(new_size) <= block->size) {
+    block->used = block->used - align_up(old_size) + align_up(new_size);
+    arena->used[arena->phase] += new_size - old_size;
+    return ptr;
+  }
+
+  void *new_ptr = arena_alloc(arena, new_size);
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  return new_ptr;
+}
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len)
+{
+  char *dup = arena_alloc(arena, len + 1);
+  memcpy(dup, str, len);
+  dup[len] = '\0';
+  return dup;
+}
+
+void arena_report(arena_t *arena, FILE *fp)
+{
+  size_t total = 0;
+  for (ARENA_PHASE phase = 0; phase < PHASE_NUM; phase++) {
+    fprintf(fp, "%-8s %12zu bytes\n", phase_names[phase], arena->used[phase]);
+    total += arena->used[phase];
+  }
+  fprintf(fp, "%-8s %12zu bytes\n", "total", total);
+  fprintf(fp, "%-8s %12zu bytes\n", "reserved", arena->reserved);
+}
@@ -0,0 +1,584 @@
+#define _DEFAULT_SOURCE
+#include "bytecode.h"
+#include "arena.h"
+#include "hashmap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool use_fusion = true;
+
+/* compile ir to bytecode */
+
+// where the target of an instruction is, which is patched when the function is complete
+typedef struct fixup_t
+{
+  uint32_t at;  // index in body of the slot holding the target
+  bb_t *bb;
+} fixup_t;
+
+DEFINE_VEC(fixup_vec, fixup_t)
+DEFINE_VEC(index_vec, uint32_t)
+
+static bc_ins_vec_t code;      // instructions of program
+static bc_func_vec_t funcs;
+static hashmap_t *func_index;  // name of function to its index in funcs + 1
+
+// the function being compiled, its constants are loaded first, and its blocks follow in body
+static ir_func_t *curr_func;
+static uint32_t values_num;
+static uint32_t *reads;        // number of reads of each temporary
+static hashmap_t *consts;      // constant to its register + 1
+static bc_ins_vec_t loads;     // loads of the constants
+static bc_ins_vec_t body;
+static fixup_vec_t fixups;
+static index_vec_t args;       // instructions writing arguments, to registers relative to the end of frame
+static index_vec_t calls;      // calls, whose windows start at the end of frame
+static uint32_t max_args;
+
+static const BC_OP bc_ops[IR_OP_NUM] = {
+  [IR_MOV] = BC_MOV,
+  [IR_NEG] = BC_NEG,
+  [IR_ADD] = BC_ADD,
+  [IR_SUB] = BC_SUB,
+  [IR_MUL] = BC_MUL,
+  [IR_DIV] = BC_DIV,
+  [IR_EQ]  = BC_EQ,
+  [IR_NE]  = BC_NE,
+  [IR_LT]  = BC_LT,
+  [IR_LE]  = BC_LE,
+  [IR_GT]  = BC_GT,
+  [IR_GE]  = BC_GE,
+};
+
+static bool is_compare(IR_OP op)
+{
+  return op >= IR_EQ && op <= IR_GE;
+}
+
+// the comparison that is true iff cc is false
+static IR_OP negate(IR_OP cc)
+{
+  static const IR_OP negated[] = { IR_NE, IR_EQ, IR_GE, IR_GT, IR_LE, IR_LT };
+  return negated[cc - IR_EQ];
+}
+
+// the comparison of b and a that is true iff cc of a and b is
+static IR_OP mirror(IR_OP cc)
+{
+  static const IR_OP mirrored[] = { IR_EQ, IR_NE, IR_GT, IR_GE, IR_LT, IR_LE };
+  return mirrored[cc - IR_EQ];
+}
+
+static bool fits_int16(int64_t imm)
+{
+  return imm >= INT16_MIN && imm <= INT16_MAX;
+}
+
+// the register of a temporary or variable
+static uint32_t value_reg(operand_t opd)
+{
+  uint32_t value = ir_value(curr_func, opd);
+  uint32_t vars_num = curr_func->params.size + curr_func->locals.size;
+  return value >= curr_func->temps_num ? value - curr_func->temps_num : value + vars_num;
+}
+
+// the register of a constant, which is loaded when the function is entered
+static uint32_t const_reg(int32_t val)
+{
+  entry_t *entry = hashmap_get(consts, (char *) &val, sizeof(val));
+  if (entry)
+    return (uint32_t) (uintptr_t) entry->val - 1;
+  uint32_t reg = values_num + loads.size;
+  int32_t *key = arena_alloc(curr_arena, sizeof(int32_t));
+  *key = val;
+  hashmap_add(consts, (char *) key, sizeof(int32_t), (void *) (uintptr_t) (reg + 1));
+  bc_ins_vec_push(&loads, (bc_ins_t) { .op = BC_LOADI, .a = reg, .imm = val });
+  return reg;
+}
+
+static uint32_t reg(operand_t opd)
+{
+  return opd.kind == OPD_IMM ? const_reg((int32_t) opd.imm) : value_reg(opd);
+}
+
+static void emit(BC_OP op, uint32_t a, uint32_t b, uint32_t c)
+{
+  bc_ins_vec_push(&body, (bc_ins_t) { .op = op, .a = a, .b = b, .c = c });
+}
+
+static void emit_imm(BC_OP op, uint32_t a, int32_t imm)
+{
+  bc_ins_vec_push(&body, (bc_ins_t) { .op = op, .a = a, .imm = imm });
+}
+
+// emit a jump to block, the target is in the last slot
+static void emit_target(BC_OP op, uint32_t a, bb_t *bb)
+{
+  bc_ins_vec_push(&body, (bc_ins_t) { .op = op, .a = a });
+  fixup_vec_push(&fixups, (fixup_t) { .at = body.size - 1, .bb = bb });
+}
+
+// compare a and b, and goto block if the comparison cc is true
+static void emit_branch(IR_OP cc, operand_t a, operand_t b, bb_t *bb)
+{
+  if (a.kind == OPD_IMM && b.kind != OPD_IMM) {
+    operand_t t = a;
+    a = b;
+    b = t;
+    cc = mirror(cc);
+  }
+  if (b.kind == OPD_IMM)
+    emit_imm(BC_BEQI + (cc - IR_EQ), reg(a), (int32_t) b.imm);
+  else
+    emit(BC_BEQ + (cc - IR_EQ), reg(a), reg(b), 0);
+  emit_target(BC_MOV, 0, bb);
+}
+
+// the operand is the temporary dst, and nothing else reads it
+static bool is_only_read(operand_t dst, operand_t opd)
+{
+  return dst.kind == OPD_TEMP && opd.kind == OPD_TEMP && opd.temp == dst.temp && reads[dst.temp] == 1;
+}
+
+static void gen_call(ins_t *ins)
+{
+  if (!strcmp(ins->func->name, "print")) {
+    emit(BC_PRINT, reg(ins->args[0]), 0, 0);
+    return;
+  }
+  for (uint32_t i = 0; i < ins->args_num; i++) {
+    operand_t arg = ins->args[i];
+    if (arg.kind == OPD_IMM)
+      emit_imm(BC_LOADI, i, (int32_t) arg.imm);
+    else
+      emit(BC_MOV, i, reg(arg), 0);
+    index_vec_push(&args, body.size - 1);
+  }
+  if (ins->args_num > max_args)
+    max_args = ins->args_num;
+  entry_t *entry = hashmap_get_cstr(func_index, ins->func->name);
+  emit(BC_CALL, reg(ins->dst), 0, (uint32_t) (uintptr_t) entry->val - 1);
+  index_vec_push(&calls, body.size - 1);
+}
+
+// code generation for the operations, whose result goes to dst
+static void gen_op(ins_t *ins, operand_t dst)
+{
+  uint32_t d = reg(dst);
+  switch (ins->op) {
+    case IR_MOV:
+      if (ins->a.kind == OPD_IMM)
+        emit_imm(BC_LOADI, d, (int32_t) ins->a.imm);
+      else if (reg(ins->a) != d)
+        emit(BC_MOV, d, reg(ins->a), 0);
+      return;
+    case IR_NEG:
+      emit(BC_NEG, d, reg(ins->a), 0);
+      return;
+    case IR_ADD:
+      // adding a small constant is common, e.g. i = i + 1
+      if (use_fusion && ins->b.kind == OPD_IMM && ins->a.kind != OPD_IMM && fits_int16(ins->b.imm)) {
+        emit(BC_ADDI, d, reg(ins->a), (uint16_t) ins->b.imm);
+        return;
+      }
+      if (use_fusion && ins->a.kind == OPD_IMM && ins->b.kind != OPD_IMM && fits_int16(ins->a.imm)) {
+        emit(BC_ADDI, d, reg(ins->b), (uint16_t) ins->a.imm);
+        return;
+      }
+      break;
+    case IR_SUB:
+      if (use_fusion && ins->b.kind == OPD_IMM && ins->a.kind != OPD_IMM && fits_int16(-ins->b.imm)) {
+        emit(BC_ADDI, d, reg(ins->a), (uint16_t) -ins->b.imm);
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+  emit(bc_ops[ins->op], d, reg(ins->a), reg(ins->b));
+}
+
+// code generation for instruction, where following is the next instruction in its block,
+// and next is the block laid out after it, return the number of instructions consumed
+static uint32_t gen_ins(ins_t *ins, ins_t *following, bb_t *next)
+{
+  switch (ins->op) {
+    case IR_JMP:
+      if (ins->target != next)
+        emit_target(BC_JMP, 0, ins->target);
+      return 1;
+    case IR_BR:
+      if (ins->target == next) {
+        emit_target(BC_JZ, reg(ins->a), ins->else_target);
+      } else {
+        emit_target(BC_JNZ, reg(ins->a), ins->target);
+        if (ins->else_target != next)
+          emit_target(BC_JMP, 0, ins->else_target);
+      }
+      return 1;
+    case IR_RET:
+      emit(BC_RET, reg(ins->a), 0, 0);
+      return 1;
+    case IR_CALL:
+      gen_call(ins);
+      return 1;
+    default:
+      break;
+  }
+
+  // a comparison only branched on is a compare-and-branch
+  if (use_fusion && is_compare(ins->op) && following && following->op == IR_BR
+      && is_only_read(ins->dst, following->a)) {
+    if (following->target == next) {
+      emit_branch(negate(ins->op), ins->a, ins->b, following->else_target);
+    } else {
+      emit_branch(ins->op, ins->a, ins->b, following->target);
+      if (following->else_target != next)
+        emit_target(BC_JMP, 0, following->else_target);
+    }
+    return 2;
+  }
+
+  // a result only moved to a variable is written to the variable directly
+  if (use_fusion && following && following->op == IR_MOV && is_only_read(ins->dst, following->a)) {
+    gen_op(ins, following->dst);
+    return 2;
+  }
+
+  gen_op(ins, ins->dst);
+  return 1;
+}
+
+static void gen_func(ir_func_t *func)
+{
+  curr_func = func;
+  values_num = ir_values_num(func);
+  consts = new_hashmap(16);
+  bc_ins_vec_init(&loads);
+  bc_ins_vec_init(&body);
+  fixup_vec_init(&fixups);
+  index_vec_init(&args);
+  index_vec_init(&calls);
+  max_args = 0;
+
+  reads = arena_calloc(curr_arena, func->temps_num + 1, sizeof(uint32_t));
+  for (size_t i = 0; i < func->blocks.size; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    for (size_t j = 0; j < bb->ins.size; j++) {
+      operand_t buf[2], *opds;
+      uint32_t num = ir_reads(ins_vec_at(&bb->ins, j), buf, &opds);
+      for (uint32_t k = 0; k < num; k++) {
+        if (opds[k].kind == OPD_TEMP)
+          reads[opds[k].temp]++;
+      }
+    }
+  }
+
+  // generate blocks in layout order
+  uint32_t *starts = arena_alloc(curr_arena, sizeof(uint32_t) * func->blocks.size);
+  for (size_t i = 0; i < func->blocks.size; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    bb_t *next = i + 1 < func->blocks.size ? *bb_vec_at(&func->blocks, i + 1) : NULL;
+    starts[i] = body.size;
+    for (size_t j = 0; j < bb->ins.size;) {
+      ins_t *following = j + 1 < bb->ins.size ? ins_vec_at(&bb->ins, j + 1) : NULL;
+      j += gen_ins(ins_vec_at(&bb->ins, j), following, next);
+    }
+  }
+
+  uint32_t frame_size = values_num + loads.size;
+  if (frame_size + max_args > UINT16_MAX) {
+    fprintf(stderr, "function \"%s\" has too many values for bytecode\n", func->func->name);
+    exit(1);
+  }
+  for (size_t i = 0; i < args.size; i++)
+    bc_ins_vec_at(&body, *index_vec_at(&args, i))->a += frame_size;
+  for (size_t i = 0; i < calls.size; i++)
+    bc_ins_vec_at(&body, *index_vec_at(&calls, i))->b = frame_size;
+
+  // main prints the hello message first, as it does in codegen
+  bool is_main = !strcmp(func->func->name, "main");
+  uint32_t entry = code.size;
+  uint32_t start = entry + is_main + loads.size;
+  for (size_t i = 0; i < fixups.size; i++) {
+    fixup_t *fixup = fixup_vec_at(&fixups, i);
+    bc_ins_vec_at(&body, fixup->at)->target = start + starts[fixup->bb->id];
+  }
+
+  if (is_main)
+    bc_ins_vec_push(&code, (bc_ins_t) { .op = BC_HELLO });
+  for (size_t i = 0; i < loads.size; i++)
+    bc_ins_vec_push(&code, *bc_ins_vec_at(&loads, i));
+  for (size_t i = 0; i < body.size; i++)
+    bc_ins_vec_push(&code, *bc_ins_vec_at(&body, i));
+
+  bc_func_vec_push(&funcs, (bc_func_t) {
+    .entry = entry,
+    .end = code.size,
+    .params_num = func->params.size,
+    .frame_size = frame_size,
+    .regs_num = frame_size + max_args,
+  });
+}
+
+// translate the ir of program into bytecode
+// print is not compiled, calls to it are print instructions, as it is in the runtime of codegen
+bc_prog_t *gen_bytecode(ir_func_t *prog)
+{
+  bc_ins_vec_init(&code);
+  bc_func_vec_init(&funcs);
+  func_index = new_hashmap(16);
+  uint32_t funcs_num = 0;
+  for (ir_func_t *func = prog; func; func = func->next) {
+    if (strcmp(func->func->name, "print"))
+      hashmap_add_cstr(func_index, func->func->name, (void *) (uintptr_t) ++funcs_num);
+  }
+
+  entry_t *main_entry = hashmap_get_cstr(func_index, "main");
+  if (!main_entry) {
+    fprintf(stderr, "undefined reference to \"main\"\n");
+    exit(1);
+  }
+
+  for (ir_func_t *func = prog; func; func = func->next) {
+    if (strcmp(func->func->name, "print"))
+      gen_func(func);
+  }
+
+  bc_prog_t *bc = arena_calloc(curr_arena, 1, sizeof(bc_prog_t));
+  bc->funcs_num = funcs.size;
+  bc->code_size = code.size;
+  bc->main = (uint32_t) (uintptr_t) main_entry->val - 1;
+  bc->funcs = funcs.data;
+  bc->code = code.data;
+#ifdef DEBUG
+  verify_bytecode(bc);
+#endif
+  return bc;
+}
+
+/* verify bytecode */
+
+// bytecode loaded from a file is verified before it runs, so that the vm needs no checks
+// other than the ones of stack: every register is in the window of its function,
+// and every jump lands on an instruction of its function
+
+static noreturn void bc_error(uint32_t at, char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static noreturn void bc_error(uint32_t at, char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "invalid bytecode at %u: ", at);
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+  exit(1);
+}
+
+static bool is_branch(uint8_t op)
+{
+  return op >= BC_BEQ && op <= BC_BGEI;
+}
+
+static bool has_target(uint8_t op)
+{
+  return op == BC_JMP || op == BC_JZ || op == BC_JNZ;
+}
+
+static void verify_regs(bc_func_t *func, uint32_t at, uint32_t num, ...)
+{
+  va_list ap;
+  va_start(ap, num);
+  for (uint32_t i = 0; i < num; i++) {
+    uint32_t r = va_arg(ap, uint32_t);
+    if (r >= func->regs_num)
+      bc_error(at, "register r%u out of window", r);
+  }
+  va_end(ap);
+}
+
+void verify_bytecode(bc_prog_t *prog)
+{
+  if (prog->main >= prog->funcs_num)
+    bc_error(0, "no main");
+
+  // the second slots of compare-and-branch, which are not instructions
+  bool *is_slot = calloc(prog->code_size + 1, sizeof(bool));
+  uint32_t end = 0;
+  for (uint32_t f = 0; f < prog->funcs_num; f++) {
+    bc_func_t *func = prog->funcs + f;
+    if (func->entry != end || func->end <= func->entry || func->end > prog->code_size)
+      bc_error(func->entry, "function %u out of place", f);
+    if (func->params_num > func->frame_size || func->frame_size > func->regs_num)
+      bc_error(func->entry, "bad window of function %u", f);
+    end = func->end;
+
+    uint8_t last = BC_OP_NUM;
+    for (uint32_t i = func->entry; i < func->end; i++) {
+      bc_ins_t *ins = prog->code + i;
+      switch (ins->op) {
+        case BC_MOV:
+        case BC_NEG:
+        case BC_ADDI: verify_regs(func, i, 2, ins->a, ins->b); break;
+        case BC_LOADI:
+        case BC_JZ:
+        case BC_JNZ:
+        case BC_RET:
+        case BC_PRINT: verify_regs(func, i, 1, ins->a); break;
+        case BC_ADD:
+        case BC_SUB:
+        case BC_MUL:
+        case BC_DIV:
+        case BC_EQ:
+        case BC_NE:
+        case BC_LT:
+        case BC_LE:
+        case BC_GT:
+        case BC_GE: verify_regs(func, i, 3, ins->a, ins->b, ins->c); break;
+        case BC_BEQ:
+        case BC_BNE:
+        case BC_BLT:
+        case BC_BLE:
+        case BC_BGT:
+        case BC_BGE: verify_regs(func, i, 2, ins->a, ins->b); break;
+        case BC_BEQI:
+        case BC_BNEI:
+        case BC_BLTI:
+        case BC_BLEI:
+        case BC_BGTI:
+        case BC_BGEI: verify_regs(func, i, 1, ins->a); break;
+        case BC_CALL:
+          verify_regs(func, i, 1, ins->a);
+          if (ins->c >= prog->funcs_num)
+            bc_error(i, "call of function %u out of program", ins->c);
+          if ((uint32_t) ins->b + prog->funcs[ins->c].params_num > func->regs_num)
+            bc_error(i, "arguments out of window");
+          break;
+        case BC_JMP:
+        case BC_HELLO: break;
+        default: bc_error(i, "unknown opcode %u", ins->op);
+      }
+      last = ins->op;
+      if (is_branch(ins->op)) {
+        if (++i == func->end)
+          bc_error(i - 1, "branch without target");
+        is_slot[i] = true;
+      }
+    }
+    if (last != BC_JMP && last != BC_RET)
+      bc_error(func->end - 1, "function %u does not end with jmp or ret", f);
+  }
+  if (end != prog->code_size)
+    bc_error(end, "code out of functions");
+
+  for (uint32_t f = 0; f < prog->funcs_num; f++) {
+    bc_func_t *func = prog->funcs + f;
+    for (uint32_t i = func->entry; i < func->end; i++) {
+      bc_ins_t *ins = prog->code + i;
+      uint32_t target;
+      if (is_branch(ins->op))
+        target = prog->code[++i].target;
+      else if (has_target(ins->op) && !is_slot[i])
+        target = ins->target;
+      else
+        continue;
+      if (target < func->entry || target >= func->end || is_slot[target])
+        bc_error(i, "jump to %u out of function %u", target, f);
+    }
+  }
+  free(is_slot);
+}
+
+/* .katc files */
+
+static noreturn void write_error(char *path)
+{
+  fprintf(stderr, "cannot write %s\n", path);
+  exit(1);
+}
+
+// write the program to the .katc file of path
+void write_bytecode(bc_prog_t *prog, char *path)
+{
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "cannot open %s\n", path);
+    exit(1);
+  }
+  katc_header_t header = {
+    .magic = KATC_MAGIC,
+    .version = KATC_VERSION,
+    .funcs_num = prog->funcs_num,
+    .code_size = prog->code_size,
+    .main = prog->main,
+  };
+  if (fwrite(&header, sizeof(header), 1, fp) != 1
+      || fwrite(prog->funcs, sizeof(bc_func_t), prog->funcs_num, fp) != prog->funcs_num
+      || fwrite(prog->code, sizeof(bc_ins_t), prog->code_size, fp) != prog->code_size)
+    write_error(path);
+  // buffered bytes are written when the file is closed, which fails on a full disk too
+  if (fclose(fp))
+    write_error(path);
+}
+
+// map the .katc file of path read-only, and verify the program in it
+bc_prog_t *load_bytecode(char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open bytecode file \"%s\": %s\n", path, strerror(errno));
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "cannot stat bytecode file \"%s\": %s\n", path, strerror(errno));
+    exit(1);
+  }
+  size_t size = st.st_size;
+  if (!S_ISREG(st.st_mode) || size < sizeof(katc_header_t)) {
+    fprintf(stderr, "\"%s\" is not a kat bytecode file\n", path);
+    exit(1);
+  }
+  char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "cannot map bytecode file \"%s\": %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  katc_header_t *header = (katc_header_t *) base;
+  uint64_t expected = sizeof(katc_header_t) + (uint64_t) header->funcs_num * sizeof(bc_func_t)
+                    + (uint64_t) header->code_size * sizeof(bc_ins_t);
+  if (memcmp(header->magic, KATC_MAGIC, 4) || header->version != KATC_VERSION || expected != size) {
+    fprintf(stderr, "\"%s\" is not a kat bytecode file\n", path);
+    exit(1);
+  }
+
+  bc_prog_t *prog = calloc(1, sizeof(bc_prog_t));
+  prog->funcs_num = header->funcs_num;
+  prog->code_size = header->code_size;
+  prog->main = header->main;
+  prog->funcs = (bc_func_t *) (base + sizeof(katc_header_t));
+  prog->code = (bc_ins_t *) (prog->funcs + prog->funcs_num);
+  prog->mapped = base;
+  prog->mapped_size = size;
+  verify_bytecode(prog);
+  return prog;
+}
+
+// release a program loaded by load_bytecode
+void unload_bytecode(bc_prog_t *prog)
+{
+  if (prog) {
+    munmap(prog->mapped, prog->mapped_size);
+    free(prog);
+  }
+}
@@ -1,5 +1,8 @@
 #include "codegen.h"
-#include "parse.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "x86.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -8,227 +11,539 @@
 char *source_file_path;
 char *output_file_path;
 FILE *output_file;
+obj_t *output_obj;  // the object encoded to, instead of printing assembly to output_file
 
-// emit instruction (a loc) to output file
-static void emit(char *fmt, ...) __attribute__((format(printf, 1, 2)));
-static void emit(char *fmt, ...)
+// instructions of current function, printed (or encoded) when the function is complete
+static x86_vec_t code;
+
+// apply the peephole rules before printing (--no-peephole prints the instructions as they are)
+bool use_peephole = true;
+
+static void emit(X86_OP op, x86_opd_t src, x86_opd_t dst)
+{
+  x86_vec_push(&code, (x86_ins_t) { .op = op, .src = src, .dst = dst });
+}
+
+// emit an instruction on addresses, e.g. on %esp, which are 64 bits on x86_64
+static void emit_wide(X86_OP op, x86_opd_t src, x86_opd_t dst)
+{
+  x86_vec_push(&code, (x86_ins_t) { .op = op, .wide = target == TARGET_X86_64, .src = src, .dst = dst });
+}
+
+static void emit_cc(X86_OP op, X86_CC cc, x86_opd_t opd)
+{
+  x86_vec_push(&code, (x86_ins_t) { .op = op, .cc = cc, .src = op == X86_JCC ? opd : x86_none(),
+                                    .dst = op == X86_JCC ? x86_none() : opd });
+}
+
+// emit a line of assembly, e.g. a directive
+static void emit_text(char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void emit_text(char *fmt, ...)
 {
   va_list ap;
   va_start(ap, fmt);
-  vfprintf(output_file, fmt, ap);
+  int len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+
+  char *line = arena_alloc(curr_arena, len + 1);
+  va_start(ap, fmt);
+  vsnprintf(line, len + 1, fmt, ap);
   va_end(ap);
-  fprintf(output_file, "\n");
-}
-
-static void gen_expr(node_t *node);
-static void gen_fncall(node_t *node);
-static void gen_decl_stmt(node_t *node);
-static void gen_expr_stmt(node_t *node);
-static void gen_if_stmt(node_t *node);
-static void gen_while_stmt(node_t *node);
-static void gen_return_stmt(node_t *node);
-static void gen_block(node_t *node);
-static void gen_func(node_t *node);
+  emit(X86_TEXT, x86_sym(line), x86_none());
+}
+
+// print the instructions emitted so far to output file
+static void flush(bool optimize)
+{
+  if (optimize && use_peephole)
+    peephole(&code);
+  if (output_obj) {
+    encode(output_obj, &code);
+  } else {
+    for (size_t i = 0; i < code.size; i++)
+      print_x86(x86_vec_at(&code, i), output_file);
+  }
+  x86_vec_clear(&code);
+}
+
+static void gen_func(ir_func_t *func);
 static void gen_data();
-static void gen_text(node_t *node);
+static void gen_text(ir_func_t *prog);
 
 static void gen_runtime_print();
 
-static void gen_expr(node_t *node)
+// the function being generated, and where its values are
+static ir_func_t *curr_func;
+static alloc_t *curr_alloc;
+static int32_t *homes;  // offsets to %ebp of the values in memory
+
+// allocate registers to values (--no-regalloc keeps all of them in memory)
+bool use_regalloc = true;
+
+// registers passing the first arguments on x86_64, the others are pushed right to left
+#define ARG_REGS_NUM 6
+static X86_REG arg_regs[ARG_REGS_NUM] = { X86_EDI, X86_ESI, X86_EDX, X86_ECX, X86_R8, X86_R9 };
+
+// size of the words pushed to stack
+static int word_size()
 {
-  if (node) {
-    if (node->type == ND_NUM)
-    {
-      emit("  pushl $%ld", node->ival);
-      return;
-    }
+  return target == TARGET_X86_64 ? 8 : 4;
+}
 
-    if (node->type == ND_VAR) {
-      emit("  pushl %d(%%ebp)", node->var->offset);
-      return;
-    }
+// the machine register of an allocated register
+static X86_REG machine_reg(int reg)
+{
+  return target_regs()->regs[reg];
+}
 
-    if (node->type == ND_FNCALL) {
-      gen_fncall(node);
-      return;
+// location of operand, an immediate, a register or a slot below %ebp
+static x86_opd_t loc(operand_t opd)
+{
+  switch (opd.kind) {
+    case OPD_IMM:
+      // int is 32 bits, so a literal too large for it wraps around
+      return x86_imm((int32_t) opd.imm);
+    case OPD_TEMP:
+    case OPD_VAR: {
+      uint32_t value = ir_value(curr_func, opd);
+      int8_t reg = curr_alloc->regs[value];
+      return reg == REG_NONE ? x86_mem(X86_EBP, homes[value]) : x86_reg(machine_reg(reg));
     }
-
-    gen_expr(node->lhs);
-    gen_expr(node->rhs);
-
-    emit("  popl %%edi");
-    emit("  popl %%eax");
-
-    switch (node->op->type) {
-    case ND_ADD:
-      emit("  addl %%edi, %%eax");
-      break;
-    case ND_SUB:
-      emit("  subl %%edi, %%eax\n");
-      break;
-    case ND_MUL:
-      emit("  imul %%edi, %%eax");
-      break;
-    case ND_DIV:
-      emit("  cqo");
-      emit("  idiv %%eax");
-      break;
-    case ND_ASSIGN:
-    case ND_LOGAND:
-    case ND_LOGOR:
-    case ND_EQ:
-    case ND_NE:
-    case ND_LT:
-    case ND_LE:
-    case ND_GT:
-    case ND_GE:
-      fprintf(stdout, "not implemented yet\n");
+    default:
+      fprintf(stderr, "missing operand in %s at line %d\n", __FILE__, __LINE__);
       exit(1);
-    }
+  }
+}
+
+static bool in_register(operand_t opd)
+{
+  return loc(opd).kind == X86_OPD_REG;
+}
+
+static bool in_memory(operand_t opd)
+{
+  return loc(opd).kind == X86_OPD_MEM;
+}
+
+// true if the operands are at the same place
+static bool same_loc(operand_t x, operand_t y)
+{
+  return x.kind != OPD_IMM && y.kind != OPD_IMM && x86_same_opd(loc(x), loc(y));
+}
 
-    emit("  pushl %%eax");
+static void load(X86_REG reg, operand_t opd)
+{
+  emit(X86_MOV, loc(opd), x86_reg(reg));
+}
+
+static void store(operand_t opd, X86_REG reg)
+{
+  if (!x86_is_reg(loc(opd), reg))
+    emit(X86_MOV, x86_reg(reg), loc(opd));
+}
+
+// dst = src, through %eax if both are in memory
+static void move(operand_t dst, operand_t src)
+{
+  if (same_loc(dst, src))
+    return;
+  if (in_memory(dst) && in_memory(src)) {
+    load(X86_EAX, src);
+    store(dst, X86_EAX);
+  } else {
+    emit(X86_MOV, loc(src), loc(dst));
   }
 }
 
-static void gen_fncall(node_t *node)
+// local label of basic block
+static x86_opd_t bb_label(bb_t *bb)
 {
-  // TODO: generate code for normal functions
-  // runtime print integer function
-  if (!strcmp(node->func->name, "print")) {
-    gen_expr(node->params);
-    emit("  call print");
+  return x86_label(curr_func->func->name, bb->id);
+}
+
+static X86_OP arith_ops[] = {
+  [IR_ADD] = X86_ADD,
+  [IR_SUB] = X86_SUB,
+  [IR_MUL] = X86_IMUL,
+};
+
+// condition codes of comparisons
+static X86_CC compare_ccs[] = {
+  [IR_EQ] = X86_CC_E,
+  [IR_NE] = X86_CC_NE,
+  [IR_LT] = X86_CC_L,
+  [IR_LE] = X86_CC_LE,
+  [IR_GT] = X86_CC_G,
+  [IR_GE] = X86_CC_GE,
+};
+
+// true if the operand reads the register, as a value or as the base of memory
+static bool reads_reg(x86_opd_t opd, x86_opd_t reg)
+{
+  return (opd.kind == X86_OPD_REG || opd.kind == X86_OPD_MEM) && opd.reg == reg.reg;
+}
+
+// move srcs to dsts at once, where a source may be the destination of another move
+// destinations are distinct, and only the registers among them may be read by other moves,
+// so a move goes once no pending move reads its destination, and a cycle is broken through %eax
+static void parallel_move(x86_opd_t *dsts, x86_opd_t *srcs, int num)
+{
+  bool done[ARG_REGS_NUM] = { false };
+  int left = num;
+  while (left > 0) {
+    bool progress = false;
+    for (int i = 0; i < num; i++) {
+      bool blocked = false;
+      for (int j = 0; j < num && !done[i] && !blocked; j++)
+        blocked = j != i && !done[j] && dsts[i].kind == X86_OPD_REG && reads_reg(srcs[j], dsts[i]);
+      if (done[i] || blocked)
+        continue;
+      if (!x86_same_opd(srcs[i], dsts[i]))
+        emit(X86_MOV, srcs[i], dsts[i]);
+      done[i] = true;
+      left--;
+      progress = true;
+    }
+    if (progress)
+      continue;
+
+    // every pending destination is read by another move, so they form cycles
+    int i = 0;
+    while (done[i])
+      i++;
+    emit(X86_MOV, dsts[i], x86_reg(X86_EAX));
+    for (int j = 0; j < num; j++) {
+      if (!done[j] && x86_same_opd(srcs[j], dsts[i]))
+        srcs[j] = x86_reg(X86_EAX);
+    }
   }
 }
 
-static void gen_decl_stmt(node_t *node)
+// i386: arguments are pushed right to left, and popped by the caller (cdecl)
+// x86_64: the first arguments are passed in registers, and the others are pushed,
+// so that the stack is 16-byte aligned at the call (system v)
+static void gen_call(ins_t *ins)
 {
-  if (node->op) { // initialized declaration
-    gen_expr(node->rhs);  // generate expression on the lhs, the value of expression is stored in %eax
-    emit("  popl %%eax");
-    emit("  movl %%eax, %d(%%ebp)", node->lhs->var->offset);
-  } else {  // unintialized declaration
-    // do nothing
+  uint32_t in_regs = 0, pad = 0;
+  if (target == TARGET_X86_64) {
+    in_regs = ins->args_num < ARG_REGS_NUM ? ins->args_num : ARG_REGS_NUM;
+    pad = (ins->args_num - in_regs) % 2;
+    if (pad)
+      emit_wide(X86_SUB, x86_imm(8), x86_reg(X86_ESP));
+  }
+
+  for (uint32_t i = ins->args_num; i > in_regs; i--)
+    emit(X86_PUSH, loc(ins->args[i - 1]), x86_none());
+
+  if (target == TARGET_X86_64) {
+    x86_opd_t dsts[ARG_REGS_NUM], srcs[ARG_REGS_NUM];
+    for (uint32_t i = 0; i < in_regs; i++) {
+      dsts[i] = x86_reg(arg_regs[i]);
+      srcs[i] = loc(ins->args[i]);
+    }
+    parallel_move(dsts, srcs, in_regs);
   }
+
+  emit(X86_CALL, x86_sym(ins->func->name), x86_none());
+  uint32_t pushed = ins->args_num - in_regs + pad;
+  if (pushed)
+    emit_wide(X86_ADD, x86_imm(pushed * word_size()), x86_reg(X86_ESP));
+  store(ins->dst, X86_EAX);
 }
 
-static void gen_expr_stmt(node_t *node)
+// dst = a op b for add, sub and mul
+// the result is computed in the register of dst, or in %eax if dst is in memory
+static void gen_arith(ins_t *ins)
 {
-  gen_expr(node->rhs);  // generate expression on the lhs, the value of expression is stored in %eax
-  if (node->lhs) {
-    emit("  popl %%eax");
-    emit("  movl %%eax, %d(%%ebp)", node->lhs->var->offset);
+  X86_OP op = arith_ops[ins->op];
+  bool in_reg = in_register(ins->dst);
+  if (in_reg && same_loc(ins->dst, ins->b) && !same_loc(ins->dst, ins->a)) {
+    if (ins->op != IR_SUB) {  // commutative
+      emit(op, loc(ins->a), loc(ins->dst));
+      return;
+    }
+    in_reg = false;
+  }
+
+  if (in_reg) {
+    move(ins->dst, ins->a);
+    emit(op, loc(ins->b), loc(ins->dst));
+  } else {
+    load(X86_EAX, ins->a);
+    emit(op, loc(ins->b), x86_reg(X86_EAX));
+    store(ins->dst, X86_EAX);
   }
 }
 
-static void gen_if_stmt(node_t *node)
+// set the flags by comparing a with b
+// a is compared where it is unless it is an immediate, or both are in memory
+static void gen_cmp(operand_t a, operand_t b)
 {
+  x86_opd_t x = loc(a);
+  x86_opd_t y = loc(b);
+  if (x.kind == X86_OPD_IMM || (x.kind == X86_OPD_MEM && y.kind == X86_OPD_MEM)) {
+    load(X86_EAX, a);
+    x = x86_reg(X86_EAX);
+  }
+  emit(X86_CMP, y, x);
 }
 
-static void gen_while_stmt(node_t *node)
+// jump to target if cc holds, or to else_target
+static void gen_branch(X86_CC cc, bb_t *target, bb_t *else_target, bb_t *next)
 {
+  if (target == next) {
+    emit_cc(X86_JCC, x86_negate_cc(cc), bb_label(else_target));
+  } else {
+    emit_cc(X86_JCC, cc, bb_label(target));
+    if (else_target != next)
+      emit(X86_JMP, bb_label(else_target), x86_none());
+  }
 }
 
-// the return value is stored in %eax
-static void gen_return_stmt(node_t *node)
+// restore the callee-saved registers and return
+static void gen_epilogue()
 {
-  gen_expr(node->rhs);
-  emit("  popl %%eax");
-  emit("  movl %%ebp, %%esp");
-  emit("  popl %%ebp");
-  emit("  ret");
+  for (int r = target_regs()->callee_saved; r-- > 0;) {
+    if (curr_alloc->used[r])
+      emit(X86_POP, x86_none(), x86_reg(machine_reg(r)));
+  }
+  emit_wide(X86_MOV, x86_reg(X86_EBP), x86_reg(X86_ESP));
+  emit(X86_POP, x86_none(), x86_reg(X86_EBP));
+  emit(X86_RET, x86_none(), x86_none());
 }
 
-// code generation for block of stmts
-// node->type == ND_BLOCK
-static void gen_block(node_t *node)
+// lower an instruction, return the number of instructions lowered
+// %eax is the scratch register, the other registers hold values (see regalloc.h)
+// following is the next instruction in the block, and next is the block placed after
+// current block, which is reached without a jump
+// temporaries are read once, so a comparison whose result is only branched on by the
+// following instruction is lowered together with it into a conditional jump
+static int gen_ins(ins_t *ins, ins_t *following, bb_t *next)
 {
-  while (node) {
-    switch (node->type) {
-    case ND_DECL_STMT: gen_decl_stmt(node); break;
-    case ND_EXPR_STMT: gen_expr_stmt(node); break;
-    case ND_IF: gen_if_stmt(node); break;
-    case ND_WHILE: gen_while_stmt(node); break;
-    case ND_RETURN: gen_return_stmt(node); break;
+  switch (ins->op) {
+    case IR_MOV:
+      move(ins->dst, ins->a);
+      return 1;
+    case IR_NEG:
+      if (in_register(ins->dst) || same_loc(ins->dst, ins->a)) {
+        move(ins->dst, ins->a);
+        emit(X86_NEG, x86_none(), loc(ins->dst));
+      } else {
+        load(X86_EAX, ins->a);
+        emit(X86_NEG, x86_none(), x86_reg(X86_EAX));
+        store(ins->dst, X86_EAX);
+      }
+      return 1;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+      gen_arith(ins);
+      return 1;
+    case IR_DIV:
+      // cltd overwrites %edx, so the divisor is pushed if it is there (or an immediate)
+      load(X86_EAX, ins->a);
+      if (ins->b.kind == OPD_IMM || x86_is_reg(loc(ins->b), X86_EDX)) {
+        emit(X86_PUSH, loc(ins->b), x86_none());
+        emit(X86_CLTD, x86_none(), x86_none());
+        emit(X86_IDIV, x86_none(), x86_mem(X86_ESP, 0));
+        emit_wide(X86_ADD, x86_imm(word_size()), x86_reg(X86_ESP));
+      } else {
+        emit(X86_CLTD, x86_none(), x86_none());
+        emit(X86_IDIV, x86_none(), loc(ins->b));
+      }
+      store(ins->dst, X86_EAX);
+      return 1;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+      gen_cmp(ins->a, ins->b);
+      if (following && following->op == IR_BR && ins->dst.kind == OPD_TEMP &&
+          following->a.kind == OPD_TEMP && following->a.temp == ins->dst.temp) {
+        gen_branch(compare_ccs[ins->op], following->target, following->else_target, next);
+        return 2;
+      }
+      emit_cc(X86_SETCC, compare_ccs[ins->op], x86_reg(X86_EAX));
+      if (in_register(ins->dst)) {
+        emit(X86_MOVZB, x86_reg(X86_EAX), loc(ins->dst));
+      } else {
+        emit(X86_MOVZB, x86_reg(X86_EAX), x86_reg(X86_EAX));
+        store(ins->dst, X86_EAX);
+      }
+      return 1;
+    case IR_CALL:
+      gen_call(ins);
+      return 1;
+    case IR_JMP:
+      if (ins->target != next)
+        emit(X86_JMP, bb_label(ins->target), x86_none());
+      return 1;
+    case IR_BR:
+      if (in_register(ins->a)) {
+        emit(X86_TEST, loc(ins->a), loc(ins->a));
+      } else if (in_memory(ins->a)) {
+        emit(X86_CMP, x86_imm(0), loc(ins->a));
+      } else {
+        load(X86_EAX, ins->a);
+        emit(X86_TEST, x86_reg(X86_EAX), x86_reg(X86_EAX));
+      }
+      gen_branch(X86_CC_NE, ins->target, ins->else_target, next);
+      return 1;
+    case IR_RET:
+      // the return value is stored in %eax
+      load(X86_EAX, ins->a);
+      gen_epilogue();
+      return 1;
     default:
       fprintf(stderr, "not implemented yet\n");
       exit(1);
-    }
-    node = node->next;
   }
 }
 
-// calculate how many bytes needed by the local variables
-// also set the offset off the stack for these variables
-static size_t calculate_stack_size(node_t *node)
+// lay out the frame of function
+// the parameters pushed by the caller are above the return address,
+// i386: 4 bytes each from 8(%ebp), x86_64: 8 bytes each from 16(%rbp), after the ones in registers
+// the other values in memory are below %ebp
+// return the size of frame
+static size_t layout_frame(ir_func_t *func)
+{
+  uint32_t values_num = ir_values_num(func);
+  uint32_t in_regs = target == TARGET_X86_64 ? ARG_REGS_NUM : 0;
+  homes = arena_alloc(curr_arena, sizeof(int32_t) * (values_num + 1));
+  size_t slots = 0;
+  for (uint32_t v = 0; v < values_num; v++) {
+    uint32_t param = v - func->temps_num;
+    bool is_param = v >= func->temps_num && param < func->params.size;
+    if (is_param && param >= in_regs)
+      homes[v] = 2 * word_size() + (param - in_regs) * word_size();
+    else if (curr_alloc->regs[v] == REG_NONE)
+      homes[v] = -(int32_t) ++slots * 4;
+  }
+  return slots * 4;
+}
+
+// the hello message of main, printed before anything else
+static void gen_hello()
 {
-  // iterate through all the stmts in function body
-  // stack only grows when delaration appears
-  size_t stack_size = 0;
-  node_t *stmt = node->body;
-  while(stmt) {
-    if (stmt->type == ND_DECL_STMT) {
-      stack_size += stmt->lhs->var->type->size;
-      stmt->lhs->var->offset = -stack_size;
+  if (target == TARGET_I386) {
+    emit(X86_PUSH, x86_sym("msg"), x86_none());
+    emit(X86_CALL, x86_sym("printf"), x86_none());
+    emit(X86_ADD, x86_imm(4), x86_reg(X86_ESP));
+    return;
+  }
+
+  // the parameters of main are still in registers, which printf clobbers
+  int saved = curr_func->params.size < ARG_REGS_NUM ? curr_func->params.size : ARG_REGS_NUM;
+  for (int i = 0; i < saved; i++)
+    emit(X86_PUSH, x86_reg(arg_regs[i]), x86_none());
+  if (saved % 2)
+    emit_wide(X86_SUB, x86_imm(8), x86_reg(X86_ESP));
+  emit_wide(X86_LEA, x86_rip("msg"), x86_reg(X86_EDI));
+  emit(X86_XOR, x86_reg(X86_EAX), x86_reg(X86_EAX));  // no vector registers for varargs
+  emit(X86_CALL, x86_sym("printf@PLT"), x86_none());
+  if (saved % 2)
+    emit_wide(X86_ADD, x86_imm(8), x86_reg(X86_ESP));
+  for (int i = saved; i-- > 0;)
+    emit(X86_POP, x86_none(), x86_reg(arg_regs[i]));
+}
+
+// move the parameters to where they are allocated
+// the ones in registers go first, since the others may be allocated to their registers
+static void gen_params()
+{
+  ir_func_t *func = curr_func;
+  size_t in_regs = 0;
+  if (target == TARGET_X86_64) {
+    x86_opd_t dsts[ARG_REGS_NUM], srcs[ARG_REGS_NUM];
+    for (; in_regs < ARG_REGS_NUM && in_regs < func->params.size; in_regs++) {
+      dsts[in_regs] = loc((operand_t) { .kind = OPD_VAR, .var = *var_vec_at(&func->params, in_regs) });
+      srcs[in_regs] = x86_reg(arg_regs[in_regs]);
     }
-    stmt = stmt->next;
+    parallel_move(dsts, srcs, in_regs);
+  }
+
+  for (size_t i = in_regs; i < func->params.size; i++) {
+    int8_t reg = curr_alloc->regs[func->temps_num + i];
+    if (reg != REG_NONE)
+      emit(X86_MOV, x86_mem(X86_EBP, homes[func->temps_num + i]), x86_reg(machine_reg(reg)));
   }
-  return stack_size;
 }
 
 // code generation for function definition
-// node->type == ND_FUNC
-static void gen_func(node_t *node)
+static void gen_func(ir_func_t *func)
 {
-  if (!strcmp(node->func->name, "print")) {
+  curr_func = func;
+  char *name = func->func->name;
+  if (!strcmp(name, "print")) {
     gen_runtime_print();
     return;
   }
 
+  curr_alloc = use_regalloc ? regalloc(func) : spill_all(func);
+  reg_set_t *regs = target_regs();
+
   // gnu gas directives for functions
-  emit(".type %s, @function", node->func->name);
-  emit(".globl %s", node->func->name);
-  emit("%s:", node->func->name);
+  emit(X86_GLOBAL, x86_sym(name), x86_none());
+  emit(X86_LABEL, x86_sym(name), x86_none());
 
   // save stack frame
-  emit("  pushl %%ebp");
-  emit("  movl %%esp, %%ebp");
+  emit(X86_PUSH, x86_reg(X86_EBP), x86_none());
+  emit_wide(X86_MOV, x86_reg(X86_ESP), x86_reg(X86_EBP));
 
-  // reserve space for local variables on the stack
-  size_t stack_size = calculate_stack_size(node);
+  // reserve space for the values in memory on the stack
+  // on x86_64 the frame is padded so that the stack stays 16-byte aligned for calls
+  size_t stack_size = layout_frame(func);
+  if (target == TARGET_X86_64) {
+    size_t saved = 0;
+    for (int r = 0; r < regs->callee_saved; r++)
+      saved += curr_alloc->used[r] * 8;
+    stack_size = (stack_size + saved + 15) / 16 * 16 - saved;
+  }
 #ifdef DEBUG
-  printf("stack size of function \"%s\" is %ld\n", node->func->name, stack_size);
+  printf("stack size of function \"%s\" is %ld\n", name, stack_size);
 #endif
   if (stack_size > 0)
-    emit("  subl $%ld, %%esp", stack_size);
-  // emit("  pusha");
+    emit_wide(X86_SUB, x86_imm(stack_size), x86_reg(X86_ESP));
+
+  // save the callee-saved registers used
+  for (int r = 0; r < regs->callee_saved; r++) {
+    if (curr_alloc->used[r])
+      emit(X86_PUSH, x86_reg(machine_reg(r)), x86_none());
+  }
 
   // so I add this message for main
   // every kat program will print this hello message :^)
-  if (!strcmp(node->func->name, "main")) {
-    emit("  push $msg");
-    emit("  call printf");
-    emit("  add $4, %%esp");
-  }
+  if (!strcmp(name, "main"))
+    gen_hello();
 
-  // generate function body
-  if (node->body)
-    gen_block(node->body);
+  gen_params();
 
-  // restore stack frame
-  // emit("  popa");
-  emit("  movl %%ebp, %%esp");
-  emit("  popl %%ebp");
-  emit("  ret");
+  // generate blocks in layout order, every block ends with a terminator
+  for (size_t i = 0; i < func->blocks.size; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    bb_t *next = i + 1 < func->blocks.size ? *bb_vec_at(&func->blocks, i + 1) : NULL;
+    if (i > 0)
+      emit(X86_LABEL, bb_label(bb), x86_none());
+    for (size_t j = 0; j < bb->ins.size;) {
+      ins_t *following = j + 1 < bb->ins.size ? ins_vec_at(&bb->ins, j + 1) : NULL;
+      j += gen_ins(ins_vec_at(&bb->ins, j), following, next);
+    }
+  }
+
+  flush(true);
 }
 
 static void gen_data()
 {
-  emit(".section .data");
-  emit("msg:");
-  emit("  .asciz \"hello, friends :^)\\n\"");
-  emit("number_formatter:");
-  emit("  .asciz \"%%d\\n\"");
-  emit("");
+  emit(X86_SECTION, x86_sym(".data"), x86_none());
+  emit(X86_LABEL, x86_sym("msg"), x86_none());
+  emit(X86_STRING, x86_sym("hello, friends :^)\n"), x86_none());
+  emit(X86_LABEL, x86_sym("number_formatter"), x86_none());
+  emit(X86_STRING, x86_sym("%d\n"), x86_none());
+  emit_text("%s", "");
+  flush(false);
 }
 
 // static void gen_bss()
@@ -236,40 +551,179 @@ static void gen_data()
 //   emit("  .section .bss");
 // }
 
-// print the integer stored in %eax
+// print the integer passed as the argument
 static void gen_runtime_print()
 {
-  emit(".type print, @function");
-  emit(".globl print");
-  emit("print:");
-  emit("  pushl %%ebp");
-  emit("  movl %%esp, %%ebp");
-  emit("  pushl %%eax");
-  emit("  pushl $number_formatter");
-  emit("  call printf");
-  emit("  add $8, %%esp");
-  emit("  movl %%ebp, %%esp");
-  emit("  popl %%ebp");
-  emit("  ret");
-  emit("");
-}
-
-static void gen_text(node_t *tree)
-{
-  node_t *node = tree;
-  if (node->type == ND_PROG) {
-    emit(".section .text");
-    node_t *func = node->body;
-    while (func) {
-      gen_func(func);
-      func = func->next;
-    }
+  emit(X86_GLOBAL, x86_sym("print"), x86_none());
+  emit(X86_LABEL, x86_sym("print"), x86_none());
+  emit(X86_PUSH, x86_reg(X86_EBP), x86_none());
+  emit_wide(X86_MOV, x86_reg(X86_ESP), x86_reg(X86_EBP));
+  if (target == TARGET_I386) {
+    emit(X86_PUSH, x86_mem(X86_EBP, 8), x86_none());
+    emit(X86_PUSH, x86_sym("number_formatter"), x86_none());
+    emit(X86_CALL, x86_sym("printf"), x86_none());
+    emit(X86_ADD, x86_imm(8), x86_reg(X86_ESP));
+  } else {
+    emit(X86_MOV, x86_reg(X86_EDI), x86_reg(X86_ESI));
+    emit_wide(X86_LEA, x86_rip("number_formatter"), x86_reg(X86_EDI));
+    emit(X86_XOR, x86_reg(X86_EAX), x86_reg(X86_EAX));
+    emit(X86_CALL, x86_sym("printf@PLT"), x86_none());
+  }
+  emit_wide(X86_MOV, x86_reg(X86_EBP), x86_reg(X86_ESP));
+  emit(X86_POP, x86_none(), x86_reg(X86_EBP));
+  emit(X86_RET, x86_none(), x86_none());
+  emit_text("%s", "");
+  flush(false);
+}
+
+static void gen_text(ir_func_t *prog)
+{
+  emit(X86_SECTION, x86_sym(".text"), x86_none());
+  flush(false);
+  for (ir_func_t *func = prog; func; func = func->next)
+    gen_func(func);
+}
+
+// the entry of program, which calls main and exits with what main returns
+static void gen_runtime_start()
+{
+  emit(X86_GLOBAL, x86_sym("_start"), x86_none());
+  emit(X86_LABEL, x86_sym("_start"), x86_none());
+  // on i386 argc and argv are on the stack already, where main takes its arguments,
+  // on x86_64 they are loaded to the argument registers
+  if (target == TARGET_X86_64) {
+    emit(X86_MOV, x86_mem(X86_ESP, 0), x86_reg(X86_EDI));
+    emit_wide(X86_LEA, x86_mem(X86_ESP, 8), x86_reg(X86_ESI));
   }
+  emit(X86_CALL, x86_sym("main"), x86_none());
+  if (target == TARGET_I386) {
+    emit(X86_MOV, x86_reg(X86_EAX), x86_reg(X86_EBX));
+    emit(X86_MOV, x86_imm(1), x86_reg(X86_EAX));  // exit
+  } else {
+    emit(X86_MOV, x86_reg(X86_EAX), x86_reg(X86_EDI));
+    emit(X86_MOV, x86_imm(60), x86_reg(X86_EAX));  // exit
+  }
+  emit(X86_SYSCALL, x86_none(), x86_none());
+  flush(false);
 }
 
-void codegen(node_t *tree)
+// printf of the two formats kat passes, the hello message of main and "%d\n" of print,
+// which writes with the system call, so that programs need no libc
+// the digits are formatted backwards from the end of a buffer on the stack,
+// and the remainders of a negative number are negative, so that INT32_MIN needs no special case
+static void gen_runtime_printf()
 {
+  bool is_64 = target == TARGET_X86_64;
+  X86_REG fmt = is_64 ? X86_EDI : X86_ESI;
+  X86_REG ptr = is_64 ? X86_ESI : X86_EDI;   // the end of string, or the first digit
+  X86_REG sign = is_64 ? X86_R8 : X86_EBX;   // the number
+  X86_REG buf = is_64 ? X86_ESI : X86_ECX;   // the arguments of write
+  X86_REG len = X86_EDX;
+  x86_opd_t end = x86_mem(X86_EBP, is_64 ? 0 : -12);  // the end of buffer, below the saved registers
+  x86_opd_t number = x86_label("printf", 0), length = x86_label("printf", 1), string = x86_label("printf", 2);
+  x86_opd_t digit = x86_label("printf", 3), positive = x86_label("printf", 4), digits = x86_label("printf", 5);
+  x86_opd_t write = x86_label("printf", 6);
+
+  emit(X86_GLOBAL, x86_sym("printf"), x86_none());
+  emit(X86_LABEL, x86_sym("printf"), x86_none());
+  emit(X86_PUSH, x86_reg(X86_EBP), x86_none());
+  emit_wide(X86_MOV, x86_reg(X86_ESP), x86_reg(X86_EBP));
+  if (!is_64) {
+    emit(X86_PUSH, x86_reg(X86_EBX), x86_none());
+    emit(X86_PUSH, x86_reg(X86_ESI), x86_none());
+    emit(X86_PUSH, x86_reg(X86_EDI), x86_none());
+    emit(X86_MOV, x86_mem(X86_EBP, 8), x86_reg(fmt));
+  }
+  emit_wide(X86_SUB, x86_imm(16), x86_reg(X86_ESP));
+  emit(X86_MOVZB, x86_mem(fmt, 0), x86_reg(X86_EAX));
+  emit(X86_CMP, x86_imm('%'), x86_reg(X86_EAX));
+  emit_cc(X86_JCC, X86_CC_E, number);
+
+  // the string as it is
+  emit_wide(X86_MOV, x86_reg(fmt), x86_reg(ptr));
+  emit(X86_LABEL, length, x86_none());
+  emit(X86_MOVZB, x86_mem(ptr, 0), x86_reg(X86_EAX));
+  emit(X86_TEST, x86_reg(X86_EAX), x86_reg(X86_EAX));
+  emit_cc(X86_JCC, X86_CC_E, string);
+  emit_wide(X86_ADD, x86_imm(1), x86_reg(ptr));
+  emit(X86_JMP, length, x86_none());
+  emit(X86_LABEL, string, x86_none());
+  emit_wide(X86_MOV, x86_reg(ptr), x86_reg(len));
+  emit_wide(X86_SUB, x86_reg(fmt), x86_reg(len));
+  emit_wide(X86_MOV, x86_reg(fmt), x86_reg(buf));
+  emit(X86_JMP, write, x86_none());
+
+  // the number, and a newline
+  emit(X86_LABEL, number, x86_none());
+  emit(X86_MOV, is_64 ? x86_reg(X86_ESI) : x86_mem(X86_EBP, 12), x86_reg(X86_EAX));
+  emit(X86_MOV, x86_reg(X86_EAX), x86_reg(sign));
+  emit_wide(X86_LEA, end, x86_reg(ptr));
+  emit_wide(X86_SUB, x86_imm(1), x86_reg(ptr));
+  emit(X86_MOVB, x86_imm('\n'), x86_mem(ptr, 0));
+  emit(X86_MOV, x86_imm(10), x86_reg(X86_ECX));
+  emit(X86_LABEL, digit, x86_none());
+  emit(X86_CLTD, x86_none(), x86_none());
+  emit(X86_IDIV, x86_none(), x86_reg(X86_ECX));
+  emit(X86_TEST, x86_reg(X86_EDX), x86_reg(X86_EDX));
+  emit_cc(X86_JCC, X86_CC_GE, positive);
+  emit(X86_NEG, x86_none(), x86_reg(X86_EDX));
+  emit(X86_LABEL, positive, x86_none());
+  emit(X86_ADD, x86_imm('0'), x86_reg(X86_EDX));
+  emit_wide(X86_SUB, x86_imm(1), x86_reg(ptr));
+  emit(X86_MOVB, x86_reg(X86_EDX), x86_mem(ptr, 0));
+  emit(X86_TEST, x86_reg(X86_EAX), x86_reg(X86_EAX));
+  emit_cc(X86_JCC, X86_CC_NE, digit);
+  emit(X86_TEST, x86_reg(sign), x86_reg(sign));
+  emit_cc(X86_JCC, X86_CC_GE, digits);
+  emit_wide(X86_SUB, x86_imm(1), x86_reg(ptr));
+  emit(X86_MOVB, x86_imm('-'), x86_mem(ptr, 0));
+  emit(X86_LABEL, digits, x86_none());
+  emit_wide(X86_LEA, end, x86_reg(len));
+  emit_wide(X86_SUB, x86_reg(ptr), x86_reg(len));
+  if (buf != ptr)
+    emit(X86_MOV, x86_reg(ptr), x86_reg(buf));
+
+  // write(1, buf, len)
+  emit(X86_LABEL, write, x86_none());
+  if (is_64) {
+    emit(X86_MOV, x86_imm(1), x86_reg(X86_EAX));
+    emit(X86_MOV, x86_imm(1), x86_reg(X86_EDI));
+    emit(X86_SYSCALL, x86_none(), x86_none());
+  } else {
+    emit(X86_MOV, x86_imm(4), x86_reg(X86_EAX));
+    emit(X86_MOV, x86_imm(1), x86_reg(X86_EBX));
+    emit(X86_SYSCALL, x86_none(), x86_none());
+    emit(X86_ADD, x86_imm(16), x86_reg(X86_ESP));
+    emit(X86_POP, x86_none(), x86_reg(X86_EDI));
+    emit(X86_POP, x86_none(), x86_reg(X86_ESI));
+    emit(X86_POP, x86_none(), x86_reg(X86_EBX));
+  }
+  emit_wide(X86_MOV, x86_reg(X86_EBP), x86_reg(X86_ESP));
+  emit(X86_POP, x86_none(), x86_reg(X86_EBP));
+  emit(X86_RET, x86_none(), x86_none());
+  flush(false);
+}
+
+// generate the runtime, which kat programs are linked with when they are not linked by gcc
+void codegen_runtime()
+{
+  x86_vec_init(&code);
+  emit(X86_SECTION, x86_sym(".text"), x86_none());
+  gen_runtime_start();
+  gen_runtime_printf();
+}
+
+// lower the ir of program to assembly, or to machine code in output_obj
+void codegen(ir_func_t *prog)
+{
+  x86_vec_init(&code);
   gen_data();
   // gen_bss();
-  gen_text(tree);
+  gen_text(prog);
+
+  // the stack is not executable
+  if (target == TARGET_X86_64) {
+    emit_text(".section .note.GNU-stack,\"\",@progbits");
+    flush(false);
+  }
 }
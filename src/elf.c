@@ -0,0 +1,378 @@
+#include "obj.h"
+#include "arena.h"
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// elf files of objects, relocatable (ET_REL) or executable (ET_EXEC)
+//
+// elf32 (i386) and elf64 (x86_64) have the same structures with fields of different sizes,
+// so the fields are written one by one, an address (or an offset) is a word of 4 or 8 bytes
+// the file is built in memory, and written at once
+
+static byte_vec_t *out;
+static int word;  // the size of address
+
+// write the little-endian value of size bytes
+static void put(uint64_t val, int size)
+{
+  for (int i = 0; i < size; i++)
+    byte_vec_push(out, (uint8_t) (val >> (8 * i)));
+}
+
+static void put_word(uint64_t val)
+{
+  put(val, word);
+}
+
+static void put_bytes(byte_vec_t *bytes)
+{
+  for (size_t i = 0; i < bytes->size; i++)
+    byte_vec_push(out, *byte_vec_at(bytes, i));
+}
+
+static void pad_to(size_t align)
+{
+  while (out->size % align)
+    byte_vec_push(out, 0);
+}
+
+// overwrite the little-endian value of size bytes at offset
+static void patch(byte_vec_t *bytes, size_t offset, uint64_t val, int size)
+{
+  for (int i = 0; i < size; i++)
+    *byte_vec_at(bytes, offset + i) = (uint8_t) (val >> (8 * i));
+}
+
+static void begin(TARGET target)
+{
+  out = arena_alloc(curr_arena, sizeof(byte_vec_t));
+  byte_vec_init(out);
+  word = target == TARGET_X86_64 ? 8 : 4;
+}
+
+static size_t ehdr_size()
+{
+  return word == 8 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr);
+}
+
+static size_t phdr_size()
+{
+  return word == 8 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr);
+}
+
+static size_t shdr_size()
+{
+  return word == 8 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+}
+
+static void put_ehdr(uint16_t type, uint64_t entry, uint64_t phoff, uint16_t phnum, uint64_t shoff,
+                     uint16_t shnum, uint16_t shstrndx)
+{
+  uint8_t ident[EI_NIDENT] = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3 };
+  ident[EI_CLASS] = word == 8 ? ELFCLASS64 : ELFCLASS32;
+  ident[EI_DATA] = ELFDATA2LSB;
+  ident[EI_VERSION] = EV_CURRENT;
+  ident[EI_OSABI] = ELFOSABI_SYSV;
+  for (int i = 0; i < EI_NIDENT; i++)
+    put(ident[i], 1);
+  put(type, 2);
+  put(word == 8 ? EM_X86_64 : EM_386, 2);
+  put(EV_CURRENT, 4);
+  put_word(entry);
+  put_word(phoff);
+  put_word(shoff);
+  put(0, 4);  // flags
+  put(ehdr_size(), 2);
+  put(phnum ? phdr_size() : 0, 2);
+  put(phnum, 2);
+  put(shnum ? shdr_size() : 0, 2);
+  put(shnum, 2);
+  put(shstrndx, 2);
+}
+
+static void put_phdr(uint32_t type, uint32_t flags, uint64_t offset, uint64_t addr, uint64_t size)
+{
+  put(type, 4);
+  if (word == 8)
+    put(flags, 4);
+  put_word(offset);
+  put_word(addr);
+  put_word(addr);  // physical address
+  put_word(size);  // in file
+  put_word(size);  // in memory
+  if (word == 4)
+    put(flags, 4);
+  put_word(type == PT_LOAD ? 0x1000 : 16);
+}
+
+static void put_shdr(uint32_t name, uint32_t type, uint64_t flags, uint64_t offset, uint64_t size,
+                     uint32_t link, uint32_t info, uint64_t align, uint64_t entsize)
+{
+  put(name, 4);
+  put(type, 4);
+  put_word(flags);
+  put_word(0);  // address
+  put_word(offset);
+  put_word(size);
+  put(link, 4);
+  put(info, 4);
+  put_word(align);
+  put_word(entsize);
+}
+
+static void put_sym(uint32_t name, uint8_t info, uint16_t shndx, uint64_t value)
+{
+  put(name, 4);
+  if (word == 8) {
+    put(info, 1);
+    put(0, 1);  // visibility
+    put(shndx, 2);
+    put_word(value);
+    put_word(0);  // size
+  } else {
+    put_word(value);
+    put_word(0);
+    put(info, 1);
+    put(0, 1);
+    put(shndx, 2);
+  }
+}
+
+// append the string to the string table, return its offset
+static uint32_t add_str(byte_vec_t *strtab, char *str)
+{
+  uint32_t offset = strtab->size;
+  for (; *str; str++)
+    byte_vec_push(strtab, (uint8_t) *str);
+  byte_vec_push(strtab, 0);
+  return offset;
+}
+
+static void write_file(char *path, FILE *fp)
+{
+  if (fwrite(out->data, 1, out->size, fp) != out->size) {
+    fprintf(stderr, "cannot write %s\n", path);
+    exit(1);
+  }
+}
+
+static uint32_t reloc_type(TARGET target, RELOC kind)
+{
+  if (target == TARGET_X86_64) {
+    switch (kind) {
+      case RELOC_ABS32: return R_X86_64_32;
+      case RELOC_PC32: return R_X86_64_PC32;
+      case RELOC_PLT32: return R_X86_64_PLT32;
+    }
+  }
+  switch (kind) {
+    case RELOC_ABS32: return R_386_32;
+    case RELOC_PC32: return R_386_PC32;
+    case RELOC_PLT32: return R_386_PLT32;
+  }
+  return 0;
+}
+
+// sections of relocatable file, the relocations of section i are in RELOC_OF(i)
+enum {
+  SHN_TEXT = 1,
+  SHN_DATA,
+  SHN_REL_TEXT,
+  SHN_REL_DATA,
+  SHN_SYMTAB,
+  SHN_STRTAB,
+  SHN_NOTE,  // .note.GNU-stack, the stack is not executable
+  SHN_SHSTRTAB,
+  SHN_NUM,
+};
+
+#define RELOC_OF(section) (SHN_REL_TEXT + (section))
+
+// undefined symbols are global, as other objects define them
+static bool is_global(obj_sym_t *sym)
+{
+  return sym->is_global || !sym->is_defined;
+}
+
+// write the object as a relocatable file
+// on i386 relocations have no addend field (rel), so the addends are written to the sections
+void write_obj(obj_t *obj, FILE *fp)
+{
+  begin(obj->target);
+  bool is_rela = obj->target == TARGET_X86_64;
+
+  // symbols, the local ones come first, and the index in symtab of each symbol
+  uint32_t *indexes = arena_alloc(curr_arena, sizeof(uint32_t) * (obj->syms.size + 1));
+  uint32_t locals_num = 1;
+  for (size_t i = 0; i < obj->syms.size; i++)
+    locals_num += !is_global(obj_sym_vec_at(&obj->syms, i));
+  uint32_t next_local = 1, next_global = locals_num;
+  for (size_t i = 0; i < obj->syms.size; i++)
+    indexes[i] = is_global(obj_sym_vec_at(&obj->syms, i)) ? next_global++ : next_local++;
+
+  byte_vec_t strtab;
+  byte_vec_init(&strtab);
+  byte_vec_push(&strtab, 0);
+  uint32_t *names = arena_alloc(curr_arena, sizeof(uint32_t) * (obj->syms.size + 1));
+  for (size_t i = 0; i < obj->syms.size; i++)
+    names[i] = add_str(&strtab, obj_sym_vec_at(&obj->syms, i)->name);
+
+  if (!is_rela) {
+    for (size_t i = 0; i < obj->relocs.size; i++) {
+      reloc_t *reloc = reloc_vec_at(&obj->relocs, i);
+      patch(&obj->sections[reloc->section], reloc->offset, (uint32_t) reloc->addend, 4);
+    }
+  }
+
+  // contents of sections, after the header
+  uint64_t offsets[SHN_NUM] = { 0 }, sizes[SHN_NUM] = { 0 };
+  put_ehdr(ET_REL, 0, 0, 0, 0, 0, 0);  // patched below
+
+  for (SECTION section = 0; section < SECTION_NUM; section++) {
+    pad_to(16);
+    offsets[SHN_TEXT + section] = out->size;
+    put_bytes(&obj->sections[section]);
+    sizes[SHN_TEXT + section] = obj->sections[section].size;
+  }
+
+  for (SECTION section = 0; section < SECTION_NUM; section++) {
+    pad_to(word);
+    offsets[RELOC_OF(section)] = out->size;
+    for (size_t i = 0; i < obj->relocs.size; i++) {
+      reloc_t *reloc = reloc_vec_at(&obj->relocs, i);
+      if (reloc->section != section)
+        continue;
+      uint64_t sym = indexes[reloc->sym], type = reloc_type(obj->target, reloc->kind);
+      put_word(reloc->offset);
+      put_word(is_rela ? sym << 32 | type : sym << 8 | type);
+      if (is_rela)
+        put_word((uint64_t) (int64_t) reloc->addend);
+    }
+    sizes[RELOC_OF(section)] = out->size - offsets[RELOC_OF(section)];
+  }
+
+  pad_to(word);
+  offsets[SHN_SYMTAB] = out->size;
+  put_sym(0, 0, SHN_UNDEF, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < obj->syms.size; i++) {
+      obj_sym_t *sym = obj_sym_vec_at(&obj->syms, i);
+      if (is_global(sym) != pass)
+        continue;
+      uint8_t bind = is_global(sym) ? STB_GLOBAL : STB_LOCAL;
+      uint8_t type = sym->is_func ? STT_FUNC : STT_NOTYPE;
+      uint16_t shndx = sym->is_defined ? SHN_TEXT + sym->section : SHN_UNDEF;
+      put_sym(names[i], (uint8_t) (bind << 4 | type), shndx, sym->is_defined ? sym->offset : 0);
+    }
+  }
+  sizes[SHN_SYMTAB] = out->size - offsets[SHN_SYMTAB];
+
+  offsets[SHN_STRTAB] = out->size;
+  put_bytes(&strtab);
+  sizes[SHN_STRTAB] = strtab.size;
+
+  offsets[SHN_NOTE] = out->size;
+
+  byte_vec_t shstrtab;
+  byte_vec_init(&shstrtab);
+  byte_vec_push(&shstrtab, 0);
+  uint32_t shnames[SHN_NUM] = {
+    [SHN_TEXT] = add_str(&shstrtab, ".text"),
+    [SHN_DATA] = add_str(&shstrtab, ".data"),
+    [SHN_REL_TEXT] = add_str(&shstrtab, is_rela ? ".rela.text" : ".rel.text"),
+    [SHN_REL_DATA] = add_str(&shstrtab, is_rela ? ".rela.data" : ".rel.data"),
+    [SHN_SYMTAB] = add_str(&shstrtab, ".symtab"),
+    [SHN_STRTAB] = add_str(&shstrtab, ".strtab"),
+    [SHN_NOTE] = add_str(&shstrtab, ".note.GNU-stack"),
+    [SHN_SHSTRTAB] = add_str(&shstrtab, ".shstrtab"),
+  };
+  offsets[SHN_SHSTRTAB] = out->size;
+  put_bytes(&shstrtab);
+  sizes[SHN_SHSTRTAB] = shstrtab.size;
+
+  // section headers
+  pad_to(word);
+  uint64_t shoff = out->size;
+  uint64_t rel_size = is_rela ? 3 * word : 2 * word;
+  uint64_t sym_size = word == 8 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+  put_shdr(0, SHT_NULL, 0, 0, 0, 0, 0, 0, 0);
+  put_shdr(shnames[SHN_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, offsets[SHN_TEXT], sizes[SHN_TEXT], 0, 0, 16, 0);
+  put_shdr(shnames[SHN_DATA], SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, offsets[SHN_DATA], sizes[SHN_DATA], 0, 0, 16, 0);
+  for (SECTION section = 0; section < SECTION_NUM; section++) {
+    int shn = RELOC_OF(section);
+    put_shdr(shnames[shn], is_rela ? SHT_RELA : SHT_REL, SHF_INFO_LINK, offsets[shn], sizes[shn], SHN_SYMTAB,
+             SHN_TEXT + section, word, rel_size);
+  }
+  put_shdr(shnames[SHN_SYMTAB], SHT_SYMTAB, 0, offsets[SHN_SYMTAB], sizes[SHN_SYMTAB], SHN_STRTAB, locals_num, word,
+           sym_size);
+  put_shdr(shnames[SHN_STRTAB], SHT_STRTAB, 0, offsets[SHN_STRTAB], sizes[SHN_STRTAB], 0, 0, 1, 0);
+  put_shdr(shnames[SHN_NOTE], SHT_PROGBITS, 0, offsets[SHN_NOTE], 0, 0, 0, 1, 0);
+  put_shdr(shnames[SHN_SHSTRTAB], SHT_STRTAB, 0, offsets[SHN_SHSTRTAB], sizes[SHN_SHSTRTAB], 0, 0, 1, 0);
+
+  // the header again, now that the section headers are placed
+  byte_vec_t *file = out;
+  out = arena_alloc(curr_arena, sizeof(byte_vec_t));
+  byte_vec_init(out);
+  put_ehdr(ET_REL, 0, 0, 0, shoff, SHN_NUM, SHN_SHSTRTAB);
+  memcpy(file->data, out->data, out->size);
+  out = file;
+
+  write_file("object", fp);
+}
+
+// where the executable is loaded, the first page is left unmapped
+static uint32_t base_of(TARGET target)
+{
+  return target == TARGET_X86_64 ? 0x400000 : 0x8048000;
+}
+
+// the layout of executable: the headers and text are mapped from the start of file (read and execute),
+// and data follows them in the file, mapped one page further (read and write),
+// so that an address is congruent to its offset in file modulo the page size as mmap needs,
+// and the two mappings never share a page
+static void layout(obj_t *exe, uint32_t addrs[SECTION_NUM], uint64_t offsets[SECTION_NUM])
+{
+  uint32_t base = base_of(exe->target);
+  offsets[SECTION_TEXT] = (ehdr_size() + 3 * phdr_size() + 15) / 16 * 16;
+  offsets[SECTION_DATA] = (offsets[SECTION_TEXT] + exe->sections[SECTION_TEXT].size + 15) / 16 * 16;
+  addrs[SECTION_TEXT] = base + offsets[SECTION_TEXT];
+  addrs[SECTION_DATA] = base + 0x1000 + offsets[SECTION_DATA];
+}
+
+// the addresses of sections in the executable
+void layout_exe(obj_t *exe, uint32_t addrs[SECTION_NUM])
+{
+  uint64_t offsets[SECTION_NUM];
+  begin(exe->target);
+  layout(exe, addrs, offsets);
+}
+
+// write the linked sections as an executable file, which has no section headers
+void write_exe(obj_t *exe, uint32_t addrs[SECTION_NUM], uint32_t entry, char *path)
+{
+  begin(exe->target);
+  uint64_t offsets[SECTION_NUM];
+  layout(exe, addrs, offsets);
+  uint32_t base = base_of(exe->target);
+  uint64_t text_end = offsets[SECTION_TEXT] + exe->sections[SECTION_TEXT].size;
+
+  put_ehdr(ET_EXEC, entry, ehdr_size(), 3, 0, 0, SHN_UNDEF);
+  put_phdr(PT_LOAD, PF_R | PF_X, 0, base, text_end);
+  put_phdr(PT_LOAD, PF_R | PF_W, offsets[SECTION_DATA], addrs[SECTION_DATA], exe->sections[SECTION_DATA].size);
+  put_phdr(PT_GNU_STACK, PF_R | PF_W, 0, 0, 0);
+  pad_to(16);
+  put_bytes(&exe->sections[SECTION_TEXT]);
+  pad_to(16);
+  put_bytes(&exe->sections[SECTION_DATA]);
+
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "cannot open %s\n", path);
+    exit(1);
+  }
+  write_file(path, fp);
+  fclose(fp);
+  chmod(path, 0755);
+}
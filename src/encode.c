@@ -0,0 +1,500 @@
+#include "obj.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// encoder of x86 instructions into machine code
+//
+// an instruction is encoded into a buffer of its own, which is then appended to the section,
+// with its relocation, an instruction refers to one symbol at most
+// jumps to local labels are resolved here, since they never leave the function,
+// they are short (rel8) unless their target is too far, which is found by relaxation:
+// all of them start short, and those out of range grow until nothing changes,
+// as a jump only grows, the others only get farther, and this ends
+// symbols (functions and data) are left to relocations
+
+obj_t *new_obj()
+{
+  obj_t *obj = arena_calloc(curr_arena, 1, sizeof(obj_t));
+  obj->target = target;
+  for (SECTION section = 0; section < SECTION_NUM; section++)
+    byte_vec_init(&obj->sections[section]);
+  obj_sym_vec_init(&obj->syms);
+  reloc_vec_init(&obj->relocs);
+  obj->sym_index = new_hashmap(64);
+  obj->curr = SECTION_TEXT;
+  return obj;
+}
+
+// index of the symbol, which is added undefined if it is not yet
+uint32_t obj_sym(obj_t *obj, char *name)
+{
+  entry_t *entry = hashmap_get_cstr(obj->sym_index, name);
+  if (entry)
+    return (uint32_t) (uintptr_t) entry->val - 1;
+  obj_sym_vec_push(&obj->syms, (obj_sym_t) { .name = name });
+  hashmap_add_cstr(obj->sym_index, name, (void *) (uintptr_t) obj->syms.size);
+  return obj->syms.size - 1;
+}
+
+// an encoded instruction
+typedef struct enc_t
+{
+  uint8_t bytes[16];
+  int len;
+  bool has_reloc;
+  int reloc_at;     // offset of the field in bytes
+  char *reloc_sym;
+  RELOC reloc_kind;
+} enc_t;
+
+static enc_t *enc;
+static x86_ins_t *curr_ins;
+
+static void fail()
+{
+  fprintf(stderr, "cannot encode: ");
+  print_x86(curr_ins, stderr);
+  exit(1);
+}
+
+static void byte(uint8_t b)
+{
+  enc->bytes[enc->len++] = b;
+}
+
+static void imm32(int64_t imm)
+{
+  for (int i = 0; i < 4; i++)
+    byte((uint8_t) (imm >> (8 * i)));
+}
+
+static bool fits_imm8(int64_t imm)
+{
+  return imm >= -128 && imm <= 127;
+}
+
+// a 32-bit field, whose value is left to the relocation of symbol
+// calls through plt are named sym@PLT as gas does
+static void reloc32(char *sym, RELOC kind)
+{
+  if (enc->has_reloc)
+    fail();
+  char *plt = strstr(sym, "@PLT");
+  if (plt) {
+    sym = arena_strndup(curr_arena, sym, plt - sym);
+    kind = RELOC_PLT32;
+  }
+  enc->has_reloc = true;
+  enc->reloc_at = enc->len;
+  enc->reloc_sym = sym;
+  enc->reloc_kind = kind;
+  imm32(0);
+}
+
+// the immediate of src, which is an address if it is a symbol
+static void imm_opd(x86_opd_t opd)
+{
+  if (opd.kind == X86_OPD_SYM)
+    reloc32(opd.sym, RELOC_ABS32);
+  else
+    imm32(opd.imm);
+}
+
+// on x86_64, the prefix of 64-bit operands (w), the registers above %edi in reg and rm,
+// and the byte registers %spl to %dil, which are %ah to %bh without it
+// byte_reg is the register used as a byte register, or -1
+static void rex(bool w, int reg, x86_opd_t rm, int byte_reg)
+{
+  if (target != TARGET_X86_64)
+    return;
+  bool has_base = rm.kind == X86_OPD_REG || rm.kind == X86_OPD_MEM;
+  uint8_t prefix = 0x40 | w << 3 | (reg >= 8) << 2 | (has_base && rm.reg >= 8);
+  if (prefix != 0x40 || (byte_reg >= X86_ESP && byte_reg <= X86_EDI))
+    byte(prefix);
+}
+
+// the modrm byte of reg and rm, and the sib and displacement of memory
+static void modrm(int reg, x86_opd_t rm)
+{
+  reg &= 7;
+  switch (rm.kind) {
+    case X86_OPD_REG:
+      byte(0xc0 | reg << 3 | (rm.reg & 7));
+      return;
+    case X86_OPD_MEM: {
+      // %ebp (and %r13) as a base always has a displacement, %esp (and %r12) needs a sib
+      int base = rm.reg & 7;
+      int mod = rm.disp == 0 && base != X86_EBP ? 0 : fits_imm8(rm.disp) ? 1 : 2;
+      byte(mod << 6 | reg << 3 | base);
+      if (base == X86_ESP)
+        byte(0x24);
+      if (mod == 1)
+        byte((uint8_t) rm.disp);
+      else if (mod == 2)
+        imm32(rm.disp);
+      return;
+    }
+    case X86_OPD_RIP:
+      // disp32 alone, which is relative to the next instruction on x86_64
+      byte(0x05 | reg << 3);
+      reloc32(rm.sym, target == TARGET_X86_64 ? RELOC_PC32 : RELOC_ABS32);
+      return;
+    default:
+      fail();
+  }
+}
+
+// opcode (of one or two bytes) with reg and rm
+static void op_rm(uint32_t opcode, bool w, int reg, x86_opd_t rm, int byte_reg)
+{
+  if (rm.kind != X86_OPD_REG && rm.kind != X86_OPD_MEM && rm.kind != X86_OPD_RIP)
+    fail();
+  rex(w, reg, rm, byte_reg);
+  if (opcode > 0xff)
+    byte(opcode >> 8);
+  byte(opcode & 0xff);
+  modrm(reg, rm);
+}
+
+static bool is_reg(x86_opd_t opd)
+{
+  return opd.kind == X86_OPD_REG;
+}
+
+static bool is_imm(x86_opd_t opd)
+{
+  return opd.kind == X86_OPD_IMM || opd.kind == X86_OPD_SYM;
+}
+
+// the extension of opcode field in modrm for the alu operations, 0x83 /n and 0x81 /n
+static int alu_ext(X86_OP op)
+{
+  switch (op) {
+    case X86_ADD: return 0;
+    case X86_SUB: return 5;
+    case X86_XOR: return 6;
+    case X86_CMP: return 7;
+    default: return -1;
+  }
+}
+
+static uint8_t cc_codes[X86_CC_NUM] = {
+  [X86_CC_E]  = 0x4,
+  [X86_CC_NE] = 0x5,
+  [X86_CC_L]  = 0xc,
+  [X86_CC_GE] = 0xd,
+  [X86_CC_LE] = 0xe,
+  [X86_CC_G]  = 0xf,
+};
+
+// encode the instruction at offset at, a jump to local label is short unless is_long
+static void encode_ins(x86_ins_t *ins, uint32_t at, bool is_long, uint32_t *labels)
+{
+  x86_opd_t src = ins->src, dst = ins->dst;
+  bool w = ins->wide;
+  curr_ins = ins;
+
+  switch (ins->op) {
+    case X86_MOV:
+      if (is_reg(src))
+        op_rm(0x89, w, src.reg, dst, -1);
+      else if (is_imm(src) && is_reg(dst) && !w) {
+        rex(false, 0, dst, -1);
+        byte(0xb8 + (dst.reg & 7));
+        imm_opd(src);
+      } else if (is_imm(src)) {
+        op_rm(0xc7, w, 0, dst, -1);
+        imm_opd(src);
+      } else if (is_reg(dst))
+        op_rm(0x8b, w, dst.reg, src, -1);
+      else
+        fail();
+      return;
+    case X86_MOVZB:
+      if (!is_reg(dst))
+        fail();
+      op_rm(0x0fb6, w, dst.reg, src, is_reg(src) ? (int) src.reg : -1);
+      return;
+    case X86_MOVB:
+      if (is_reg(src))
+        op_rm(0x88, false, src.reg, dst, src.reg);
+      else if (src.kind == X86_OPD_IMM) {
+        op_rm(0xc6, false, 0, dst, -1);
+        byte((uint8_t) src.imm);
+      } else
+        fail();
+      return;
+    case X86_LEA:
+      if (!is_reg(dst) || is_reg(src))
+        fail();
+      op_rm(0x8d, w, dst.reg, src, -1);
+      return;
+    case X86_ADD:
+    case X86_SUB:
+    case X86_XOR:
+    case X86_CMP: {
+      int ext = alu_ext(ins->op);
+      if (src.kind == X86_OPD_IMM && fits_imm8(src.imm)) {
+        op_rm(0x83, w, ext, dst, -1);
+        byte((uint8_t) src.imm);
+      } else if (is_imm(src) && x86_is_reg(dst, X86_EAX)) {
+        // the short form on %eax
+        rex(w, 0, dst, -1);
+        byte(ext * 8 + 0x05);
+        imm_opd(src);
+      } else if (is_imm(src)) {
+        op_rm(0x81, w, ext, dst, -1);
+        imm_opd(src);
+      } else if (is_reg(src))
+        op_rm(ext * 8 + 0x01, w, src.reg, dst, -1);
+      else if (is_reg(dst))
+        op_rm(ext * 8 + 0x03, w, dst.reg, src, -1);
+      else
+        fail();
+      return;
+    }
+    case X86_TEST:
+      if (is_imm(src) && x86_is_reg(dst, X86_EAX)) {
+        rex(w, 0, dst, -1);
+        byte(0xa9);
+        imm_opd(src);
+      } else if (is_imm(src)) {
+        op_rm(0xf7, w, 0, dst, -1);
+        imm_opd(src);
+      } else if (is_reg(src))
+        op_rm(0x85, w, src.reg, dst, -1);
+      else if (is_reg(dst))
+        op_rm(0x85, w, dst.reg, src, -1);
+      else
+        fail();
+      return;
+    case X86_IMUL:
+      if (!is_reg(dst))
+        fail();
+      if (src.kind == X86_OPD_IMM && fits_imm8(src.imm)) {
+        op_rm(0x6b, w, dst.reg, dst, -1);
+        byte((uint8_t) src.imm);
+      } else if (is_imm(src)) {
+        op_rm(0x69, w, dst.reg, dst, -1);
+        imm_opd(src);
+      } else
+        op_rm(0x0faf, w, dst.reg, src, -1);
+      return;
+    case X86_SHL:
+      if (src.kind != X86_OPD_IMM)
+        fail();
+      if (src.imm == 1) {
+        op_rm(0xd1, w, 4, dst, -1);
+        return;
+      }
+      op_rm(0xc1, w, 4, dst, -1);
+      byte((uint8_t) src.imm);
+      return;
+    case X86_NEG: op_rm(0xf7, w, 3, dst, -1); return;
+    case X86_IDIV: op_rm(0xf7, w, 7, dst, -1); return;
+    case X86_SETCC: op_rm(0x0f90 | cc_codes[ins->cc], false, 0, dst, is_reg(dst) ? (int) dst.reg : -1); return;
+    case X86_CLTD: byte(0x99); return;
+    case X86_PUSH:
+      // push and pop are 64 bits on x86_64 without the prefix
+      if (is_reg(src)) {
+        rex(false, 0, src, -1);
+        byte(0x50 + (src.reg & 7));
+      } else if (src.kind == X86_OPD_IMM && fits_imm8(src.imm)) {
+        byte(0x6a);
+        byte((uint8_t) src.imm);
+      } else if (is_imm(src)) {
+        byte(0x68);
+        imm_opd(src);
+      } else
+        op_rm(0xff, false, 6, src, -1);
+      return;
+    case X86_POP:
+      if (is_reg(dst)) {
+        rex(false, 0, dst, -1);
+        byte(0x58 + (dst.reg & 7));
+      } else
+        op_rm(0x8f, false, 0, dst, -1);
+      return;
+    case X86_CALL:
+      if (src.kind != X86_OPD_SYM)
+        fail();
+      // gas calls through plt on x86_64, which is the function itself unless it is in a shared library
+      byte(0xe8);
+      reloc32(src.sym, target == TARGET_X86_64 ? RELOC_PLT32 : RELOC_PC32);
+      return;
+    case X86_JMP:
+    case X86_JCC: {
+      if (src.kind != X86_OPD_LABEL)
+        fail();
+      int size = !is_long ? 2 : ins->op == X86_JMP ? 5 : 6;
+      int32_t rel = (int32_t) (labels[src.id] - (at + size));
+      if (!is_long) {
+        byte(ins->op == X86_JMP ? 0xeb : 0x70 | cc_codes[ins->cc]);
+        byte((uint8_t) rel);
+      } else {
+        if (ins->op == X86_JMP)
+          byte(0xe9);
+        else {
+          byte(0x0f);
+          byte(0x80 | cc_codes[ins->cc]);
+        }
+        imm32(rel);
+      }
+      return;
+    }
+    case X86_RET: byte(0xc3); return;
+    case X86_SYSCALL:
+      if (target == TARGET_X86_64) {
+        byte(0x0f);
+        byte(0x05);
+      } else {
+        byte(0xcd);
+        byte(0x80);
+      }
+      return;
+    default:
+      fail();
+  }
+}
+
+static bool is_local_jump(x86_ins_t *ins)
+{
+  return (ins->op == X86_JMP || ins->op == X86_JCC) && ins->src.kind == X86_OPD_LABEL;
+}
+
+static SECTION section_of(char *name)
+{
+  if (!strcmp(name, ".text"))
+    return SECTION_TEXT;
+  if (!strcmp(name, ".data"))
+    return SECTION_DATA;
+  fprintf(stderr, "unknown section %s\n", name);
+  exit(1);
+}
+
+// the size of instruction at offset at, which is not a directive
+static uint32_t size_of(x86_ins_t *ins, uint32_t at, bool is_long, uint32_t *labels)
+{
+  enc_t buf = { 0 };
+  enc = &buf;
+  encode_ins(ins, at, is_long, labels);
+  return buf.len;
+}
+
+// encode the instructions into obj, they may switch sections and define symbols,
+// a local label is only referred to by the instructions encoded with it
+void encode(obj_t *obj, x86_vec_t *code)
+{
+  size_t num = code->size;
+  uint32_t labels_num = 0;
+  for (size_t i = 0; i < num; i++) {
+    x86_ins_t *ins = x86_vec_at(code, i);
+    if (ins->op == X86_LABEL && ins->src.kind == X86_OPD_LABEL && ins->src.id >= labels_num)
+      labels_num = ins->src.id + 1;
+  }
+  uint32_t *labels = arena_calloc(curr_arena, labels_num + 1, sizeof(uint32_t));
+  uint32_t *offsets = arena_alloc(curr_arena, sizeof(uint32_t) * (num + 1));
+  uint32_t *sizes = arena_alloc(curr_arena, sizeof(uint32_t) * (num + 1));
+  bool *is_long = arena_calloc(curr_arena, num + 1, sizeof(bool));
+
+  // relax the jumps, the sizes of the other instructions are known at first
+  for (bool changed = true, first = true; changed; first = false) {
+    SECTION section = obj->curr;
+    uint32_t at = obj->sections[section].size;
+    for (size_t i = 0; i < num; i++) {
+      x86_ins_t *ins = x86_vec_at(code, i);
+      offsets[i] = at;
+      switch (ins->op) {
+        case X86_NOP:
+        case X86_TEXT:
+        case X86_GLOBAL:
+          sizes[i] = 0;
+          break;
+        case X86_SECTION:
+          section = section_of(ins->src.sym);
+          at = obj->sections[section].size;
+          sizes[i] = 0;
+          break;
+        case X86_LABEL:
+          if (ins->src.kind == X86_OPD_LABEL)
+            labels[ins->src.id] = at;
+          sizes[i] = 0;
+          break;
+        case X86_STRING:
+          sizes[i] = strlen(ins->src.sym) + 1;
+          break;
+        default:
+          if (is_local_jump(ins))
+            sizes[i] = !is_long[i] ? 2 : ins->op == X86_JMP ? 5 : 6;
+          else if (first)
+            sizes[i] = size_of(ins, at, false, labels);
+      }
+      at += sizes[i];
+    }
+
+    changed = false;
+    for (size_t i = 0; i < num; i++) {
+      x86_ins_t *ins = x86_vec_at(code, i);
+      if (is_local_jump(ins) && !is_long[i]) {
+        int64_t rel = (int64_t) labels[ins->src.id] - (offsets[i] + 2);
+        if (!fits_imm8(rel))
+          is_long[i] = changed = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    x86_ins_t *ins = x86_vec_at(code, i);
+    byte_vec_t *bytes = &obj->sections[obj->curr];
+    switch (ins->op) {
+      case X86_NOP:
+      case X86_TEXT:
+        continue;
+      case X86_SECTION:
+        obj->curr = section_of(ins->src.sym);
+        continue;
+      case X86_GLOBAL: {
+        obj_sym_t *sym = obj_sym_vec_at(&obj->syms, obj_sym(obj, ins->src.sym));
+        sym->is_global = sym->is_func = true;
+        continue;
+      }
+      case X86_LABEL:
+        if (ins->src.kind == X86_OPD_SYM) {
+          obj_sym_t *sym = obj_sym_vec_at(&obj->syms, obj_sym(obj, ins->src.sym));
+          if (sym->is_defined) {
+            fprintf(stderr, "symbol %s is defined twice\n", sym->name);
+            exit(1);
+          }
+          sym->is_defined = true;
+          sym->section = obj->curr;
+          sym->offset = bytes->size;
+        }
+        continue;
+      case X86_STRING:
+        for (char *c = ins->src.sym; *c; c++)
+          byte_vec_push(bytes, (uint8_t) *c);
+        byte_vec_push(bytes, 0);
+        continue;
+      default:
+        break;
+    }
+
+    enc_t buf = { 0 };
+    enc = &buf;
+    encode_ins(ins, offsets[i], is_long[i], labels);
+    if (buf.has_reloc) {
+      // the field of a pc-relative relocation is relative to the end of instruction
+      bool is_pc = buf.reloc_kind != RELOC_ABS32;
+      reloc_vec_push(&obj->relocs, (reloc_t) {
+        .section = obj->curr,
+        .offset = bytes->size + buf.reloc_at,
+        .sym = obj_sym(obj, buf.reloc_sym),
+        .kind = buf.reloc_kind,
+        .addend = is_pc ? buf.reloc_at - buf.len : 0,
+      });
+    }
+    for (int j = 0; j < buf.len; j++)
+      byte_vec_push(bytes, buf.bytes[j]);
+  }
+}
@@ -0,0 +1,236 @@
+#include "fold.h"
+#include "arena.h"
+#include "vec.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// constant folding and propagation over the ast (-O)
+//
+// an expression whose operands are constant is replaced by its value,
+// which is computed as the target does: int is 32 bits and wraps around,
+// and a division trapping at run time (by zero, or INT32_MIN by -1) is left as it is
+// a variable initialized with a constant and never assigned afterwards is a constant too,
+// its references are replaced by the value, and its initialization is removed
+// since a variable is only visible after its declaration, the statements are folded in order
+
+fold_stats_t fold_stats;
+
+// a frame folds the node at slot in two steps (see fold_expr)
+// an expression is expanded into its operands in step 0, and folded in step 1
+// the arguments of a call are folded one by one, since a folded argument may be a new node,
+// whose next is only known after it is folded
+typedef struct fold_frame_t
+{
+  node_t **slot;
+  int step;
+  bool is_arg;
+} fold_frame_t;
+
+DEFINE_SMALL_VEC(fold_stack, fold_frame_t, 64)
+
+static bool is_const(node_t *node)
+{
+  return node->type == ND_NUM;
+}
+
+// the value of constant node, as an int of target
+static int32_t const_of(node_t *node)
+{
+  return (int32_t) (uint32_t) node->ival;
+}
+
+// turn the expression node into a number, an expression node is larger than a number node
+static void set_const(node_t *node, int32_t val)
+{
+  node->type = ND_NUM;
+  node->op = ND_NIL;
+  node->ival = val;
+  fold_stats.folded++;
+}
+
+// evaluate the binary operator, return false if it is left to run time
+static bool eval_binary(ND_TYPE op, int32_t a, int32_t b, int32_t *val)
+{
+  uint32_t x = a, y = b;
+  switch (op) {
+    case ND_ADD: *val = (int32_t) (x + y); return true;
+    case ND_SUB: *val = (int32_t) (x - y); return true;
+    case ND_MUL: *val = (int32_t) (x * y); return true;
+    case ND_DIV:
+      if (b == 0 || (a == INT32_MIN && b == -1))
+        return false;
+      *val = a / b;
+      return true;
+    case ND_EQ: *val = a == b; return true;
+    case ND_NE: *val = a != b; return true;
+    case ND_LT: *val = a < b; return true;
+    case ND_LE: *val = a <= b; return true;
+    case ND_GT: *val = a > b; return true;
+    case ND_GE: *val = a >= b; return true;
+    case ND_LOGAND: *val = a && b; return true;
+    case ND_LOGOR: *val = a || b; return true;
+    default: return false;
+  }
+}
+
+// fold the expression node whose operands are folded
+static void fold_node(node_t *node)
+{
+  node_t *lhs = node->lhs;
+  node_t *rhs = node->rhs;
+
+  // unary expression, the operand is rhs
+  if (!lhs) {
+    if (is_const(rhs))
+      set_const(node, node->op == ND_NEG ? (int32_t) (0u - (uint32_t) const_of(rhs)) : const_of(rhs));
+    return;
+  }
+
+  int32_t val;
+  if (is_const(lhs) && is_const(rhs)) {
+    if (eval_binary(node->op, const_of(lhs), const_of(rhs), &val))
+      set_const(node, val);
+    return;
+  }
+
+  // a constant lhs of && and || either decides the value, and rhs is never evaluated,
+  // or leaves it to rhs, and the expression is rhs != 0, which reuses lhs as the zero
+  if ((node->op == ND_LOGAND || node->op == ND_LOGOR) && is_const(lhs)) {
+    bool is_or = node->op == ND_LOGOR;
+    if ((const_of(lhs) != 0) == is_or) {
+      set_const(node, is_or);
+    } else {
+      node->op = ND_NE;
+      node->lhs = rhs;
+      node->rhs = lhs;
+      lhs->ival = 0;
+      fold_stats.folded++;
+    }
+  }
+}
+
+// fold the expression at slot in place
+// operands are folded before their operator, in post-order on an explicit stack (as dump_expr does),
+// and the arguments of a call one after another through the is_arg frames
+static void fold_expr(node_t **slot)
+{
+  if (!*slot)
+    return;
+
+  fold_stack_t stack;
+  fold_stack_init(&stack);
+  fold_stack_push(&stack, (fold_frame_t) { .slot = slot, .step = 0 });
+
+  while (!fold_stack_empty(&stack)) {
+    fold_frame_t frame = fold_stack_pop(&stack);
+    slot = frame.slot;
+
+    // the argument at slot is folded, go on with the next one
+    if (frame.is_arg) {
+      if (frame.step == 1)
+        slot = &(*slot)->next;
+      if (*slot) {
+        fold_stack_push(&stack, (fold_frame_t) { .slot = slot, .step = 1, .is_arg = true });
+        fold_stack_push(&stack, (fold_frame_t) { .slot = slot, .step = 0 });
+      }
+      continue;
+    }
+
+    node_t *node = *slot;
+    switch (node->type) {
+      case ND_VAR:
+        if (node->var->is_const) {
+          *slot = make_num_node(node->var->const_val);
+          (*slot)->next = node->next;
+          fold_stats.propagated++;
+        }
+        continue;
+      case ND_FNCALL:
+        fold_stack_push(&stack, (fold_frame_t) { .slot = &node->params, .step = 0, .is_arg = true });
+        continue;
+      case ND_EXPR: break;
+      default: continue;
+    }
+
+    if (frame.step == 0) {
+      fold_stack_push(&stack, (fold_frame_t) { .slot = slot, .step = 1 });
+      fold_stack_push(&stack, (fold_frame_t) { .slot = &node->rhs, .step = 0 });
+      if (node->lhs)
+        fold_stack_push(&stack, (fold_frame_t) { .slot = &node->lhs, .step = 0 });
+      continue;
+    }
+
+    fold_node(node);
+  }
+}
+
+// mark the variables assigned by the statements
+static void mark_assigned(node_t *node)
+{
+  for (; node; node = node->next) {
+    switch (node->type) {
+      case ND_EXPR_STMT:
+        if (node->op == ND_ASSIGN)
+          node->lhs->var->is_assigned = true;
+        break;
+      case ND_IF:
+        mark_assigned(node->if_stmt);
+        mark_assigned(node->else_stmt);
+        break;
+      case ND_WHILE: mark_assigned(node->while_stmt); break;
+      default: break;
+    }
+  }
+}
+
+static void fold_stmts(node_t *node)
+{
+  for (; node; node = node->next) {
+    switch (node->type) {
+      case ND_DECL_STMT: {
+        if (node->op != ND_ASSIGN)
+          break;
+        fold_expr(&node->rhs);
+        symbol_t *var = node->lhs->var;
+        if (!var->is_assigned && is_const(node->rhs)) {
+          // all the references to the variable are replaced, so its value is never read
+          var->is_const = true;
+          var->const_val = const_of(node->rhs);
+          node->op = ND_NIL;
+          node->rhs = NULL;
+          fold_stats.removed++;
+        }
+        break;
+      }
+      case ND_EXPR_STMT: fold_expr(&node->rhs); break;
+      case ND_IF:
+        fold_expr(&node->cond);
+        fold_stmts(node->if_stmt);
+        fold_stmts(node->else_stmt);
+        break;
+      case ND_WHILE:
+        fold_expr(&node->cond);
+        fold_stmts(node->while_stmt);
+        break;
+      case ND_RETURN: fold_expr(&node->rhs); break;
+      default: break;
+    }
+  }
+}
+
+// fold the constant expressions of program in place
+void fold(node_t *tree)
+{
+  fold_stats = (fold_stats_t) { 0 };
+  for (node_t *func = tree->body; func; func = func->next) {
+    mark_assigned(func->body);
+    fold_stmts(func->body);
+  }
+}
+
+void fold_report(FILE *fp)
+{
+  fprintf(fp, "%-10s %10zu nodes\n", "folded", fold_stats.folded);
+  fprintf(fp, "%-10s %10zu references\n", "propagated", fold_stats.propagated);
+  fprintf(fp, "%-10s %10zu stores\n", "removed", fold_stats.removed);
+}
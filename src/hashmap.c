@@ -1,4 +1,6 @@
 #include "hashmap.h"
+#include "intern.h"
+#include "arena.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -9,7 +11,7 @@
 // https://en.wikipedia.org/wiki/Fowler-Noll-Vo_hash_function
 #define FNV_OFFSET_BASIS 0xcbf29ce484222325
 #define FNV_PRIME 0x100000001b3
-static uint64_t fnv_hash(char *s, size_t len)
+uint64_t hash_bytes(char *s, size_t len)
 {
   uint64_t hash = FNV_OFFSET_BASIS;
   for (unsigned i = 0; i < len; i++) {
@@ -19,108 +21,331 @@ static uint64_t fnv_hash(char *s, size_t len)
   return hash;
 }
 
-hashmap_t *new_hashmap(size_t capacity)
+#define MIN_CAPACITY 16  // one group of HASHMAP_SWISS
+
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80    // control byte of empty entry
+#define CTRL_DELETED 0xfe  // control byte of tombstone
+// control byte of alive entry is 7 bits of its hash (high bit clear)
+
+// the capacity is rounded up to a power of two
+hashmap_t *new_hashmap_layout(HASHMAP_LAYOUT layout, size_t capacity)
 {
-  hashmap_t *hashmap = calloc(1, sizeof(hashmap_t));
-  hashmap->capcity = capacity;
-  hashmap->bucket = calloc(capacity, sizeof(entry_t));
-  hashmap->size = 0;
-  for (unsigned i = 0; i < hashmap->capcity; i++)  {
-    hashmap->bucket[i].used = false;
-    hashmap->bucket[i].key = NULL;
-    hashmap->bucket[i].len = 0;
-    hashmap->bucket[i].val = NULL;
+  size_t capcity = MIN_CAPACITY;
+  while (capcity < capacity)
+    capcity *= 2;
+
+  hashmap_t *hashmap = arena_calloc(curr_arena, 1, sizeof(hashmap_t));
+  hashmap->layout = layout;
+  hashmap->capcity = capcity;
+  hashmap->bucket = arena_calloc(curr_arena, capcity, sizeof(entry_t));
+  if (layout == HASHMAP_SWISS) {
+    hashmap->ctrl = arena_alloc(curr_arena, capcity);
+    memset(hashmap->ctrl, CTRL_EMPTY, capcity);
   }
+  hashmap->size = 0;
+  hashmap->filled = 0;
   return hashmap;
 }
 
-void delete_hashmap(hashmap_t *hashmap)
+hashmap_t *new_hashmap(size_t capacity)
 {
-  if (hashmap) {
-    if (hashmap->bucket)
-      free(hashmap->bucket);
-    free(hashmap);
-  }
+  return new_hashmap_layout(HASHMAP_SWISS, capacity);
 }
 
-static bool match(entry_t *entry, char *key, size_t len)
+// match the entry with the given key
+// the hash rejects most mismatches without looking at the keys,
+// and interned keys (names of atoms) are unique, so they are matched by pointer
+static bool match(entry_t *entry, char *key, size_t len, uint64_t hash, bool interned)
 {
   return entry->used == true  // first to make sure the entry is alive
+      && entry->hash == hash
       && entry->len == len
-      && !memcmp(entry->key, key, sizeof(char) * len);
+      && (entry->key == key || (!interned && !memcmp(entry->key, key, sizeof(char) * len)));
 }
 
-void hashmap_add(hashmap_t *hashmap, char *key, size_t len, void *val)
+static void fill_entry(entry_t *entry, char *key, size_t len, uint64_t hash, void *val)
 {
-  if (hashmap->size == hashmap->capcity) {
-    fprintf(stderr, "hashmap is full, cannot add entry\n");
-    return;
-  }
+  entry->hash = hash;
+  entry->key = key;
+  entry->len = len;
+  entry->used = true;
+  entry->deleted = false;
+  entry->val = val;
+}
+
+static void clear_entry(entry_t *entry)
+{
+  entry->used = false;
+  entry->key = NULL;
+  entry->len = 0;
+  entry->val = NULL;
+}
 
-  // get hash value
-  uint64_t hash = fnv_hash(key, len);
-
-  // linear probing
-  for (unsigned i = 0; i < hashmap->capcity; i++) {
-    entry_t *entry = hashmap->bucket + (hash + i) % hashmap->capcity;
-
-    // the entry is not used
-    if (entry->used == false) {
-      entry->used = true;
-      entry->key = key;
-      entry->len = len;
-      entry->val = val;
-      hashmap->size++;
-      break;
+/* HASHMAP_LINEAR */
+
+// rehash the alive entries into a bucket which keeps them at most half full
+// tombstones are dropped on the way
+static void linear_rehash(hashmap_t *hashmap)
+{
+  size_t capcity = hashmap->capcity;
+  while (2 * (hashmap->size + 1) > capcity)
+    capcity *= 2;
+
+  entry_t *bucket = arena_calloc(curr_arena, capcity, sizeof(entry_t));
+  size_t mask = capcity - 1;
+  for (size_t i = 0; i < hashmap->capcity; i++) {
+    entry_t *entry = hashmap->bucket + i;
+    if (entry->used) {
+      size_t index = entry->hash & mask;
+      while (bucket[index].used)
+        index = (index + 1) & mask;
+      bucket[index] = *entry;
     }
   }
+
+  // the old bucket is left to the arena
+  hashmap->bucket = bucket;
+  hashmap->capcity = capcity;
+  hashmap->filled = hashmap->size;
 }
 
-void hashmap_remove(hashmap_t *hashmap, char *key, size_t len)
+static void linear_add(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, void *val)
 {
-  if (hashmap->size == 0) {
-    fprintf(stderr, "hashmap is empty, cannot remove entry\n");
-    return;
+  if (4 * (hashmap->filled + 1) > 3 * hashmap->capcity)
+    linear_rehash(hashmap);
+
+  // linear probing, the first tombstone or empty entry takes the key
+  size_t mask = hashmap->capcity - 1;
+  size_t index = hash & mask;
+  while (hashmap->bucket[index].used)
+    index = (index + 1) & mask;
+
+  entry_t *entry = hashmap->bucket + index;
+  if (!entry->deleted)
+    hashmap->filled++;
+  fill_entry(entry, key, len, hash, val);
+  hashmap->size++;
+}
+
+static entry_t *linear_get(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, bool interned)
+{
+  // linear probing, skip tombstones and stop at an empty entry
+  size_t mask = hashmap->capcity - 1;
+  for (size_t index = hash & mask; ; index = (index + 1) & mask) {
+    entry_t *entry = hashmap->bucket + index;
+    if (match(entry, key, len, hash, interned))
+      return entry;
+    if (!entry->used && !entry->deleted)
+      return NULL;
+  }
+}
+
+static void linear_remove(hashmap_t *hashmap, entry_t *entry)
+{
+  // leave a tombstone, so the probing of keys after it goes on
+  clear_entry(entry);
+  entry->deleted = true;
+  hashmap->size--;
+}
+
+/* HASHMAP_SWISS */
+
+// the low 7 bits of hash go to the control byte, the rest chooses the group
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((uint8_t) ((hash) & 0x7f))
+
+// bit i of the result is set if control byte i of the group equals byte
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+static uint32_t group_match(uint8_t *group, uint8_t byte)
+{
+  __m128i ctrl = _mm_load_si128((__m128i *) group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+}
+
+// empty and deleted control bytes are the ones with high bit set
+static uint32_t group_match_free(uint8_t *group)
+{
+  return _mm_movemask_epi8(_mm_load_si128((__m128i *) group));
+}
+#else
+static uint32_t group_match(uint8_t *group, uint8_t byte)
+{
+  uint32_t mask = 0;
+  for (int i = 0; i < GROUP_SIZE; i++)
+    mask |= (uint32_t) (group[i] == byte) << i;
+  return mask;
+}
+
+static uint32_t group_match_free(uint8_t *group)
+{
+  uint32_t mask = 0;
+  for (int i = 0; i < GROUP_SIZE; i++)
+    mask |= (uint32_t) (group[i] >> 7) << i;
+  return mask;
+}
+#endif
+
+// groups are probed in triangular sequence (1, 2, 3, ... groups further),
+// which visits every group once since the number of groups is a power of two
+
+// index of the first empty or deleted entry in the probe sequence of hash
+static size_t swiss_find_free(hashmap_t *hashmap, uint64_t hash)
+{
+  size_t group_mask = hashmap->capcity / GROUP_SIZE - 1;
+  size_t group = H1(hash) & group_mask;
+  for (size_t step = 1; ; step++) {
+    uint32_t mask = group_match_free(hashmap->ctrl + group * GROUP_SIZE);
+    if (mask)
+      return group * GROUP_SIZE + __builtin_ctz(mask);
+    group = (group + step) & group_mask;
   }
+}
+
+// rehash the alive entries into a table which keeps them at most 7/16 full
+static void swiss_rehash(hashmap_t *hashmap)
+{
+  size_t capcity = hashmap->capcity;
+  while (16 * (hashmap->size + 1) > 7 * capcity)
+    capcity *= 2;
 
-  // get hash value
-  uint64_t hash = fnv_hash(key, len);
-
-  // linear probing
-  for (unsigned i = 0; i < hashmap->capcity; i++) {
-    entry_t *entry = hashmap->bucket + (hash + i) % hashmap->capcity;
-    if (match(entry, key, len)) {
-      entry->used = false;
-      entry->key = NULL;
-      entry->len = 0;
-      entry->val = NULL;
-      hashmap->size--;
-      return;
+  entry_t *bucket = hashmap->bucket;
+  uint8_t *ctrl = hashmap->ctrl;
+  size_t old_capcity = hashmap->capcity;
+
+  // the old table is left to the arena
+  hashmap->capcity = capcity;
+  hashmap->bucket = arena_calloc(curr_arena, capcity, sizeof(entry_t));
+  hashmap->ctrl = arena_alloc(curr_arena, capcity);
+  memset(hashmap->ctrl, CTRL_EMPTY, capcity);
+  for (size_t i = 0; i < old_capcity; i++) {
+    if (!(ctrl[i] & 0x80)) {
+      size_t index = swiss_find_free(hashmap, bucket[i].hash);
+      hashmap->ctrl[index] = ctrl[i];
+      hashmap->bucket[index] = bucket[i];
     }
   }
+  hashmap->filled = hashmap->size;
+}
+
+static void swiss_add(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, void *val)
+{
+  if (8 * (hashmap->filled + 1) > 7 * hashmap->capcity)
+    swiss_rehash(hashmap);
 
-  fprintf(stderr, "no entry has key \"%s\", cannot remove\n", key);
-  return;
+  size_t index = swiss_find_free(hashmap, hash);
+  if (hashmap->ctrl[index] == CTRL_EMPTY)
+    hashmap->filled++;
+  hashmap->ctrl[index] = H2(hash);
+  fill_entry(hashmap->bucket + index, key, len, hash, val);
+  hashmap->size++;
 }
 
-// if found, return the entry pointer, otherwise return null pointer
-entry_t *hashmap_get(hashmap_t *hashmap, char *key, size_t len)
+static entry_t *swiss_get(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, bool interned)
 {
-  if (hashmap->size == 0)
-    return NULL;
+  size_t group_mask = hashmap->capcity / GROUP_SIZE - 1;
+  size_t group = H1(hash) & group_mask;
+  for (size_t step = 1; ; step++) {
+    uint8_t *ctrl = hashmap->ctrl + group * GROUP_SIZE;
 
-  // get hash value
-  uint64_t hash = fnv_hash(key, len);
+    // only the entries whose control byte matches are compared
+    for (uint32_t mask = group_match(ctrl, H2(hash)); mask; mask &= mask - 1) {
+      entry_t *entry = hashmap->bucket + group * GROUP_SIZE + __builtin_ctz(mask);
+      if (match(entry, key, len, hash, interned))
+        return entry;
+    }
 
-  // linear probing
-  for (unsigned i = 0; i < hashmap->capcity; i++) {
-    entry_t *entry = hashmap->bucket + (hash + i) % hashmap->capcity;
-    if (match(entry, key, len))
-      return entry;
+    // an empty entry ends the probing, since the key would have been put there
+    if (group_match(ctrl, CTRL_EMPTY))
+      return NULL;
+    group = (group + step) & group_mask;
+  }
+}
+
+static void swiss_remove(hashmap_t *hashmap, entry_t *entry)
+{
+  size_t index = entry - hashmap->bucket;
+  uint8_t *group = hashmap->ctrl + index / GROUP_SIZE * GROUP_SIZE;
+
+  // the probing of a key never went past a group with an empty entry,
+  // so the entry can be emptied, otherwise it becomes a tombstone
+  if (group_match(group, CTRL_EMPTY)) {
+    hashmap->ctrl[index] = CTRL_EMPTY;
+    hashmap->filled--;
+  } else {
+    hashmap->ctrl[index] = CTRL_DELETED;
+  }
+  clear_entry(entry);
+  hashmap->size--;
+}
+
+static void add_entry(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, void *val)
+{
+  switch (hashmap->layout) {
+    case HASHMAP_SWISS: swiss_add(hashmap, key, len, hash, val); break;
+    case HASHMAP_LINEAR: linear_add(hashmap, key, len, hash, val); break;
+  }
+}
+
+// if found, return the entry pointer, otherwise return null pointer
+static entry_t *get_entry(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, bool interned)
+{
+  switch (hashmap->layout) {
+    case HASHMAP_SWISS: return swiss_get(hashmap, key, len, hash, interned);
+    case HASHMAP_LINEAR: return linear_get(hashmap, key, len, hash, interned);
   }
   return NULL;
 }
 
+static void remove_entry(hashmap_t *hashmap, char *key, size_t len, uint64_t hash, bool interned)
+{
+  entry_t *entry = get_entry(hashmap, key, len, hash, interned);
+  if (!entry) {
+    fprintf(stderr, "no entry has key \"%.*s\", cannot remove\n", (int) len, key);
+    return;
+  }
+
+  switch (hashmap->layout) {
+    case HASHMAP_SWISS: swiss_remove(hashmap, entry); break;
+    case HASHMAP_LINEAR: linear_remove(hashmap, entry); break;
+  }
+}
+
+void hashmap_add(hashmap_t *hashmap, char *key, size_t len, void *val)
+{
+  add_entry(hashmap, key, len, hash_bytes(key, len), val);
+}
+
+void hashmap_remove(hashmap_t *hashmap, char *key, size_t len)
+{
+  remove_entry(hashmap, key, len, hash_bytes(key, len), false);
+}
+
+entry_t *hashmap_get(hashmap_t *hashmap, char *key, size_t len)
+{
+  return get_entry(hashmap, key, len, hash_bytes(key, len), false);
+}
+
+// the following functions pass atom as key
+// which carries its precomputed hash, and is matched by pointer
+
+void hashmap_add_atom(hashmap_t *hashmap, atom_t *key, void *val)
+{
+  add_entry(hashmap, key->name, key->len, key->hash, val);
+}
+
+void hashmap_remove_atom(hashmap_t *hashmap, atom_t *key)
+{
+  remove_entry(hashmap, key->name, key->len, key->hash, true);
+}
+
+entry_t *hashmap_get_atom(hashmap_t *hashmap, atom_t *key)
+{
+  return get_entry(hashmap, key->name, key->len, key->hash, true);
+}
+
 // the following functions pass c-style string as key, which is null-terminated
 // use strlen to get the number of valid characters excluding '\0'
 
@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// compilation phases, allocations are accounted to the phase they are made in
+typedef enum ARENA_PHASE
+{
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_IR,
+  PHASE_CODEGEN,
+  PHASE_LINK,
+  PHASE_NUM,
+} ARENA_PHASE;
+
+// block of memory that small allocations are bumped from
+// large allocations get a block of their own, so they can be resized
+typedef struct block_t
+{
+  struct block_t *prev;
+  struct block_t *next;
+  size_t size;  // capacity of data
+  size_t used;  // bytes used in data
+  _Alignas(16) unsigned char data[];
+} block_t;
+
+// region allocator, all the memory of a compilation comes from one arena,
+// and is released at once when the arena is deleted
+typedef struct arena_t
+{
+  block_t *blocks;  // blocks of small allocations, the current block is the head
+  block_t *large;   // blocks of large allocations
+  ARENA_PHASE phase;
+  size_t used[PHASE_NUM];  // bytes allocated in each phase
+  size_t reserved;         // bytes reserved from the system
+} arena_t;
+
+// the arena of current compilation
+extern arena_t *curr_arena;
+
+arena_t *new_arena();
+void delete_arena(arena_t *arena);
+
+void arena_set_phase(arena_t *arena, ARENA_PHASE phase);
+
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_calloc(arena_t *arena, size_t num, size_t size);
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+
+void arena_report(arena_t *arena, FILE *fp);
+
+#endif
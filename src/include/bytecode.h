@@ -0,0 +1,128 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ir.h"
+#include "vec.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// register-based bytecode, the portable backend next to codegen
+// the ir of a program is compiled to bytecode (bytecode.c), and interpreted (vm.c),
+// or written to a .katc file, which is mapped back into memory to be interpreted later
+//
+// a function works on a window of registers, numbered
+// parameters first, then local variables, temporaries, and the constants it uses
+// the registers past its window hold the arguments of its calls,
+// and become the parameters of callee, which works on the window starting there
+//
+// an instruction is 8 bytes, an opcode and register a, followed by registers b and c,
+// a 32-bit immediate, or a jump target, which is the index of an instruction in program
+// compare-and-branch takes two slots, the second one holds the target only
+
+typedef enum BC_OP
+{
+  BC_MOV,    // a = b
+  BC_LOADI,  // a = imm
+  BC_NEG,    // a = -b
+  BC_ADD,    // a = b + c
+  BC_ADDI,   // a = b + c, where c is a signed 16-bit immediate
+  BC_SUB,    // a = b - c
+  BC_MUL,    // a = b * c
+  BC_DIV,    // a = b / c
+  BC_EQ,     // a = b == c
+  BC_NE,     // a = b != c
+  BC_LT,     // a = b < c
+  BC_LE,     // a = b <= c
+  BC_GT,     // a = b > c
+  BC_GE,     // a = b >= c
+  BC_JMP,    // goto target
+  BC_JZ,     // goto target if a is zero
+  BC_JNZ,    // goto target if a is not zero
+  BC_BEQ,    // goto target of the next slot if a == b
+  BC_BNE,
+  BC_BLT,
+  BC_BLE,
+  BC_BGT,
+  BC_BGE,
+  BC_BEQI,   // goto target of the next slot if a == imm
+  BC_BNEI,
+  BC_BLTI,
+  BC_BLEI,
+  BC_BGTI,
+  BC_BGEI,
+  BC_CALL,   // a = call function c, whose window starts at register b
+  BC_RET,    // return a
+  BC_PRINT,  // print a
+  BC_HELLO,  // print the hello message, which every kat program prints first :^)
+  BC_OP_NUM,
+} BC_OP;
+
+typedef struct bc_ins_t
+{
+  uint8_t op;
+  uint8_t unused;
+  uint16_t a;
+  union {
+    struct {
+      uint16_t b;
+      uint16_t c;
+    };
+    int32_t imm;
+    uint32_t target;
+  };
+} bc_ins_t;
+
+typedef struct bc_func_t
+{
+  uint32_t entry;       // index of the first instruction
+  uint32_t end;         // index past the last instruction
+  uint16_t params_num;
+  uint16_t frame_size;  // registers of the function itself
+  uint16_t regs_num;    // frame_size, and the arguments of the calls it makes
+  uint16_t unused;
+} bc_func_t;
+
+DEFINE_VEC(bc_ins_vec, bc_ins_t)
+DEFINE_VEC(bc_func_vec, bc_func_t)
+
+typedef struct bc_prog_t
+{
+  uint32_t funcs_num;
+  uint32_t code_size;
+  uint32_t main;        // index of main in funcs
+  bc_func_t *funcs;
+  bc_ins_t *code;
+  void *mapped;         // the mapping of .katc file the program is in, or null
+  size_t mapped_size;
+} bc_prog_t;
+
+// a .katc file is the header, followed by funcs and code as they are in memory,
+// in the byte order of the machine that wrote it
+#define KATC_MAGIC "KATC"
+#define KATC_VERSION 1
+
+typedef struct katc_header_t
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t funcs_num;
+  uint32_t code_size;
+  uint32_t main;
+  uint32_t unused;
+} katc_header_t;
+
+// fuse common sequences of ir into superinstructions (--no-fuse compiles them one by one)
+extern bool use_fusion;
+
+// bytecode.c
+bc_prog_t *gen_bytecode(ir_func_t *prog);
+void verify_bytecode(bc_prog_t *prog);
+void write_bytecode(bc_prog_t *prog, char *path);
+bc_prog_t *load_bytecode(char *path);
+void unload_bytecode(bc_prog_t *prog);
+
+// vm.c
+int run_bytecode(bc_prog_t *prog, int32_t *args, int args_num);
+
+#endif
@@ -1,13 +1,19 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
-#include "parse.h"
+#include "ir.h"
+#include "obj.h"
+#include <stdbool.h>
 #include <stdio.h>
 
 extern char *source_file_path;
 extern char *output_file_path;
 extern FILE *output_file;
+extern obj_t *output_obj;
+extern bool use_regalloc;
+extern bool use_peephole;
 
-void codegen(node_t *tree);
+void codegen(ir_func_t *prog);
+void codegen_runtime();
 
 #endif
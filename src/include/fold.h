@@ -0,0 +1,21 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "parse.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// what the last fold did
+typedef struct fold_stats_t
+{
+  size_t folded;      // expression nodes replaced by their constant value
+  size_t propagated;  // references to constant variables replaced by their value
+  size_t removed;     // initializations of constant variables removed
+} fold_stats_t;
+
+extern fold_stats_t fold_stats;
+
+void fold(node_t *tree);
+void fold_report(FILE *fp);
+
+#endif
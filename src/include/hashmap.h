@@ -1,27 +1,47 @@
 #ifndef HASHMAP_H
 #define HASHMAP_H
 
+#include "intern.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 typedef struct entry_t
 {
-  bool used;    // if the entry has been used
-  char *key;    // string (without null '\0' as its tail)
-  size_t len;   // key length (number of characters)
-  void *val;    // value
+  uint64_t hash;  // hash of key, compared before the key itself
+  char *key;      // string (without null '\0' as its tail)
+  uint32_t len;   // key length (number of characters)
+  bool used;      // if the entry is alive
+  bool deleted;   // if the entry is a tombstone, which does not end probing (HASHMAP_LINEAR)
+  void *val;      // value
 } entry_t;
 
+// layouts of hash table, both are open addressing with power-of-two capacity
+// HASHMAP_LINEAR: linear probing over the entries,
+//   the table grows when it is 3/4 filled, so the probing always ends at an empty entry
+// HASHMAP_SWISS: a control byte per entry holds 7 bits of the hash (or empty/deleted),
+//   the entries are probed in groups of 16, whose control bytes are matched at once,
+//   the table grows when it is 7/8 filled
+typedef enum HASHMAP_LAYOUT
+{
+  HASHMAP_SWISS,
+  HASHMAP_LINEAR,
+} HASHMAP_LAYOUT;
+
 typedef struct hashmap_t
 {
-  entry_t *bucket;  // chain of entries
-  size_t capcity;   // maximum number of entries
-  size_t size;      // the number of entries used
+  HASHMAP_LAYOUT layout;
+  entry_t *bucket;  // array of entries
+  uint8_t *ctrl;    // control bytes of entries (HASHMAP_SWISS)
+  size_t capcity;   // number of entries in bucket
+  size_t size;      // the number of entries alive
+  size_t filled;    // the number of entries alive or deleted
 } hashmap_t;
 
-hashmap_t *new_hashmap(size_t capacity);
+uint64_t hash_bytes(char *s, size_t len);
 
-void delete_hashmap(hashmap_t *hashmap);
+hashmap_t *new_hashmap(size_t capacity);
+hashmap_t *new_hashmap_layout(HASHMAP_LAYOUT layout, size_t capacity);
 
 void hashmap_add(hashmap_t *hashmap, char *key, size_t len, void *val);
 void hashmap_add_cstr(hashmap_t *hashmap, char *key, void *val);
@@ -32,6 +52,10 @@ void hashmap_remove_cstr(hashmap_t *hashmap, char *key);
 entry_t *hashmap_get(hashmap_t *hashmap, char *key, size_t len);
 entry_t *hashmap_get_cstr(hashmap_t *hashmap, char *key);
 
+void hashmap_add_atom(hashmap_t *hashmap, atom_t *key, void *val);
+void hashmap_remove_atom(hashmap_t *hashmap, atom_t *key);
+entry_t *hashmap_get_atom(hashmap_t *hashmap, atom_t *key);
+
 #ifdef DEBUG
   void hashmap_test();
 #endif
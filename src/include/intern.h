@@ -0,0 +1,24 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// interned identifier
+// each distinct identifier is interned exactly once, so atoms are compared by pointer,
+// and the hash is computed once when the identifier is first seen
+typedef struct atom_t
+{
+  uint32_t id;    // index of the atom, dense from 0
+  uint32_t len;   // length of name (excluding '\0')
+  uint64_t hash;  // hash of name
+  char name[];    // null-terminated name
+} atom_t;
+
+void intern_reset();
+atom_t *intern(char *str, size_t len);
+atom_t *intern_cstr(char *str);
+atom_t *atom_of(uint32_t id);
+size_t atom_num();
+
+#endif
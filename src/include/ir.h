@@ -0,0 +1,150 @@
+#ifndef IR_H
+#define IR_H
+
+#include "parse.h"
+#include "symbol.h"
+#include "vec.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// three-address intermediate representation
+// a function is a control flow graph of basic blocks,
+// each block is a list of instructions ending with exactly one terminator (jmp, br or ret)
+// the operands of instructions are temporaries, variables or immediates
+// temporaries are numbered per function, and are not in ssa form:
+// the result of a short-circuit expression is assigned in two blocks
+
+typedef enum IR_OP
+{
+  IR_MOV,   // dst = a
+  IR_NEG,   // dst = -a
+  IR_ADD,   // dst = a + b
+  IR_SUB,   // dst = a - b
+  IR_MUL,   // dst = a * b
+  IR_DIV,   // dst = a / b
+  IR_EQ,    // dst = a == b
+  IR_NE,    // dst = a != b
+  IR_LT,    // dst = a < b
+  IR_LE,    // dst = a <= b
+  IR_GT,    // dst = a > b
+  IR_GE,    // dst = a >= b
+  IR_CALL,  // dst = func(args...)
+  IR_JMP,   // jmp target
+  IR_BR,    // br a, target, else_target (target if a is not zero)
+  IR_RET,   // ret a
+  IR_OP_NUM,
+} IR_OP;
+
+typedef enum OPD_KIND
+{
+  OPD_NONE,
+  OPD_TEMP,  // temporary
+  OPD_VAR,   // local variable or parameter
+  OPD_IMM,   // immediate
+} OPD_KIND;
+
+typedef struct operand_t
+{
+  OPD_KIND kind;
+  union {
+    uint32_t temp;
+    symbol_t *var;
+    int64_t imm;
+  };
+} operand_t;
+
+struct bb_t;
+
+typedef struct ins_t
+{
+  IR_OP op;
+  operand_t dst;
+  operand_t a;
+  operand_t b;
+  union {
+    // IR_CALL
+    struct {
+      symbol_t *func;
+      operand_t *args;
+      uint32_t args_num;
+    };
+    // IR_JMP and IR_BR
+    struct {
+      struct bb_t *target;
+      struct bb_t *else_target;
+    };
+  };
+} ins_t;
+
+DEFINE_VEC(ins_vec, ins_t)
+DEFINE_VEC(bb_vec, struct bb_t *)
+DEFINE_VEC(var_vec, symbol_t *)
+
+// basic block
+typedef struct bb_t
+{
+  uint32_t id;         // index in the blocks of function
+  ins_vec_t ins;       // instructions, the last one is the terminator
+  struct bb_t *succ[2];
+  uint32_t succ_num;
+  bb_vec_t preds;
+} bb_t;
+
+typedef struct ir_func_t
+{
+  symbol_t *func;
+  var_vec_t params;    // parameters in order
+  var_vec_t locals;    // local variables of all the blocks in the function
+  bb_vec_t blocks;     // blocks in layout order, the first one is the entry
+  uint32_t temps_num;
+  struct ir_func_t *next;
+} ir_func_t;
+
+// values are the temporaries and variables of function, numbered
+// temporaries first, then parameters and local variables (see symbol_t::index)
+static inline uint32_t ir_values_num(ir_func_t *func)
+{
+  return func->temps_num + func->params.size + func->locals.size;
+}
+
+// the value of operand, which must be a temporary or variable
+static inline uint32_t ir_value(ir_func_t *func, operand_t opd)
+{
+  return opd.kind == OPD_TEMP ? opd.temp : func->temps_num + opd.var->index;
+}
+
+// true if the instruction ends a basic block
+static inline bool ir_is_terminator(IR_OP op)
+{
+  return op == IR_JMP || op == IR_BR || op == IR_RET;
+}
+
+// operands read by the instruction, return the number of them
+// buf holds a and b for the instructions other than calls
+static inline uint32_t ir_reads(ins_t *ins, operand_t buf[2], operand_t **reads)
+{
+  buf[0] = ins->a;
+  buf[1] = ins->b;
+  *reads = buf;
+  switch (ins->op) {
+    case IR_CALL: *reads = ins->args; return ins->args_num;
+    case IR_JMP: return 0;
+    case IR_MOV:
+    case IR_NEG:
+    case IR_BR:
+    case IR_RET: return 1;
+    default: return 2;
+  }
+}
+
+// true if the instruction writes its dst
+static inline bool ir_writes(ins_t *ins)
+{
+  return !ir_is_terminator(ins->op);
+}
+
+ir_func_t *gen_ir(node_t *tree);
+void verify_ir(ir_func_t *prog);
+void dump_ir(ir_func_t *prog, FILE *fp);
+
+#endif
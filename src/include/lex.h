@@ -1,40 +1,111 @@
 #ifndef LEX_H
 #define LEX_H
 
+#include "intern.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 typedef enum TK_TYPE
 {
-  TK_KW,
   TK_ID,
   TK_NUM,
   TK_CHR,
   TK_STR,
-  TK_PUNCT,
   TK_EOF,
+
+  // keywords, from TK_KW_IF to TK_KW_FALSE
+  TK_KW_IF,       // if
+  TK_KW_ELSE,     // else
+  TK_KW_ELIF,     // elif
+  TK_KW_WHILE,    // while
+  TK_KW_BREAK,    // break
+  TK_KW_CONTINUE, // continue
+  TK_KW_FUNC,     // func
+  TK_KW_RETURN,   // return
+  TK_KW_LET,      // let
+  TK_KW_INT,      // int
+  TK_KW_FLOAT,    // float
+  TK_KW_CHAR,     // char
+  TK_KW_STR,      // str
+  TK_KW_BOOL,     // bool
+  TK_KW_TRUE,     // true
+  TK_KW_FALSE,    // false
+
+  // punctuators, from TK_LPAREN to TK_PUNCT
+  TK_LPAREN,      // (
+  TK_RPAREN,      // )
+  TK_LBRACE,      // {
+  TK_RBRACE,      // }
+  TK_LBRACKET,    // [
+  TK_RBRACKET,    // ]
+  TK_COMMA,       // ,
+  TK_SEMI,        // ;
+  TK_COLON,       // :
+  TK_DOT,         // .
+  TK_ASSIGN,      // =
+  TK_PLUS,        // +
+  TK_MINUS,       // -
+  TK_STAR,        // *
+  TK_SLASH,       // /
+  TK_PERCENT,     // %
+  TK_NOT,         // !
+  TK_AMP,         // &
+  TK_PIPE,        // |
+  TK_LT,          // <
+  TK_GT,          // >
+  TK_ADD_ASSIGN,  // +=
+  TK_SUB_ASSIGN,  // -=
+  TK_MUL_ASSIGN,  // *=
+  TK_DIV_ASSIGN,  // /=
+  TK_GE,          // >=
+  TK_LE,          // <=
+  TK_EQ,          // ==
+  TK_NE,          // !=
+  TK_LOGAND,      // &&
+  TK_LOGOR,       // ||
+  TK_ARROW,       // =>
+  TK_PUNCT,       // other punctuation characters, which are not used by kat
 } TK_TYPE;
 
+// tokens are stored contiguously in one array terminated by a TK_EOF token,
+// so the next token of a token is simply token + 1
+// the lexeme is not copied, it is located by its offset in the source buffer,
+// the values of literals are kept in a side table,
+// and identifiers are interned and brackets are matched while lexing
 typedef struct token_t
 {
   TK_TYPE type;
-  char *begin;
-  size_t len;
-  size_t line;
+  uint32_t offset;  // offset of the lexeme in the source buffer
+  uint32_t len;     // length of the lexeme
+  union {
+    uint32_t lit;   // index of the literal value (TK_NUM, TK_CHR, TK_STR)
+    uint32_t atom;  // id of the interned identifier (TK_ID)
+    uint32_t match; // index of the matching bracket (TK_LPAREN to TK_RBRACKET)
+  };
+} token_t;
 
+// literal value of number, character and string tokens
+typedef struct literal_t
+{
   union {
     int64_t ival;
     long double fval;
+    char cval;
+    char *sval;
   };
-  char cval;
-  char *sval;
+} literal_t;
 
-  struct token_t *next;
-} token_t;
+bool is_kw_type(TK_TYPE type);
+bool is_punct_type(TK_TYPE type);
 
-char *tok2cstr(token_t *token);
+char *tok_begin(token_t *token);
+size_t tok_line(token_t *token);
+literal_t *tok_literal(token_t *token);
+atom_t *tok_atom(token_t *token);
+token_t *tok_match(token_t *token);
 
-token_t *lex(char *buf);
+token_t *lex(char *buf, size_t len);
 
 void dump_token_list(token_t *tokens);
 
@@ -0,0 +1,84 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include "hashmap.h"
+#include "vec.h"
+#include "x86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// machine code in memory
+// an object holds the sections of a program with their symbols and relocations,
+// it is built by the encoder from x86 instructions (encode.c),
+// and written as an elf relocatable file (elf.c), linked into an elf executable (link.c),
+// or loaded into memory and run (jit.c)
+
+typedef enum SECTION
+{
+  SECTION_TEXT,
+  SECTION_DATA,
+  SECTION_NUM,
+} SECTION;
+
+typedef struct obj_sym_t
+{
+  char *name;
+  SECTION section;
+  uint32_t offset;  // offset in section
+  bool is_defined;
+  bool is_global;
+  bool is_func;
+} obj_sym_t;
+
+// how a relocation is computed from the address of symbol S, the addend A,
+// and the address of the field P, all of them are 32 bits
+typedef enum RELOC
+{
+  RELOC_ABS32,  // S + A
+  RELOC_PC32,   // S + A - P
+  RELOC_PLT32,  // S + A - P, a call through plt, which is the function itself when linked statically
+} RELOC;
+
+typedef struct reloc_t
+{
+  SECTION section;
+  uint32_t offset;  // offset of the field in section
+  uint32_t sym;     // index of symbol
+  RELOC kind;
+  int32_t addend;
+} reloc_t;
+
+DEFINE_VEC(byte_vec, uint8_t)
+DEFINE_VEC(obj_sym_vec, obj_sym_t)
+DEFINE_VEC(reloc_vec, reloc_t)
+
+typedef struct obj_t
+{
+  TARGET target;
+  byte_vec_t sections[SECTION_NUM];
+  obj_sym_vec_t syms;
+  hashmap_t *sym_index;  // name => index of symbol + 1
+  reloc_vec_t relocs;
+  SECTION curr;          // the section being encoded to
+} obj_t;
+
+obj_t *new_obj();
+uint32_t obj_sym(obj_t *obj, char *name);
+
+// encode.c
+void encode(obj_t *obj, x86_vec_t *code);
+
+// elf.c
+void write_obj(obj_t *obj, FILE *fp);
+void layout_exe(obj_t *exe, uint32_t addrs[SECTION_NUM]);
+void write_exe(obj_t *exe, uint32_t addrs[SECTION_NUM], uint32_t entry, char *path);
+
+// link.c
+void apply_reloc(uint8_t *field, reloc_t *reloc, uint64_t s, uint64_t p);
+void link_exe(obj_t **objs, int objs_num, char *path);
+
+// jit.c
+int jit_run(obj_t *obj, int32_t *args, int args_num);
+
+#endif
@@ -20,8 +20,6 @@ typedef enum ND_TYPE
   ND_WHILE,     // while statement
   ND_RETURN,    // return statement
   ND_NUM,       // number
-  ND_LPAREN,    // "(" (used for opp, but will not appear in ast)
-  ND_RPAREN,    // ")" (used for opp, but will not appear in ast)
   ND_ASSIGN,    // =
   ND_POS,       // + (unary)
   ND_NEG,       // - (unary)
@@ -39,64 +37,62 @@ typedef enum ND_TYPE
   ND_GE,        // >=
 } ND_TYPE;
 
+// ast node
+// every node has a small header (its type, the inline operator and the next sibling),
+// followed by the fields of its kind, which share one union
+// nodes are allocated with the size of their kind (see make_node),
+// so only the fields of the node type may be accessed
 typedef struct node_t
 {
   ND_TYPE type;
 
-  // used when node type is ND_VAR or ND_FUNC
-  union {
-    symbol_t *var;
-    symbol_t *func;
-  };
+  // operator of the node, ND_NIL if there is none
+  // used when node type is ND_EXPR (binary operator),
+  // ND_DECL_STMT or ND_EXPR_STMT (ND_ASSIGN if the statement assigns)
+  ND_TYPE op;
 
-  // function call or definition
-  // the head of parameter list
-  // parameters are organized to linked list
-  struct node_t *params;
+  // the next node
+  // used when node type is ND_FUNC, the node is a statement node,
+  // or the node is a parameter or an argument of function call
+  struct node_t *next;
 
-  // function body or statement block
-  // the head of functions or statements
-  // functions and statements are organized to linked list
   union {
-    struct node_t *body;
-    struct node_t *block;
-  };
-
-  // lhs, rhs and op
-  // used by expression and condition
-  // also used by declaration statement and expression statement
-  struct node_t *lhs;
-  struct node_t *op;
-  struct node_t *rhs;
-
-  // condition of if or while statement
-  // used when node type is ND_IF or ND_WHILE
-  struct node_t *cond;
+    // ND_VAR
+    symbol_t *var;
 
-  // if-else statement
-  // used when node type is ND_IF
-  struct node_t *if_stmt;
-  struct node_t *else_stmt;
+    // ND_PROG, ND_FUNC and ND_FNCALL
+    struct {
+      symbol_t *func;
+      // the head of parameter (or argument) list
+      struct node_t *params;
+      // function body, or the functions of program
+      struct node_t *body;
+    };
 
-  // while statement
-  // used when node type is ND_WHILE
-  struct node_t *while_stmt;
+    // ND_EXPR, ND_DECL_STMT, ND_EXPR_STMT and ND_RETURN
+    struct {
+      struct node_t *lhs;
+      struct node_t *rhs;
+    };
 
-  // the next node
-  // used when node type is ND_FUNC
-  // or the node is a statement node
-  struct node_t *next;
+    // ND_IF and ND_WHILE
+    struct {
+      struct node_t *cond;
+      union {
+        struct node_t *if_stmt;
+        struct node_t *while_stmt;
+      };
+      struct node_t *else_stmt;
+    };
 
-  // literals
-  union {
+    // ND_NUM
+    // kat only supports integer literals currently
     int64_t ival;
-    long double fval;
   };
-  char cval;
-  char *sval;
 } node_t;
 
 node_t *parse(token_t *token_list);
+node_t *make_num_node(int64_t ival);
 
 void dump_ast(node_t *tree);
 
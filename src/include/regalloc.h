@@ -0,0 +1,35 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+#include "x86.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// registers allocated to values
+// %eax is left to the backend as the scratch register (results, division and returns),
+// the caller-saved registers are clobbered by calls, and %edx by division too,
+// so a value live across them only gets a callee-saved register
+// values are given the indexes of registers in the register set of target
+
+#define REG_NONE -1  // the value lives in memory
+#define REG_MAX 16
+
+typedef struct reg_set_t
+{
+  X86_REG regs[REG_MAX];  // the callee-saved registers come first
+  int num;
+  int callee_saved;       // the number of callee-saved registers
+} reg_set_t;
+
+typedef struct alloc_t
+{
+  int8_t *regs;         // register of each value (see ir_value), an index in the register set
+  bool used[REG_MAX];   // registers used by the function
+} alloc_t;
+
+reg_set_t *target_regs();
+alloc_t *regalloc(ir_func_t *func);
+alloc_t *spill_all(ir_func_t *func);
+
+#endif
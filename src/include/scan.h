@@ -0,0 +1,36 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// byte scanning primitives used by the lexer
+// each of them has a scalar, an sse2 and an avx2 version, chosen at runtime
+// the vector versions may read up to 32 bytes past the byte they stop at,
+// which is covered by the zero padding after the source text (see source.h)
+// all of them stop at '\0', so they never run past the sentinel
+
+typedef enum SCAN_ISA
+{
+  SCAN_SCALAR,
+  SCAN_SSE2,
+  SCAN_AVX2,
+} SCAN_ISA;
+
+// skip whitespaces and newlines
+extern char *(*skip_space)(char *p);
+
+// skip identifier characters: letter, digit and underscore
+extern char *(*skip_ident)(char *p);
+
+// find the first quote, backslash, newline or '\0' in string/character body
+extern char *(*find_quote)(char *p, char quote);
+
+// find the first newline or '\0'
+extern char *(*find_newline)(char *p);
+
+// find the first "*/" or '\0'
+extern char *(*find_comment_end)(char *p);
+
+SCAN_ISA scan_detect();
+void scan_select(SCAN_ISA isa);
+const char *scan_isa_name(SCAN_ISA isa);
+
+#endif
@@ -5,20 +5,28 @@
 #include "hashmap.h"
 #include "symbol.h"
 
-typedef struct scope_t
+// namespaces of symbols
+// variables are scoped by blocks, functions are global
+typedef enum SYM_NS
 {
-  hashmap_t *symbol_table;
-  struct scope_t *next;
-} scope_t;
+  NS_VAR,
+  NS_FUNC,
+} SYM_NS;
 
-extern scope_t *var_scope;
-extern scope_t *func_scope;
+// binding of a name in the symbol table
+// var is the innermost visible variable of the name,
+// and the variables it shadows are chained by symbol_t::next
+typedef struct binding_t
+{
+  symbol_t *var;
+  symbol_t *func;
+} binding_t;
 
+void init_scope();
 void enter_scope();
 void leave_scope();
-void add_symbol(scope_t *scope, symbol_t *symbol);
-void del_symbol(scope_t *scope, symbol_t *symbol);
-symbol_t *find_symbol_by_name(scope_t *scope, char *symbol_name);
-symbol_t *find_symbol_by_tok(scope_t *scope, token_t *token);
+void add_symbol(SYM_NS ns, symbol_t *symbol);
+symbol_t *find_symbol_by_atom(SYM_NS ns, atom_t *atom);
+symbol_t *find_symbol_by_tok(SYM_NS ns, token_t *token);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,24 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// number of zero bytes guaranteed to follow the source text
+// the first one works as the end-of-buffer sentinel for the lexer,
+// the rest allow the lexer to read ahead without bounds checking
+#define SOURCE_PADDING 64
+
+typedef struct source_t
+{
+  char *buf;    // source text followed by SOURCE_PADDING zero bytes (read-only)
+  size_t len;   // length of source text (excluding padding)
+  size_t size;  // size of the whole mapping or allocation
+  bool mapped;  // if the buffer is memory-mapped from a file
+} source_t;
+
+source_t *load_source(char *path);
+
+void unload_source(source_t *source);
+
+#endif
@@ -2,8 +2,10 @@
 #define SYMBOL_H
 
 #include "lex.h"
+#include "intern.h"
 #include "hashmap.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 typedef enum KAT_TYPE
@@ -12,21 +14,29 @@ typedef enum KAT_TYPE
   KAT_CHAR,
   KAT_STR,
   KAT_BOOL,
-  KAT_NIL
+  KAT_NIL,
+  KAT_FUNC
 } KAT_TYPE;
 
+// types are canonical and immutable, so two types are equal iff they are the same pointer
+// there is one type of each basic kind, and function types are interned by signature
 typedef struct type_t
 {
   char *name;
   size_t size;
   KAT_TYPE kind;
 
-  struct type_t *next;
+  // function type (KAT_FUNC)
+  // sig[0] is the return type, followed by the types of params
+  struct type_t *return_type;
+  size_t params_num;
+  struct type_t **sig;
 } type_t;
 
 typedef struct symbol_t
 {
-  char *name;
+  atom_t *atom;
+  char *name;   // name of atom
   bool is_var;
   bool is_func;
 
@@ -36,17 +46,28 @@ typedef struct symbol_t
     type_t *return_type;
   };
 
-  size_t params_num;
-  type_t *params_type;
+  // function's signature
+  type_t *func_type;
 
   int offset;
+  uint32_t index;  // index of local variable or parameter in its function (see ir.c)
+
+  // constant propagation (see fold.c)
+  bool is_assigned;   // the variable is assigned after its declaration
+  bool is_const;      // the variable holds const_val all its lifetime
+  int64_t const_val;
 
   token_t *token;
 
+  // the variable of the same name shadowed by this one (see scope.c)
   struct symbol_t *next;
 } symbol_t;
 
 symbol_t *make_var_symbol(token_t *var_tok, type_t *var_type);
-symbol_t *make_fn_symbol(token_t *func_tok, type_t *return_type, type_t *params_type, size_t params_num);
+symbol_t *make_fn_symbol(token_t *func_tok, type_t *func_type);
+
+void init_types();
+type_t *basic_type(KAT_TYPE kind);
+type_t *func_type(type_t *return_type, type_t **params_type, size_t params_num);
 
 #endif
@@ -0,0 +1,99 @@
+#ifndef VEC_H
+#define VEC_H
+
+#include "arena.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// type-specialized dynamic arrays, generated by macros
+//
+// DEFINE_VEC(name, type) defines name_t, an array of type growing geometrically
+// DEFINE_SMALL_VEC(name, type, n) defines name_t with an inline buffer of n elements,
+// which only moves to the arena once it has more than n elements
+// a small vector points into itself, so it must not be copied after name_init
+//
+// both have the same functions, and serve as stacks with push, pop and top:
+//   void name_init(name_t *vec);
+//   void name_push(name_t *vec, type elem);
+//   type name_pop(name_t *vec);
+//   type *name_top(name_t *vec);
+//   type *name_at(name_t *vec, size_t index);
+//   bool name_empty(name_t *vec);
+//   void name_clear(name_t *vec);
+// memory comes from the arena of current compilation, so there is nothing to free
+
+#define VEC_FUNCS(name, type, inline_buf, inline_num)                              \
+  static inline void name##_init(name##_t *vec)                                    \
+  {                                                                                \
+    vec->data = inline_buf;                                                        \
+    vec->size = 0;                                                                 \
+    vec->capacity = inline_num;                                                    \
+  }                                                                                \
+                                                                                   \
+  static __attribute__((noinline, unused)) void name##_grow(name##_t *vec)         \
+  {                                                                                \
+    size_t capacity = vec->capacity ? vec->capacity * 2 : 4;                       \
+    if (inline_buf && vec->data == inline_buf) {                                   \
+      type *data = arena_alloc(curr_arena, sizeof(type) * capacity);               \
+      memcpy(data, vec->data, sizeof(type) * vec->size);                           \
+      vec->data = data;                                                            \
+    } else {                                                                       \
+      vec->data = arena_realloc(curr_arena, vec->data, sizeof(type) * vec->capacity, \
+                                sizeof(type) * capacity);                          \
+    }                                                                              \
+    vec->capacity = capacity;                                                      \
+  }                                                                                \
+                                                                                   \
+  static inline void name##_push(name##_t *vec, type elem)                         \
+  {                                                                                \
+    if (vec->size == vec->capacity)                                                \
+      name##_grow(vec);                                                            \
+    vec->data[vec->size++] = elem;                                                 \
+  }                                                                                \
+                                                                                   \
+  static inline type name##_pop(name##_t *vec)                                     \
+  {                                                                                \
+    return vec->data[--vec->size];                                                 \
+  }                                                                                \
+                                                                                   \
+  static inline type *name##_top(name##_t *vec)                                    \
+  {                                                                                \
+    return vec->data + vec->size - 1;                                              \
+  }                                                                                \
+                                                                                   \
+  static inline type *name##_at(name##_t *vec, size_t index)                       \
+  {                                                                                \
+    return vec->data + index;                                                      \
+  }                                                                                \
+                                                                                   \
+  static inline bool name##_empty(name##_t *vec)                                   \
+  {                                                                                \
+    return vec->size == 0;                                                         \
+  }                                                                                \
+                                                                                   \
+  static inline void name##_clear(name##_t *vec)                                   \
+  {                                                                                \
+    vec->size = 0;                                                                 \
+  }
+
+#define DEFINE_VEC(name, type)                                                     \
+  typedef struct name##_t                                                          \
+  {                                                                                \
+    type *data;                                                                    \
+    size_t size;                                                                   \
+    size_t capacity;                                                               \
+  } name##_t;                                                                      \
+  VEC_FUNCS(name, type, NULL, 0)
+
+#define DEFINE_SMALL_VEC(name, type, n)                                            \
+  typedef struct name##_t                                                          \
+  {                                                                                \
+    type *data;                                                                    \
+    size_t size;                                                                   \
+    size_t capacity;                                                               \
+    type buf[n];                                                                   \
+  } name##_t;                                                                      \
+  VEC_FUNCS(name, type, vec->buf, n)
+
+#endif
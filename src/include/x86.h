@@ -0,0 +1,173 @@
+#ifndef X86_H
+#define X86_H
+
+#include "vec.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// x86 instructions, built by codegen into a list, rewritten by the peephole pass
+// and finally printed as gnu assembly (at&t syntax), or encoded into an object (see obj.h)
+
+// the machine that code is generated for (--target)
+typedef enum TARGET
+{
+  TARGET_I386,    // 32-bit, cdecl (default)
+  TARGET_X86_64,  // 64-bit, system v abi
+} TARGET;
+
+extern TARGET target;
+
+// registers, in the order of their encodings
+// they are named after their 32-bit parts, which hold the values of kat (int is 32 bits),
+// and the 64-bit ones (e.g. %rax) are used for addresses on x86_64, which also has %r8 to %r15
+typedef enum X86_REG
+{
+  X86_EAX,
+  X86_ECX,
+  X86_EDX,
+  X86_EBX,
+  X86_ESP,
+  X86_EBP,
+  X86_ESI,
+  X86_EDI,
+  X86_R8,
+  X86_R9,
+  X86_R10,
+  X86_R11,
+  X86_R12,
+  X86_R13,
+  X86_R14,
+  X86_R15,
+  X86_REG_NUM,
+} X86_REG;
+
+// condition codes of jcc and setcc
+typedef enum X86_CC
+{
+  X86_CC_E,
+  X86_CC_NE,
+  X86_CC_L,
+  X86_CC_LE,
+  X86_CC_G,
+  X86_CC_GE,
+  X86_CC_NUM,
+} X86_CC;
+
+// the operand of an one-operand instruction is dst, except push, call and jumps, which use src
+typedef enum X86_OP
+{
+  X86_NOP,    // deleted instruction, not printed
+  X86_LABEL,  // src:
+  X86_TEXT,     // a line of assembly only for the assembler, printed as it is, and not encoded
+  X86_SECTION,  // switch to section src, .text or .data
+  X86_GLOBAL,   // make function src visible to other objects
+  X86_STRING,   // the bytes of string src and a null
+  X86_MOV,
+  X86_MOVZB,    // zero extend the low byte of src
+  X86_MOVB,     // store the low byte of src
+  X86_LEA,
+  X86_ADD,
+  X86_SUB,
+  X86_IMUL,
+  X86_XOR,
+  X86_SHL,
+  X86_NEG,
+  X86_CMP,    // compare dst with src
+  X86_TEST,
+  X86_SETCC,  // set the low byte of dst
+  X86_CLTD,   // sign extend %eax into %edx
+  X86_IDIV,   // divide %edx:%eax by dst
+  X86_PUSH,
+  X86_POP,
+  X86_CALL,
+  X86_JMP,
+  X86_JCC,
+  X86_RET,
+  X86_SYSCALL,  // int $0x80 on i386
+  X86_OP_NUM,
+} X86_OP;
+
+typedef enum X86_OPD_KIND
+{
+  X86_OPD_NONE,
+  X86_OPD_REG,    // register
+  X86_OPD_IMM,    // immediate
+  X86_OPD_MEM,    // disp(base)
+  X86_OPD_SYM,    // symbol, the address of it when used as an immediate
+  X86_OPD_LABEL,  // local label of a basic block, .L<sym>.<id>
+  X86_OPD_RIP,    // the memory at symbol, addressed relative to %rip (x86_64)
+} X86_OPD_KIND;
+
+typedef struct x86_opd_t
+{
+  X86_OPD_KIND kind;
+  X86_REG reg;  // the register, or the base of memory
+  union {
+    int64_t imm;
+    int32_t disp;
+    uint32_t id;  // id of label
+  };
+  char *sym;    // the symbol, or the function of label
+} x86_opd_t;
+
+typedef struct x86_ins_t
+{
+  X86_OP op;
+  bool wide;  // operates on 64 bits (x86_64), e.g. on %rsp, push and pop always do
+  X86_CC cc;  // jcc and setcc
+  x86_opd_t src;
+  x86_opd_t dst;
+} x86_ins_t;
+
+DEFINE_VEC(x86_vec, x86_ins_t)
+
+static inline x86_opd_t x86_none()
+{
+  return (x86_opd_t) { .kind = X86_OPD_NONE };
+}
+
+static inline x86_opd_t x86_reg(X86_REG reg)
+{
+  return (x86_opd_t) { .kind = X86_OPD_REG, .reg = reg };
+}
+
+static inline x86_opd_t x86_imm(int64_t imm)
+{
+  return (x86_opd_t) { .kind = X86_OPD_IMM, .imm = imm };
+}
+
+static inline x86_opd_t x86_mem(X86_REG base, int32_t disp)
+{
+  return (x86_opd_t) { .kind = X86_OPD_MEM, .reg = base, .disp = disp };
+}
+
+static inline x86_opd_t x86_sym(char *sym)
+{
+  return (x86_opd_t) { .kind = X86_OPD_SYM, .sym = sym };
+}
+
+static inline x86_opd_t x86_rip(char *sym)
+{
+  return (x86_opd_t) { .kind = X86_OPD_RIP, .sym = sym };
+}
+
+static inline x86_opd_t x86_label(char *func, uint32_t id)
+{
+  return (x86_opd_t) { .kind = X86_OPD_LABEL, .sym = func, .id = id };
+}
+
+static inline bool x86_is_reg(x86_opd_t opd, X86_REG reg)
+{
+  return opd.kind == X86_OPD_REG && opd.reg == reg;
+}
+
+bool x86_same_opd(x86_opd_t x, x86_opd_t y);
+X86_CC x86_negate_cc(X86_CC cc);
+void print_x86(x86_ins_t *ins, FILE *fp);
+
+// peephole.c
+void peephole(x86_vec_t *code);
+void peephole_report(FILE *fp);
+
+#endif
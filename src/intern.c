@@ -0,0 +1,91 @@
+#include "intern.h"
+#include "hashmap.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// atoms indexed by id
+static atom_t **atoms;
+static size_t atoms_size;
+static size_t atoms_capacity;
+
+// open addressing index from name to atom
+// slots hold atom id + 1, 0 means empty slot
+// capacity is a power of two, and the table is kept at most half full
+static uint32_t *slots;
+static size_t slots_capacity;
+
+static void grow_slots()
+{
+  size_t capacity = slots_capacity ? slots_capacity * 2 : 1024;
+  uint32_t *new_slots = arena_calloc(curr_arena, capacity, sizeof(uint32_t));
+  for (size_t i = 0; i < atoms_size; i++) {
+    size_t slot = atoms[i]->hash & (capacity - 1);
+    while (new_slots[slot])
+      slot = (slot + 1) & (capacity - 1);
+    new_slots[slot] = i + 1;
+  }
+  slots = new_slots;
+  slots_capacity = capacity;
+}
+
+static atom_t *make_atom(char *str, size_t len, uint64_t hash)
+{
+  if (atoms_size == atoms_capacity) {
+    size_t capacity = atoms_capacity ? atoms_capacity * 2 : 1024;
+    atoms = arena_realloc(curr_arena, atoms, sizeof(atom_t *) * atoms_capacity, sizeof(atom_t *) * capacity);
+    atoms_capacity = capacity;
+  }
+  atom_t *atom = arena_alloc(curr_arena, sizeof(atom_t) + len + 1);
+  atom->id = atoms_size;
+  atom->len = len;
+  atom->hash = hash;
+  memcpy(atom->name, str, len);
+  atom->name[len] = '\0';
+  atoms[atoms_size++] = atom;
+  return atom;
+}
+
+// forget all atoms, they are allocated from the arena of current compilation
+void intern_reset()
+{
+  atoms = NULL;
+  atoms_size = atoms_capacity = 0;
+  slots = NULL;
+  slots_capacity = 0;
+}
+
+// return the unique atom of the string, intern it if not seen before
+atom_t *intern(char *str, size_t len)
+{
+  if (2 * (atoms_size + 1) > slots_capacity)
+    grow_slots();
+
+  uint64_t hash = hash_bytes(str, len);
+  size_t slot = hash & (slots_capacity - 1);
+  while (slots[slot]) {
+    atom_t *atom = atoms[slots[slot] - 1];
+    if (atom->hash == hash && atom->len == len && !memcmp(atom->name, str, len))
+      return atom;
+    slot = (slot + 1) & (slots_capacity - 1);
+  }
+
+  atom_t *atom = make_atom(str, len, hash);
+  slots[slot] = atom->id + 1;
+  return atom;
+}
+
+atom_t *intern_cstr(char *str)
+{
+  return intern(str, strlen(str));
+}
+
+atom_t *atom_of(uint32_t id)
+{
+  return atoms[id];
+}
+
+size_t atom_num()
+{
+  return atoms_size;
+}
@@ -0,0 +1,654 @@
+#include "ir.h"
+#include "arena.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdnoreturn.h>
+
+// the function and the block that instructions are appended to
+static ir_func_t *curr_func;
+static bb_t *curr_bb;
+
+// instructions of current block
+// a block is complete when the next block starts, and then its instructions are
+// copied out to an array of the exact size, so the buffer is reused by all the blocks
+static ins_vec_t curr_ins;
+
+// ir operators of the binary ast operators
+static IR_OP binary_ops[] = {
+  [ND_ADD] = IR_ADD,
+  [ND_SUB] = IR_SUB,
+  [ND_MUL] = IR_MUL,
+  [ND_DIV] = IR_DIV,
+  [ND_EQ]  = IR_EQ,
+  [ND_NE]  = IR_NE,
+  [ND_LT]  = IR_LT,
+  [ND_LE]  = IR_LE,
+  [ND_GT]  = IR_GT,
+  [ND_GE]  = IR_GE,
+};
+
+static operand_t opd_none()
+{
+  return (operand_t) { .kind = OPD_NONE };
+}
+
+static operand_t opd_imm(int64_t imm)
+{
+  return (operand_t) { .kind = OPD_IMM, .imm = imm };
+}
+
+static operand_t opd_var(symbol_t *var)
+{
+  return (operand_t) { .kind = OPD_VAR, .var = var };
+}
+
+static operand_t new_temp()
+{
+  return (operand_t) { .kind = OPD_TEMP, .temp = curr_func->temps_num++ };
+}
+
+static bb_t *new_bb()
+{
+  bb_t *bb = arena_calloc(curr_arena, 1, sizeof(bb_t));
+  ins_vec_init(&bb->ins);
+  bb_vec_init(&bb->preds);
+  return bb;
+}
+
+// copy the instructions of current block out of the buffer
+static void seal_bb()
+{
+  if (!curr_bb)
+    return;
+  curr_bb->ins.size = curr_bb->ins.capacity = curr_ins.size;
+  curr_bb->ins.data = arena_alloc(curr_arena, sizeof(ins_t) * curr_ins.size);
+  memcpy(curr_bb->ins.data, curr_ins.data, sizeof(ins_t) * curr_ins.size);
+  ins_vec_clear(&curr_ins);
+}
+
+// place the block at the end of current function, following instructions go to it
+static void start_bb(bb_t *bb)
+{
+  seal_bb();
+  bb->id = curr_func->blocks.size;
+  bb_vec_push(&curr_func->blocks, bb);
+  curr_bb = bb;
+}
+
+static bool is_terminated()
+{
+  return !ins_vec_empty(&curr_ins) && ir_is_terminator(ins_vec_top(&curr_ins)->op);
+}
+
+// append an instruction to current block
+// the code following a terminator (e.g. statements after return) is unreachable,
+// so it goes to a new block, which is removed with the other unreachable blocks
+static ins_t *emit_ins(IR_OP op)
+{
+  if (is_terminated())
+    start_bb(new_bb());
+  ins_vec_push(&curr_ins, (ins_t) { .op = op });
+  return ins_vec_top(&curr_ins);
+}
+
+static void emit_op(IR_OP op, operand_t dst, operand_t a, operand_t b)
+{
+  ins_t *ins = emit_ins(op);
+  ins->dst = dst;
+  ins->a = a;
+  ins->b = b;
+}
+
+static void emit_jmp(bb_t *target)
+{
+  emit_ins(IR_JMP)->target = target;
+}
+
+static void emit_br(operand_t cond, bb_t *target, bb_t *else_target)
+{
+  ins_t *ins = emit_ins(IR_BR);
+  ins->a = cond;
+  ins->target = target;
+  ins->else_target = else_target;
+}
+
+static void emit_ret(operand_t a)
+{
+  emit_ins(IR_RET)->a = a;
+}
+
+static operand_t gen_expr(node_t *node);
+
+// arguments are evaluated left to right
+static operand_t gen_call(node_t *node)
+{
+  uint32_t args_num = 0;
+  for (node_t *param = node->params; param; param = param->next)
+    args_num++;
+
+  operand_t *args = arena_alloc(curr_arena, sizeof(operand_t) * (args_num ? args_num : 1));
+  uint32_t i = 0;
+  for (node_t *param = node->params; param; param = param->next)
+    args[i++] = gen_expr(param);
+
+  operand_t dst = new_temp();
+  ins_t *ins = emit_ins(IR_CALL);
+  ins->dst = dst;
+  ins->func = node->func;
+  ins->args = args;
+  ins->args_num = args_num;
+  return dst;
+}
+
+// a frame evaluates a node in several steps (see gen_expr)
+typedef struct ir_frame_t
+{
+  node_t *node;
+  int step;
+  operand_t val;  // result of short-circuit expression
+  bb_t *end;      // the block after short-circuit expression
+} ir_frame_t;
+
+DEFINE_SMALL_VEC(ir_stack, ir_frame_t, 64)
+DEFINE_SMALL_VEC(opd_stack, operand_t, 64)
+
+// generate expression, return the operand holding its value
+// numbers and variables are used as operands directly, the other values go to new temporaries
+// the tree is walked on an explicit stack, as dump_expr does,
+// an operator node is expanded into its operands in step 0, and generates its operation in step 1
+// && and || evaluate rhs in a block of its own, which is skipped when lhs decides the value
+static operand_t gen_expr(node_t *node)
+{
+  ir_stack_t stack;
+  opd_stack_t values;
+  ir_stack_init(&stack);
+  opd_stack_init(&values);
+  ir_stack_push(&stack, (ir_frame_t) { .node = node, .step = 0 });
+
+  while (!ir_stack_empty(&stack)) {
+    ir_frame_t frame = ir_stack_pop(&stack);
+    node = frame.node;
+
+    switch (node->type) {
+      case ND_NUM: opd_stack_push(&values, opd_imm(node->ival)); continue;
+      case ND_VAR: opd_stack_push(&values, opd_var(node->var)); continue;
+      case ND_FNCALL: opd_stack_push(&values, gen_call(node)); continue;
+      case ND_EXPR: break;
+      default:
+        fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    if (node->op == ND_LOGAND || node->op == ND_LOGOR) {
+      bool is_and = node->op == ND_LOGAND;
+      if (frame.step == 0) {
+        ir_stack_push(&stack, (ir_frame_t) { .node = node, .step = 1 });
+        ir_stack_push(&stack, (ir_frame_t) { .node = node->lhs, .step = 0 });
+      } else if (frame.step == 1) {
+        operand_t lhs = opd_stack_pop(&values);
+        operand_t val = new_temp();
+        bb_t *rhs_bb = new_bb();
+        bb_t *short_bb = new_bb();
+        bb_t *end = new_bb();
+        if (is_and)
+          emit_br(lhs, rhs_bb, short_bb);
+        else
+          emit_br(lhs, short_bb, rhs_bb);
+
+        start_bb(short_bb);
+        emit_op(IR_MOV, val, opd_imm(!is_and), opd_none());
+        emit_jmp(end);
+
+        start_bb(rhs_bb);
+        ir_stack_push(&stack, (ir_frame_t) { .node = node, .step = 2, .val = val, .end = end });
+        ir_stack_push(&stack, (ir_frame_t) { .node = node->rhs, .step = 0 });
+      } else {
+        operand_t rhs = opd_stack_pop(&values);
+        emit_op(IR_NE, frame.val, rhs, opd_imm(0));
+        emit_jmp(frame.end);
+        start_bb(frame.end);
+        opd_stack_push(&values, frame.val);
+      }
+      continue;
+    }
+
+    // operands are generated left to right, so lhs is pushed last
+    if (frame.step == 0) {
+      ir_stack_push(&stack, (ir_frame_t) { .node = node, .step = 1 });
+      ir_stack_push(&stack, (ir_frame_t) { .node = node->rhs, .step = 0 });
+      if (node->lhs)
+        ir_stack_push(&stack, (ir_frame_t) { .node = node->lhs, .step = 0 });
+      continue;
+    }
+
+    operand_t rhs = opd_stack_pop(&values);
+
+    // unary expression, the operand is rhs
+    if (!node->lhs) {
+      if (node->op == ND_NEG) {
+        operand_t dst = new_temp();
+        emit_op(IR_NEG, dst, rhs, opd_none());
+        rhs = dst;
+      }
+      opd_stack_push(&values, rhs);
+      continue;
+    }
+
+    operand_t lhs = opd_stack_pop(&values);
+    if (node->op < ND_ADD || node->op > ND_GE || node->op == ND_LOGAND || node->op == ND_LOGOR) {
+      fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    operand_t dst = new_temp();
+    emit_op(binary_ops[node->op], dst, lhs, rhs);
+    opd_stack_push(&values, dst);
+  }
+
+  return opd_stack_pop(&values);
+}
+
+// assign the value of expression to variable
+// the instruction computing the value writes to the variable directly if possible
+static void gen_assign(symbol_t *var, node_t *expr)
+{
+  operand_t val = gen_expr(expr);
+  ins_t *last = ins_vec_empty(&curr_ins) ? NULL : ins_vec_top(&curr_ins);
+  if (val.kind == OPD_TEMP && last && last->dst.kind == OPD_TEMP && last->dst.temp == val.temp)
+    last->dst = opd_var(var);
+  else
+    emit_op(IR_MOV, opd_var(var), val, opd_none());
+}
+
+static void gen_stmts(node_t *node);
+
+static void gen_if_stmt(node_t *node)
+{
+  operand_t cond = gen_expr(node->cond);
+  bb_t *then_bb = new_bb();
+  bb_t *end = new_bb();
+  bb_t *else_bb = node->else_stmt ? new_bb() : end;
+  emit_br(cond, then_bb, else_bb);
+
+  start_bb(then_bb);
+  gen_stmts(node->if_stmt);
+  emit_jmp(end);
+
+  if (node->else_stmt) {
+    start_bb(else_bb);
+    gen_stmts(node->else_stmt);
+    emit_jmp(end);
+  }
+
+  start_bb(end);
+}
+
+static void gen_while_stmt(node_t *node)
+{
+  bb_t *cond_bb = new_bb();
+  bb_t *body = new_bb();
+  bb_t *end = new_bb();
+  emit_jmp(cond_bb);
+
+  start_bb(cond_bb);
+  emit_br(gen_expr(node->cond), body, end);
+
+  start_bb(body);
+  gen_stmts(node->while_stmt);
+  emit_jmp(cond_bb);
+
+  start_bb(end);
+}
+
+static void gen_stmts(node_t *node)
+{
+  for (; node; node = node->next) {
+    switch (node->type) {
+      case ND_DECL_STMT:
+        node->lhs->var->index = curr_func->params.size + curr_func->locals.size;
+        var_vec_push(&curr_func->locals, node->lhs->var);
+        if (node->op == ND_ASSIGN)
+          gen_assign(node->lhs->var, node->rhs);
+        break;
+      case ND_EXPR_STMT:
+        if (node->op == ND_ASSIGN)
+          gen_assign(node->lhs->var, node->rhs);
+        else
+          gen_expr(node->rhs);
+        break;
+      case ND_IF: gen_if_stmt(node); break;
+      case ND_WHILE: gen_while_stmt(node); break;
+      case ND_RETURN: emit_ret(node->rhs ? gen_expr(node->rhs) : opd_imm(0)); break;
+      default:
+        fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
+        exit(1);
+    }
+  }
+}
+
+// link the blocks by their terminators, and remove the blocks unreachable from the entry
+static void build_cfg(ir_func_t *func)
+{
+  bb_vec_t work;
+  bb_vec_init(&work);
+  bool *reached = arena_calloc(curr_arena, func->blocks.size, sizeof(bool));
+
+  for (size_t i = 0; i < func->blocks.size; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    ins_t *last = ins_vec_top(&bb->ins);
+    bb->succ_num = 0;
+    if (last->op == IR_JMP || last->op == IR_BR)
+      bb->succ[bb->succ_num++] = last->target;
+    if (last->op == IR_BR)
+      bb->succ[bb->succ_num++] = last->else_target;
+  }
+
+  bb_vec_push(&work, *bb_vec_at(&func->blocks, 0));
+  reached[0] = true;
+  while (!bb_vec_empty(&work)) {
+    bb_t *bb = bb_vec_pop(&work);
+    for (uint32_t i = 0; i < bb->succ_num; i++) {
+      if (!reached[bb->succ[i]->id]) {
+        reached[bb->succ[i]->id] = true;
+        bb_vec_push(&work, bb->succ[i]);
+      }
+    }
+  }
+
+  size_t num = 0;
+  for (size_t i = 0; i < func->blocks.size; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    if (reached[i]) {
+      bb->id = num;
+      *bb_vec_at(&func->blocks, num++) = bb;
+    }
+  }
+  func->blocks.size = num;
+
+  for (size_t i = 0; i < num; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    for (uint32_t j = 0; j < bb->succ_num; j++)
+      bb_vec_push(&bb->succ[j]->preds, bb);
+  }
+}
+
+static ir_func_t *gen_func(node_t *node)
+{
+  curr_func = arena_calloc(curr_arena, 1, sizeof(ir_func_t));
+  curr_func->func = node->func;
+  var_vec_init(&curr_func->params);
+  var_vec_init(&curr_func->locals);
+  bb_vec_init(&curr_func->blocks);
+  for (node_t *param = node->params; param; param = param->next) {
+    param->var->index = curr_func->params.size;
+    var_vec_push(&curr_func->params, param->var);
+  }
+
+  curr_bb = NULL;
+  start_bb(new_bb());
+  gen_stmts(node->body);
+
+  // falling off the end of function returns 0
+  if (!is_terminated())
+    emit_ret(opd_imm(0));
+  seal_bb();
+
+  build_cfg(curr_func);
+  return curr_func;
+}
+
+// translate the ast of program into ir, return the list of functions
+ir_func_t *gen_ir(node_t *tree)
+{
+  ir_func_t head = { .next = NULL };
+  ir_func_t *curr = &head;
+  ins_vec_init(&curr_ins);
+  for (node_t *func = tree->body; func; func = func->next) {
+    curr->next = gen_func(func);
+    curr = curr->next;
+  }
+  return head.next;
+}
+
+/* verify ir */
+
+static ir_func_t *verified_func;
+
+static noreturn void ir_error(bb_t *bb, char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static noreturn void ir_error(bb_t *bb, char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "invalid ir in function %s at bb%u: ", verified_func->func->name, bb->id);
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+  exit(1);
+}
+
+static bool is_block_of(ir_func_t *func, bb_t *bb)
+{
+  return bb && bb->id < func->blocks.size && *bb_vec_at(&func->blocks, bb->id) == bb;
+}
+
+static void verify_operand(bb_t *bb, operand_t opd, bool *used)
+{
+  switch (opd.kind) {
+    case OPD_NONE:
+      ir_error(bb, "missing operand");
+    case OPD_TEMP:
+      if (opd.temp >= verified_func->temps_num)
+        ir_error(bb, "temporary t%u out of range", opd.temp);
+      used[opd.temp] = true;
+      break;
+    case OPD_VAR:
+      if (!opd.var)
+        ir_error(bb, "variable operand without symbol");
+      break;
+    case OPD_IMM:
+      break;
+  }
+}
+
+static void verify_dst(bb_t *bb, operand_t opd, bool *defined)
+{
+  if (opd.kind == OPD_TEMP && opd.temp < verified_func->temps_num)
+    defined[opd.temp] = true;
+  else if (opd.kind != OPD_VAR || !opd.var)
+    ir_error(bb, "destination is not a temporary or variable");
+}
+
+static void verify_func(ir_func_t *func)
+{
+  verified_func = func;
+  bool *used = arena_calloc(curr_arena, func->temps_num + 1, sizeof(bool));
+  bool *defined = arena_calloc(curr_arena, func->temps_num + 1, sizeof(bool));
+
+  if (bb_vec_empty(&func->blocks)) {
+    fprintf(stderr, "invalid ir in function %s: no blocks\n", func->func->name);
+    exit(1);
+  }
+
+  for (size_t i = 0; i < func->blocks.size; i++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, i);
+    if (bb->id != i)
+      ir_error(bb, "block is numbered %zu in layout", i);
+    if (ins_vec_empty(&bb->ins))
+      ir_error(bb, "empty block");
+
+    for (size_t j = 0; j < bb->ins.size; j++) {
+      ins_t *ins = ins_vec_at(&bb->ins, j);
+      if (ins->op >= IR_OP_NUM)
+        ir_error(bb, "unknown operator %d", ins->op);
+      if (ir_is_terminator(ins->op) != (j == bb->ins.size - 1))
+        ir_error(bb, "terminator is not the last instruction");
+
+      switch (ins->op) {
+        case IR_MOV:
+        case IR_NEG:
+          verify_operand(bb, ins->a, used);
+          verify_dst(bb, ins->dst, defined);
+          break;
+        case IR_CALL:
+          if (ins->args_num != ins->func->func_type->params_num)
+            ir_error(bb, "call of %s with %u arguments, expected %zu",
+                     ins->func->name, ins->args_num, ins->func->func_type->params_num);
+          for (uint32_t k = 0; k < ins->args_num; k++)
+            verify_operand(bb, ins->args[k], used);
+          verify_dst(bb, ins->dst, defined);
+          break;
+        case IR_JMP:
+          if (!is_block_of(func, ins->target))
+            ir_error(bb, "jump to a block out of function");
+          break;
+        case IR_BR:
+          verify_operand(bb, ins->a, used);
+          if (!is_block_of(func, ins->target) || !is_block_of(func, ins->else_target))
+            ir_error(bb, "branch to a block out of function");
+          break;
+        case IR_RET:
+          verify_operand(bb, ins->a, used);
+          break;
+        default:
+          verify_operand(bb, ins->a, used);
+          verify_operand(bb, ins->b, used);
+          verify_dst(bb, ins->dst, defined);
+          break;
+      }
+    }
+
+    // successors follow the terminator, and each successor lists this block as a predecessor
+    ins_t *last = ins_vec_top(&bb->ins);
+    uint32_t succ_num = last->op == IR_JMP ? 1 : last->op == IR_BR ? 2 : 0;
+    if (bb->succ_num != succ_num ||
+        (succ_num > 0 && bb->succ[0] != last->target) ||
+        (succ_num > 1 && bb->succ[1] != last->else_target))
+      ir_error(bb, "successors do not match the terminator");
+    for (uint32_t k = 0; k < bb->succ_num; k++) {
+      bool found = false;
+      for (size_t p = 0; p < bb->succ[k]->preds.size; p++)
+        found = found || *bb_vec_at(&bb->succ[k]->preds, p) == bb;
+      if (!found)
+        ir_error(bb, "missing from the predecessors of bb%u", bb->succ[k]->id);
+    }
+    for (size_t p = 0; p < bb->preds.size; p++) {
+      bb_t *pred = *bb_vec_at(&bb->preds, p);
+      if (!is_block_of(func, pred) || (pred->succ[0] != bb && pred->succ[1] != bb))
+        ir_error(bb, "predecessor does not branch to the block");
+    }
+  }
+
+  for (uint32_t t = 0; t < func->temps_num; t++) {
+    if (used[t] && !defined[t])
+      ir_error(*bb_vec_at(&func->blocks, 0), "t%u is used but never defined", t);
+  }
+}
+
+// check the invariants of ir, exit with a message if they are broken
+void verify_ir(ir_func_t *prog)
+{
+  for (ir_func_t *func = prog; func; func = func->next)
+    verify_func(func);
+}
+
+/* dump ir */
+
+static char *op_names[] = {
+  [IR_ADD] = "+",
+  [IR_SUB] = "-",
+  [IR_MUL] = "*",
+  [IR_DIV] = "/",
+  [IR_EQ]  = "==",
+  [IR_NE]  = "!=",
+  [IR_LT]  = "<",
+  [IR_LE]  = "<=",
+  [IR_GT]  = ">",
+  [IR_GE]  = ">=",
+};
+
+static void dump_operand(operand_t opd, FILE *fp)
+{
+  switch (opd.kind) {
+    case OPD_NONE: fprintf(fp, "_"); break;
+    case OPD_TEMP: fprintf(fp, "t%u", opd.temp); break;
+    case OPD_VAR: fprintf(fp, "%s", opd.var->name); break;
+    case OPD_IMM: fprintf(fp, "%ld", opd.imm); break;
+  }
+}
+
+static void dump_ins(ins_t *ins, FILE *fp)
+{
+  fprintf(fp, "  ");
+  if (!ir_is_terminator(ins->op)) {
+    dump_operand(ins->dst, fp);
+    fprintf(fp, " = ");
+  }
+
+  switch (ins->op) {
+    case IR_MOV:
+      dump_operand(ins->a, fp);
+      break;
+    case IR_NEG:
+      fprintf(fp, "-");
+      dump_operand(ins->a, fp);
+      break;
+    case IR_CALL:
+      fprintf(fp, "call %s(", ins->func->name);
+      for (uint32_t i = 0; i < ins->args_num; i++) {
+        dump_operand(ins->args[i], fp);
+        fprintf(fp, i + 1 < ins->args_num ? ", " : "");
+      }
+      fprintf(fp, ")");
+      break;
+    case IR_JMP:
+      fprintf(fp, "jmp bb%u", ins->target->id);
+      break;
+    case IR_BR:
+      fprintf(fp, "br ");
+      dump_operand(ins->a, fp);
+      fprintf(fp, ", bb%u, bb%u", ins->target->id, ins->else_target->id);
+      break;
+    case IR_RET:
+      fprintf(fp, "ret ");
+      dump_operand(ins->a, fp);
+      break;
+    default:
+      dump_operand(ins->a, fp);
+      fprintf(fp, " %s ", op_names[ins->op]);
+      dump_operand(ins->b, fp);
+      break;
+  }
+  fprintf(fp, "\n");
+}
+
+// dump ir in text, e.g.
+// func add(a, b) => int
+// bb0:
+//   t0 = a + b
+//   ret t0
+void dump_ir(ir_func_t *prog, FILE *fp)
+{
+  for (ir_func_t *func = prog; func; func = func->next) {
+    fprintf(fp, "func %s(", func->func->name);
+    for (size_t i = 0; i < func->params.size; i++)
+      fprintf(fp, "%s%s", (*var_vec_at(&func->params, i))->name, i + 1 < func->params.size ? ", " : "");
+    fprintf(fp, ") => %s\n", func->func->return_type->name);
+
+    for (size_t i = 0; i < func->blocks.size; i++) {
+      bb_t *bb = *bb_vec_at(&func->blocks, i);
+      fprintf(fp, "bb%u:", bb->id);
+      if (bb->preds.size) {
+        fprintf(fp, "  ; preds");
+        for (size_t p = 0; p < bb->preds.size; p++)
+          fprintf(fp, " bb%u", (*bb_vec_at(&bb->preds, p))->id);
+      }
+      fprintf(fp, "\n");
+      for (size_t j = 0; j < bb->ins.size; j++)
+        dump_ins(ins_vec_at(&bb->ins, j), fp);
+    }
+
+    if (func->next)
+      fprintf(fp, "\n");
+  }
+}
@@ -0,0 +1,118 @@
+#define _DEFAULT_SOURCE
+#include "obj.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// in-process execution of programs (--run)
+//
+// the sections of object are copied into pages mapped from the system, relocated there,
+// and main is called directly, the code pages are made executable (and no longer writable) first
+// the symbols the object does not define are the runtime, which is the libc of kat itself,
+// they are called through stubs after the code, since libc may be farther than a rel32 reaches
+
+// functions a kat program calls without defining them
+static struct {
+  char *name;
+  void *addr;
+} host_syms[] = {
+  { "printf", (void *) printf },
+};
+
+// jmp *0(%rip), followed by the address it jumps to
+#define STUB_SIZE 16
+
+static size_t align_to(size_t size, size_t align)
+{
+  return (size + align - 1) / align * align;
+}
+
+static void *host_sym(char *name)
+{
+  for (size_t i = 0; i < sizeof(host_syms) / sizeof(host_syms[0]); i++) {
+    if (!strcmp(host_syms[i].name, name))
+      return host_syms[i].addr;
+  }
+  fprintf(stderr, "undefined reference to \"%s\"\n", name);
+  exit(1);
+}
+
+// run the program in object, passing args to main, return what main returns
+int jit_run(obj_t *obj, int32_t *args, int args_num)
+{
+  if (obj->target != TARGET_X86_64) {
+    fprintf(stderr, "only x86_64 code runs in process\n");
+    exit(1);
+  }
+  if (args_num > 6) {
+    fprintf(stderr, "main takes at most 6 arguments when it is run in process\n");
+    exit(1);
+  }
+
+  size_t stubs_num = 0;
+  for (size_t i = 0; i < obj->syms.size; i++)
+    stubs_num += !obj_sym_vec_at(&obj->syms, i)->is_defined;
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t stubs_offset = align_to(obj->sections[SECTION_TEXT].size, 16);
+  size_t code_size = align_to(stubs_offset + stubs_num * STUB_SIZE, page);
+  size_t size = code_size + align_to(obj->sections[SECTION_DATA].size, page);
+  uint8_t *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "cannot map memory for the program\n");
+    exit(1);
+  }
+
+  uint8_t *bases[SECTION_NUM] = { [SECTION_TEXT] = mem, [SECTION_DATA] = mem + code_size };
+  for (SECTION section = 0; section < SECTION_NUM; section++)
+    memcpy(bases[section], obj->sections[section].data, obj->sections[section].size);
+
+  // the addresses of symbols, an undefined one is its stub
+  uint8_t **addrs = arena_alloc(curr_arena, sizeof(uint8_t *) * (obj->syms.size + 1));
+  uint8_t *stub = mem + stubs_offset;
+  for (size_t i = 0; i < obj->syms.size; i++) {
+    obj_sym_t *sym = obj_sym_vec_at(&obj->syms, i);
+    if (sym->is_defined) {
+      addrs[i] = bases[sym->section] + sym->offset;
+      continue;
+    }
+    void *target_addr = host_sym(sym->name);
+    memcpy(stub, (uint8_t[]) { 0xff, 0x25, 0, 0, 0, 0 }, 6);
+    memcpy(stub + 6, &target_addr, sizeof(void *));
+    addrs[i] = stub;
+    stub += STUB_SIZE;
+  }
+
+  for (size_t i = 0; i < obj->relocs.size; i++) {
+    reloc_t *reloc = reloc_vec_at(&obj->relocs, i);
+    uint8_t *field = bases[reloc->section] + reloc->offset;
+    apply_reloc(field, reloc, (uint64_t) addrs[reloc->sym], (uint64_t) field);
+  }
+
+  if (mprotect(mem, code_size, PROT_READ | PROT_EXEC)) {
+    fprintf(stderr, "cannot make the program executable\n");
+    exit(1);
+  }
+
+  entry_t *entry = hashmap_get_cstr(obj->sym_index, "main");
+  obj_sym_t *main_sym = entry ? obj_sym_vec_at(&obj->syms, (uintptr_t) entry->val - 1) : NULL;
+  if (!main_sym || !main_sym->is_defined) {
+    fprintf(stderr, "undefined reference to \"main\"\n");
+    exit(1);
+  }
+
+  // the extra arguments are ignored by main, as they are passed in registers
+  int32_t argv[6] = { 0 };
+  memcpy(argv, args, sizeof(int32_t) * args_num);
+  int (*main_fn)(int32_t, int32_t, int32_t, int32_t, int32_t, int32_t);
+  uint8_t *main_addr = addrs[(uintptr_t) entry->val - 1];
+  memcpy(&main_fn, &main_addr, sizeof(main_fn));
+  int status = main_fn(argv[0], argv[1], argv[2], argv[3], argv[4], argv[5]);
+
+  fflush(stdout);
+  munmap(mem, size);
+  return status;
+}
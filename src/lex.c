@@ -1,166 +1,463 @@
 #include "lex.h"
+#include "scan.h"
+#include "arena.h"
+#include "vec.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdnoreturn.h>
 
-static bool start_with(char *p, const char *prefix)
+// keywords are recognized by a perfect hash of (first character, last character, length),
+// which is unique for each keyword, so one probe and one memcmp decide a lexeme
+// the table is laid out by the compiler, and a collision shows up as an overridden
+// initializer (-Woverride-init), the characters are spelled out in KW because
+// elements of string literals are not constant expressions
+
+#define KW_HASH(first, last, len) ((6 * (first) + 11 * (last) + (len)) & 31)
+#define KW(first, last, name, type) [KW_HASH(first, last, sizeof(name) - 1)] = { name, sizeof(name) - 1, type }
+
+static const struct {
+  const char *name;
+  size_t len;
+  TK_TYPE type;
+} keywords[32] = {
+  KW('i', 'f', "if", TK_KW_IF),
+  KW('e', 'e', "else", TK_KW_ELSE),
+  KW('e', 'f', "elif", TK_KW_ELIF),
+  KW('w', 'e', "while", TK_KW_WHILE),
+  KW('b', 'k', "break", TK_KW_BREAK),
+  KW('c', 'e', "continue", TK_KW_CONTINUE),
+  KW('f', 'c', "func", TK_KW_FUNC),
+  KW('r', 'n', "return", TK_KW_RETURN),
+  KW('l', 't', "let", TK_KW_LET),
+  KW('i', 't', "int", TK_KW_INT),
+  KW('f', 't', "float", TK_KW_FLOAT),
+  KW('c', 'r', "char", TK_KW_CHAR),
+  KW('s', 'r', "str", TK_KW_STR),
+  KW('b', 'l', "bool", TK_KW_BOOL),
+  KW('t', 'e', "true", TK_KW_TRUE),
+  KW('f', 'e', "false", TK_KW_FALSE),
+};
+
+// return the keyword type of the identifier, or TK_ID if it is not a keyword
+static TK_TYPE keyword_type(char *p, size_t len)
 {
-  return strncmp(p, prefix, strlen(prefix)) == 0;
+  unsigned hash = KW_HASH((unsigned char) p[0], (unsigned char) p[len - 1], len);
+  if (keywords[hash].len == len && !memcmp(keywords[hash].name, p, len))
+    return keywords[hash].type;
+  return TK_ID;
 }
 
-static bool iskeyword(token_t *token)
+// return the punctuator type at p and set its length
+// use longest match policy
+static TK_TYPE punct_type(char *p, size_t *len)
 {
-  static char *keywords[] = {
-    "if", "else", "elif", "while", "break", "continue",
-    "func", "return", "let",
-    "int", "float", "char", "str", "bool", "true", "false"
-  };
+  *len = 2;
+  switch (p[0]) {
+    case '+': if (p[1] == '=') return TK_ADD_ASSIGN; break;
+    case '-': if (p[1] == '=') return TK_SUB_ASSIGN; break;
+    case '*': if (p[1] == '=') return TK_MUL_ASSIGN; break;
+    case '/': if (p[1] == '=') return TK_DIV_ASSIGN; break;
+    case '>': if (p[1] == '=') return TK_GE; break;
+    case '<': if (p[1] == '=') return TK_LE; break;
+    case '!': if (p[1] == '=') return TK_NE; break;
+    case '&': if (p[1] == '&') return TK_LOGAND; break;
+    case '|': if (p[1] == '|') return TK_LOGOR; break;
+    case '=':
+      if (p[1] == '=') return TK_EQ;
+      if (p[1] == '>') return TK_ARROW;
+      break;
+  }
 
-  for (unsigned i = 0; i < sizeof(keywords) / sizeof(*keywords); i++) {
-    if ((strlen(keywords[i]) == token->len) &&
-        !strncmp(token->begin, keywords[i], token->len))
-      return true;
+  *len = 1;
+  switch (p[0]) {
+    case '(': return TK_LPAREN;
+    case ')': return TK_RPAREN;
+    case '{': return TK_LBRACE;
+    case '}': return TK_RBRACE;
+    case '[': return TK_LBRACKET;
+    case ']': return TK_RBRACKET;
+    case ',': return TK_COMMA;
+    case ';': return TK_SEMI;
+    case ':': return TK_COLON;
+    case '.': return TK_DOT;
+    case '=': return TK_ASSIGN;
+    case '+': return TK_PLUS;
+    case '-': return TK_MINUS;
+    case '*': return TK_STAR;
+    case '/': return TK_SLASH;
+    case '%': return TK_PERCENT;
+    case '!': return TK_NOT;
+    case '&': return TK_AMP;
+    case '|': return TK_PIPE;
+    case '<': return TK_LT;
+    case '>': return TK_GT;
+    default: return TK_PUNCT;
   }
-  return false;
 }
 
-static size_t islpunct(char *p)
+bool is_kw_type(TK_TYPE type)
 {
-  static char *long_puncts[] = {
-    "+=", "-=", "*=", "/=",
-    ">=", "<=", "==", "!=", "&&", "||",
-    "=>"
-  };
-  for (unsigned i = 0; i < sizeof(long_puncts) / sizeof(*long_puncts); i++) {
-    if (start_with(p, long_puncts[i]))
-      return strlen(long_puncts[i]);
-  }
-  return 0;
+  return type >= TK_KW_IF && type <= TK_KW_FALSE;
 }
 
-static token_t *make_token(TK_TYPE token_type, char *token_begin, char *token_end, size_t line)
+bool is_punct_type(TK_TYPE type)
+{
+  return type >= TK_LPAREN && type <= TK_PUNCT;
+}
+
+// the source buffer being lexed
+static char *source;
+static size_t source_len;
+
+// token array, grows geometrically
+static token_t *tokens;
+static size_t tokens_size;
+static size_t tokens_capacity;
+
+// literal table, indexed by token_t::lit
+static literal_t *literals;
+static size_t literals_size;
+static size_t literals_capacity;
+
+// offsets of the beginning of each line
+// built on demand, since line numbers are only needed by diagnostics and dumps
+static uint32_t *line_starts;
+static size_t lines_num;
+
+DEFINE_VEC(index_vec, uint32_t)
+
+// indices of the opening brackets not matched yet
+static index_vec_t brackets;
+
+static token_t *make_token(TK_TYPE token_type, char *token_begin, char *token_end)
 {
-  token_t *token = calloc(1, sizeof(token_t));
+  if (tokens_size == tokens_capacity) {
+    tokens = arena_realloc(curr_arena, tokens, sizeof(token_t) * tokens_capacity, sizeof(token_t) * tokens_capacity * 2);
+    tokens_capacity *= 2;
+  }
+  token_t *token = tokens + tokens_size++;
   token->type = token_type;
-  token->begin = token_begin;
+  token->offset = token_begin - source;
   token->len = token_end - token_begin;
-  token->line = line;
-  token->ival = 0;
-  token->cval = '\0';
-  token->sval = NULL;
-  token->next = NULL;
+  token->lit = 0;
   return token;
 }
 
-static void convert_number(token_t *token)
+// allocate a zeroed literal value for the token
+static literal_t *make_literal(token_t *token)
 {
-  char *dot = strchr(token->begin, '.');
-  if (!dot) { // there is no dot, integer
-    token->ival = strtoll(token->begin, NULL, 10);
-  } else {  // there is dot, float
-    char *end = NULL;
-    token->fval = strtold(token->begin, &end);
-    if (token->begin + token->len != end) {
-      // TODO: improve error message
-      fprintf(stderr, "invalid numeric value at line %ld\n", token->line);
-      exit(1);
+  if (literals_size == literals_capacity) {
+    literals = arena_realloc(curr_arena, literals, sizeof(literal_t) * literals_capacity, sizeof(literal_t) * literals_capacity * 2);
+    literals_capacity *= 2;
+  }
+  token->lit = literals_size;
+  literal_t *literal = literals + literals_size++;
+  memset(literal, 0, sizeof(literal_t));
+  return literal;
+}
+
+// match brackets while lexing, so that the parser finds the closing bracket in O(1)
+// an opening bracket left unmatched is matched with the EOF token (see lex),
+// and a stray closing bracket is matched with itself
+static void match_bracket(token_t *token)
+{
+  uint32_t index = token - tokens;
+  switch (token->type) {
+    case TK_LPAREN:
+    case TK_LBRACE:
+    case TK_LBRACKET:
+      index_vec_push(&brackets, index);
+      break;
+    case TK_RPAREN:
+    case TK_RBRACE:
+    case TK_RBRACKET: {
+      // each closing bracket follows its opening bracket in TK_TYPE
+      token_t *open = index_vec_empty(&brackets) ? NULL : tokens + *index_vec_top(&brackets);
+      if (open && open->type + 1 == token->type) {
+        open->match = index;
+        token->match = index_vec_pop(&brackets);
+      } else {
+        token->match = index;
+      }
+      break;
     }
+    default:
+      break;
   }
 }
 
-// return the c-style string of the given token
-char *tok2cstr(token_t *token)
+static void build_line_table()
 {
-  char *name = malloc(sizeof(char) * (token->len + 1));
-  memcpy(name, token->begin, sizeof(char) * token->len);
-  name[token->len] = '\0';
-  return name;
+  size_t capacity = 64;
+  line_starts = arena_alloc(curr_arena, sizeof(uint32_t) * capacity);
+  line_starts[0] = 0;
+  lines_num = 1;
+
+  char *p = source;
+  char *end = source + source_len;
+  while ((p = memchr(p, '\n', end - p)) != NULL) {
+    p++;
+    if (lines_num == capacity) {
+      line_starts = arena_realloc(curr_arena, line_starts, sizeof(uint32_t) * capacity, sizeof(uint32_t) * capacity * 2);
+      capacity *= 2;
+    }
+    line_starts[lines_num++] = p - source;
+  }
 }
 
-token_t * lex(char *buf)
+// line number of the given offset in source buffer
+static size_t line_of(uint32_t offset)
 {
-  token_t head = {};
-  token_t *curr = &head;
+  if (!line_starts)
+    build_line_table();
 
-  char *p = buf;
-  size_t line = 1;
+  // binary search the last line which begins before offset
+  size_t lo = 0, hi = lines_num;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (line_starts[mid] <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo + 1;
+}
+
+char *tok_begin(token_t *token)
+{
+  return source + token->offset;
+}
+
+size_t tok_line(token_t *token)
+{
+  return line_of(token->offset);
+}
+
+literal_t *tok_literal(token_t *token)
+{
+  return literals + token->lit;
+}
+
+atom_t *tok_atom(token_t *token)
+{
+  return atom_of(token->atom);
+}
 
-  while (*p != '\0') {
-    // skip whitespaces
-    if (*p == ' ' || *p == '\t' || *p == '\f' || *p == '\r') {
+// the matching bracket of a bracket token
+token_t *tok_match(token_t *token)
+{
+  return tokens + token->match;
+}
+
+static noreturn void lex_error(char *p, char *msg)
+{
+  fprintf(stderr, "%s at line %ld\n", msg, line_of(p - source));
+  exit(1);
+}
+
+// read number literal
+// number = {digit}- ["." {digit}-] ;
+// signs are unary operators, they are not part of the literal
+// the value is converted while scanning, integers are accumulated digit by digit,
+// floats are handed to strtold with a copy bounded by the lexeme
+static char *read_number(char *p)
+{
+  char *q = p;
+  uint64_t ival = 0;
+  bool overflow = false;
+  while (isdigit(*p)) {
+    unsigned digit = *p++ - '0';
+    if (ival > (UINT64_MAX - digit) / 10)
+      overflow = true;
+    ival = ival * 10 + digit;
+  }
+
+  bool is_float = false;
+  if (*p == '.') {
+    is_float = true;
+    p++;
+    if (!isdigit(*p))
+      lex_error(q, "invalid numeric value");
+    while (isdigit(*p))
       p++;
-      continue;
-    }
+    if (*p == '.')
+      lex_error(q, "invalid numeric value");
+  }
 
-    // skip newline
-    if (*p == '\n') {
-      line++;
+  token_t *token = make_token(TK_NUM, q, p);
+  literal_t *literal = make_literal(token);
+  if (is_float) {
+    char buf[64];
+    char *copy = token->len < sizeof(buf) ? buf : malloc(token->len + 1);
+    memcpy(copy, q, token->len);
+    copy[token->len] = '\0';
+    literal->fval = strtold(copy, NULL);
+    if (copy != buf)
+      free(copy);
+  } else {
+    if (overflow || ival > INT64_MAX)
+      lex_error(q, "integer literal is too large");
+    literal->ival = ival;
+  }
+  return p;
+}
+
+// read escape sequence starting with backslash
+// return the escaped character and move p past the sequence
+static char read_escape(char **p)
+{
+  char *q = *p;
+  char c;
+  switch (q[1]) {
+    case 'n':  c = '\n'; break;
+    case 't':  c = '\t'; break;
+    case 'r':  c = '\r'; break;
+    case '0':  c = '\0'; break;
+    case '\\': c = '\\'; break;
+    case '\'': c = '\''; break;
+    case '"':  c = '"'; break;
+    default:
+      lex_error(q, "invalid escape sequence");
+  }
+  *p = q + 2;
+  return c;
+}
+
+// read character literal
+// character = "'" (char | escape) "'" ;
+static char *read_char(char *p)
+{
+  char *q = p++;
+  if (*p == '\'')
+    lex_error(q, "empty character literal");
+  if (*p == '\n' || *p == '\0')
+    lex_error(q, "unclosed character literal");
+
+  char c = (*p == '\\') ? read_escape(&p) : *p++;
+
+  if (*p != '\'') {
+    // tell whether the literal is closed later on the same line
+    while (*p != '\'' && *p != '\n' && *p != '\0')
       p++;
+    lex_error(q, *p == '\'' ? "too many characters" : "unclosed character literal");
+  }
+  p++;
+
+  token_t *token = make_token(TK_CHR, q, p);
+  make_literal(token)->cval = c;
+  return p;
+}
+
+// read string literal
+// string = '"' {char | escape} '"' ;
+// the string is decoded into a scratch buffer while scanning,
+// then copied out once its length is known
+static char *read_string(char *p)
+{
+  static char *scratch = NULL;
+  static size_t scratch_capacity = 0;
+
+  char *q = p++;
+  size_t length = 0;
+  while (true) {
+    // copy the run of plain characters, then handle the character stopping it
+    char *stop = find_quote(p, '"');
+    size_t run = stop - p;
+    if (scratch_capacity < length + run + 1) {
+      scratch_capacity = (length + run + 1) * 2;
+      scratch = realloc(scratch, scratch_capacity);
+    }
+    memcpy(scratch + length, p, run);
+    length += run;
+    p = stop;
+
+    if (*p == '"')
+      break;
+    if (*p == '\n' || *p == '\0')
+      lex_error(q, "unclosed string literal");
+    scratch[length++] = read_escape(&p);
+  }
+  p++;
+
+  token_t *token = make_token(TK_STR, q, p);
+  make_literal(token)->sval = arena_strndup(curr_arena, scratch, length);
+  return p;
+}
+
+// lex the source buffer of len bytes
+// the buffer must be followed by a '\0' sentinel (see source.h),
+// which stops the inner scanning loops at the end of buffer
+// tokens, literals and atoms are allocated from the arena of current compilation,
+// and live as long as it
+token_t *lex(char *buf, size_t len)
+{
+  if (len > UINT32_MAX) {
+    fprintf(stderr, "source file is too large\n");
+    exit(1);
+  }
+
+  source = buf;
+  source_len = len;
+
+  // most tokens are at least a few bytes apart, start with a rough estimate
+  tokens_size = 0;
+  tokens_capacity = len / 4 + 16;
+  tokens = arena_alloc(curr_arena, sizeof(token_t) * tokens_capacity);
+
+  literals_size = 0;
+  literals_capacity = 64;
+  literals = arena_alloc(curr_arena, sizeof(literal_t) * literals_capacity);
+
+  line_starts = NULL;
+  lines_num = 0;
+
+  index_vec_init(&brackets);
+
+  intern_reset();
+
+  char *p = buf;
+  char *end = buf + len;
+
+  while (p < end) {
+    // skip whitespaces and newlines
+    if (*p == ' ' || *p == '\t' || *p == '\f' || *p == '\r' || *p == '\n') {
+      p = skip_space(p + 1);
       continue;
     }
 
-    // TODO: skip comments
-    // if (start_with(p, "//") || start_with(p, "/*"))
-    // {
+    // skip line comments
+    if (p[0] == '/' && p[1] == '/') {
+      p = find_newline(p + 2);
+      continue;
+    }
 
-    // }
+    // skip block comments
+    if (p[0] == '/' && p[1] == '*') {
+      char *q = find_comment_end(p + 2);
+      if (*q == '\0')
+        lex_error(p, "unclosed comment");
+      p = q + 2;
+      continue;
+    }
 
     // read numbers
-    // number = ["+" | "-"] {digit}- ["." {digit}-]
-    if (isdigit(*p) || ((*p == '+' || *p == '-') && isdigit(*(p + 1)))) {
-      char *q = p++;
-      while (isdigit(*p) || *p == '.')
-        p++;
-      token_t *token = make_token(TK_NUM, q, p, line);
-      curr->next = token;
-      curr = curr->next;
-      convert_number(token);
+    if (isdigit(*p)) {
+      p = read_number(p);
       continue;
     }
 
     // read characters
-    // TODO: escape character support
     if (*p == '\'') {
-      char *q = p++;
-      char *quote = strchr(p, '\'');
-      if (!quote) {
-        // TODO: improve error message
-        fprintf(stderr, "unclosed character literal at line %ld\n", line);
-        exit(1);
-      } else if (quote - p > 1) {
-        fprintf(stderr, "too many characters at line %ld\n", line);
-        exit(1);
-      } else {
-        token_t *token = make_token(TK_CHR, q, quote + 1, line);
-        token->cval = *p;
-        curr->next = token;
-        curr = curr->next;
-        p = quote + 1;
-      }
+      p = read_char(p);
       continue;
     }
 
     // read strings
-    // TODO: escape character support
     if (*p == '"') {
-      char *q = p++;
-      char *quote = strchr(p, '"');
-      if (!quote) {
-        // TODO: improve error message
-        fprintf(stderr, "unclosed string literal at line %ld\n", line);
-        exit(1);
-      } else {
-        token_t *token = make_token(TK_STR, q, quote + 1, line);
-        size_t length = quote - p;
-        token->sval = malloc(sizeof(char) * (length + 1));
-        strncpy(token->sval, p, length);
-        token->sval[length] = '\0';
-        curr->next = token;
-        curr = curr->next;
-        p = quote + 1;
-      }
+      p = read_string(p);
       continue;
     }
 
@@ -168,82 +465,86 @@ token_t * lex(char *buf)
     // identifier = (letter | underscore) , {letter | underscore | digit}
     // first to check if it is a valid identifier, then match it with keywords
     if (isalpha(*p) || *p == '_') {
-      char *q = p++;
-      while (isalnum(*p) || *p == '_')
-        p++;
-      token_t *token = make_token(TK_ID, q, p, line);
-      if (iskeyword(token))
-        token->type = TK_KW;
-      curr->next = token;
-      curr = curr->next;
+      char *q = p;
+      p = skip_ident(p + 1);
+      TK_TYPE type = keyword_type(q, p - q);
+      token_t *token = make_token(type, q, p);
+      if (type == TK_ID)
+        token->atom = intern(q, p - q)->id;
       continue;
     }
 
     // read operators and punctuators
-    // use longest match policy
     if (ispunct(*p)) {
-      size_t len = islpunct(p);
-      len = (len == 0) ? 1 : len;
-      token_t *token = make_token(TK_PUNCT, p, p + len, line);
-      curr->next = token;
-      curr = curr->next;
+      size_t len;
+      TK_TYPE type = punct_type(p, &len);
+      token_t *token = make_token(type, p, p + len);
+      if (type >= TK_LPAREN && type <= TK_RBRACKET)
+        match_bracket(token);
       p += len;
       continue;
     }
 
-    fprintf(stderr, "invalid character %c for lexer at line %ld\n", *p, line);
+    fprintf(stderr, "invalid character %c for lexer at line %ld\n", *p, line_of(p - source));
     exit(1);
   }
 
   // EOF token
-  curr->next = calloc(1, sizeof(token_t));
-  curr->next->type = TK_EOF;
-  curr->next->next = NULL;
+  token_t *eof = make_token(TK_EOF, end, end);
+  while (!index_vec_empty(&brackets))
+    tokens[index_vec_pop(&brackets)].match = eof - tokens;
+
+  // give back the unused part of the estimate
+  tokens = arena_realloc(curr_arena, tokens, sizeof(token_t) * tokens_capacity, sizeof(token_t) * tokens_size);
+  tokens_capacity = tokens_size;
 
-  return head.next;
+  return tokens;
 }
 
 void dump_token_list(token_t *tokens)
 {
   fprintf(stdout, "token list dump:\n");
-  while (tokens) {
-    switch (tokens->type) {
-      case TK_KW:
-        fprintf(stdout, "{<keyword>: ");
-        fwrite(tokens->begin, sizeof(char), tokens->len, stdout);
-        fprintf(stdout, " at line %ld}\n", tokens->line);
-        break;
+  for (token_t *token = tokens; ; token++) {
+    if (is_kw_type(token->type)) {
+      fprintf(stdout, "{<keyword>: ");
+      fwrite(tok_begin(token), sizeof(char), token->len, stdout);
+      fprintf(stdout, " at line %ld}\n", tok_line(token));
+      continue;
+    }
+
+    if (is_punct_type(token->type)) {
+      fprintf(stdout, "{<punctuator>: ");
+      fwrite(tok_begin(token), sizeof(char), token->len, stdout);
+      fprintf(stdout, " at line %ld}\n", tok_line(token));
+      continue;
+    }
+
+    switch (token->type) {
       case TK_ID:
         fprintf(stdout, "{<identifier>: ");
-        fwrite(tokens->begin, sizeof(char), tokens->len, stdout);
-        fprintf(stdout, " at line %ld}\n", tokens->line);
+        fwrite(tok_begin(token), sizeof(char), token->len, stdout);
+        fprintf(stdout, " at line %ld}\n", tok_line(token));
         break;
       case TK_NUM:
         fprintf(stdout, "{<number>: ");
-        fwrite(tokens->begin, sizeof(char), tokens->len, stdout);
-        fprintf(stdout, " at line %ld, ival = %ld, fval = %Lf}\n", tokens->line, tokens->ival, tokens->fval);
+        fwrite(tok_begin(token), sizeof(char), token->len, stdout);
+        fprintf(stdout, " at line %ld, ival = %ld, fval = %Lf}\n", tok_line(token), tok_literal(token)->ival, tok_literal(token)->fval);
         break;
       case TK_CHR:
         fprintf(stdout, "{<character>: ");
-        fwrite(tokens->begin, sizeof(char), tokens->len, stdout);
-        fprintf(stdout, " at line %ld, cval = %c}\n", tokens->line, tokens->cval);
+        fwrite(tok_begin(token), sizeof(char), token->len, stdout);
+        fprintf(stdout, " at line %ld, cval = %c}\n", tok_line(token), tok_literal(token)->cval);
         break;
       case TK_STR:
         fprintf(stdout, "{<string>: ");
-        fwrite(tokens->begin, sizeof(char), tokens->len, stdout);
-        fprintf(stdout, " at line %ld, sval = %s}\n", tokens->line, tokens->sval);
-        break;
-      case TK_PUNCT:
-        fprintf(stdout, "{<punctuator>: ");
-        fwrite(tokens->begin, sizeof(char), tokens->len, stdout);
-        fprintf(stdout, " at line %ld}\n", tokens->line);
+        fwrite(tok_begin(token), sizeof(char), token->len, stdout);
+        fprintf(stdout, " at line %ld, sval = %s}\n", tok_line(token), tok_literal(token)->sval);
         break;
       case TK_EOF:
         fprintf(stdout, "{<eof>}\n");
-        break;
+        return;
       default:
         break;
     }
-    tokens = tokens->next;
   }
 }
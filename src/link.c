@@ -0,0 +1,95 @@
+#include "obj.h"
+#include "arena.h"
+#include <stdlib.h>
+
+// static linker of objects into an executable
+//
+// the sections of objects are concatenated, a symbol is found in its object first,
+// and among the global symbols of all objects then, and the relocations are applied in place
+// the program starts at _start, which the runtime defines (see codegen_runtime)
+
+// where the section of each object starts in the executable
+typedef struct placed_t
+{
+  uint32_t offsets[SECTION_NUM];
+} placed_t;
+
+// the global symbol of name, exits if no object defines it
+static uint32_t global_addr(hashmap_t *globals, char *name)
+{
+  entry_t *entry = hashmap_get_cstr(globals, name);
+  if (!entry) {
+    fprintf(stderr, "undefined reference to \"%s\"\n", name);
+    exit(1);
+  }
+  return (uint32_t) (uintptr_t) entry->val;
+}
+
+// write the value of relocation to its field at address p, for the symbol at address s
+void apply_reloc(uint8_t *field, reloc_t *reloc, uint64_t s, uint64_t p)
+{
+  int64_t val = (int64_t) (s + reloc->addend);
+  if (reloc->kind != RELOC_ABS32)
+    val -= (int64_t) p;
+  // an absolute address is unsigned, and a relative one is signed
+  if (val < INT32_MIN || val > (reloc->kind == RELOC_ABS32 ? (int64_t) UINT32_MAX : INT32_MAX)) {
+    fprintf(stderr, "relocation out of range\n");
+    exit(1);
+  }
+  for (int i = 0; i < 4; i++)
+    field[i] = (uint8_t) ((uint64_t) val >> (8 * i));
+}
+
+static uint32_t sym_addr(placed_t *placed, obj_sym_t *sym, uint32_t addrs[SECTION_NUM])
+{
+  return addrs[sym->section] + placed->offsets[sym->section] + sym->offset;
+}
+
+void link_exe(obj_t **objs, int objs_num, char *path)
+{
+  obj_t *exe = new_obj();
+  exe->target = objs[0]->target;
+  placed_t *placed = arena_alloc(curr_arena, sizeof(placed_t) * objs_num);
+  for (int i = 0; i < objs_num; i++) {
+    for (SECTION section = 0; section < SECTION_NUM; section++) {
+      byte_vec_t *bytes = &exe->sections[section];
+      while (bytes->size % 16)
+        byte_vec_push(bytes, 0);
+      placed[i].offsets[section] = bytes->size;
+      byte_vec_t *from = &objs[i]->sections[section];
+      for (size_t j = 0; j < from->size; j++)
+        byte_vec_push(bytes, *byte_vec_at(from, j));
+    }
+  }
+
+  uint32_t addrs[SECTION_NUM];
+  layout_exe(exe, addrs);
+
+  hashmap_t *globals = new_hashmap(64);
+  for (int i = 0; i < objs_num; i++) {
+    obj_sym_vec_t *syms = &objs[i]->syms;
+    for (size_t j = 0; j < syms->size; j++) {
+      obj_sym_t *sym = obj_sym_vec_at(syms, j);
+      if (!sym->is_global || !sym->is_defined)
+        continue;
+      if (hashmap_get_cstr(globals, sym->name)) {
+        fprintf(stderr, "multiple definition of \"%s\"\n", sym->name);
+        exit(1);
+      }
+      hashmap_add_cstr(globals, sym->name, (void *) (uintptr_t) sym_addr(placed + i, sym, addrs));
+    }
+  }
+
+  for (int i = 0; i < objs_num; i++) {
+    reloc_vec_t *relocs = &objs[i]->relocs;
+    for (size_t j = 0; j < relocs->size; j++) {
+      reloc_t *reloc = reloc_vec_at(relocs, j);
+      obj_sym_t *sym = obj_sym_vec_at(&objs[i]->syms, reloc->sym);
+      uint32_t s = sym->is_defined ? sym_addr(placed + i, sym, addrs) : global_addr(globals, sym->name);
+      uint32_t offset = placed[i].offsets[reloc->section] + reloc->offset;
+      apply_reloc(byte_vec_at(&exe->sections[reloc->section], offset), reloc, s, addrs[reloc->section] + offset);
+    }
+  }
+
+  write_exe(exe, addrs, global_addr(globals, "_start"), path);
+}
@@ -1,43 +1,277 @@
+#include "arena.h"
 #include "lex.h"
 #include "parse.h"
+#include "fold.h"
+#include "ir.h"
 #include "codegen.h"
+#include "x86.h"
+#include "obj.h"
+#include "bytecode.h"
+#include "source.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-int main(int argc, char *argv[])
+// report memory used by each phase to stderr
+static bool show_stats = false;
+
+// fold constant expressions before generating ir (-O)
+static bool optimize = false;
+
+// what to emit
+typedef enum EMIT
+{
+  EMIT_EXE,  // executable (default)
+  EMIT_OBJ,  // elf relocatable object only, to output.o (--emit=obj)
+  EMIT_ASM,  // assembly only, to output.s (--emit=asm)
+  EMIT_KATC, // bytecode, to output.katc (--emit=katc)
+  EMIT_IR,   // ir dumped to stdout (--emit=ir)
+} EMIT;
+
+static EMIT emit = EMIT_EXE;
+
+// build the executable with gcc from assembly, against libc (--toolchain),
+// instead of encoding and linking it with the runtime of kat
+static bool use_toolchain = false;
+
+// run the program in process after compiling it, instead of writing anything (--run)
+// or interpret its bytecode (--vm), the source of which can be a .katc file
+// the arguments after the source are the integer arguments of main
+static bool run = false;
+static bool interpret = false;
+static char **run_args = NULL;
+static int run_args_num = 0;
+static int run_status = 0;
+
+// encode the program, and write it as an object or link it into an executable
+static void build(ir_func_t *ir)
+{
+  obj_t *program = new_obj();
+  output_obj = program;
+  codegen(ir);
+  if (emit == EMIT_OBJ) {
+    FILE *fp = fopen(output_file_path, "wb");
+    if (!fp) {
+      fprintf(stderr, "cannot open %s\n", output_file_path);
+      exit(1);
+    }
+    write_obj(program, fp);
+    fclose(fp);
+    return;
+  }
+
+  obj_t *runtime = new_obj();
+  output_obj = runtime;
+  codegen_runtime();
+  output_obj = NULL;
+
+  arena_set_phase(curr_arena, PHASE_LINK);
+  obj_t *objs[] = { program, runtime };
+  link_exe(objs, 2, output_file_path);
+}
+
+// the arguments of main, which are ints
+static int32_t *parse_run_args()
+{
+  int32_t *args = malloc(sizeof(int32_t) * (run_args_num + 1));
+  for (int i = 0; i < run_args_num; i++) {
+    char *end;
+    long val = strtol(run_args[i], &end, 10);
+    if (!*run_args[i] || *end || val < INT32_MIN || val > INT32_MAX) {
+      fprintf(stderr, "argument \"%s\" is not an int\n", run_args[i]);
+      exit(1);
+    }
+    args[i] = (int32_t) val;
+  }
+  return args;
+}
+
+static bool is_katc(char *path)
 {
-  source_file_path = argv[1];
-  FILE *source_file = fopen(source_file_path, "r");
-  fseek(source_file, 0L, SEEK_END);
-  size_t len = ftell(source_file);
-  fseek(source_file, 0L, SEEK_SET);
-  char *buf = malloc(sizeof(char) * (len + 1));
-  fread(buf, sizeof(char), len, source_file);
-  buf[len] = '\0';
-  fclose(source_file);
+  size_t len = strlen(path);
+  return len >= 5 && !strcmp(path + len - 5, ".katc");
+}
+
+// encode the program, and run it in process
+static void run_program(ir_func_t *ir)
+{
+  ir_func_t *main_func = ir;
+  while (main_func && strcmp(main_func->func->name, "main"))
+    main_func = main_func->next;
+  if (!main_func) {
+    fprintf(stderr, "undefined reference to \"main\"\n");
+    exit(1);
+  }
+  if ((size_t) run_args_num != main_func->params.size) {
+    fprintf(stderr, "main takes %zu arguments, but %d are given\n", main_func->params.size, run_args_num);
+    exit(1);
+  }
+  int32_t *args = parse_run_args();
 
-  // fprintf(stdout, "%s\n", buf);
+  obj_t *program = new_obj();
+  output_obj = program;
+  codegen(ir);
+  output_obj = NULL;
 
-  token_t *tokens = lex(buf);
+  arena_set_phase(curr_arena, PHASE_LINK);
+  run_status = jit_run(program, args, run_args_num);
+  free(args);
+}
+
+// compile the program to bytecode, and interpret it or write it to output.katc
+static void gen_katc(ir_func_t *ir)
+{
+  bc_prog_t *bc = gen_bytecode(ir);
+  if (interpret) {
+    int32_t *args = parse_run_args();
+    run_status = run_bytecode(bc, args, run_args_num);
+    free(args);
+    return;
+  }
+  write_bytecode(bc, output_file_path);
+}
+
+// compile the source file, and write the assembly to output_file_path if given
+// all the memory of a compilation comes from one arena,
+// which is released at once when the compilation is done
+static void compile(char *source_path)
+{
+  source_file_path = source_path;
+  source_t *source = load_source(source_file_path);
+
+  arena_t *arena = new_arena();
+  curr_arena = arena;
+
+  // fprintf(stdout, "%s\n", source->buf);
+
+  arena_set_phase(arena, PHASE_LEX);
+  token_t *tokens = lex(source->buf, source->len);
   // dump_token_list(tokens);
 
+  arena_set_phase(arena, PHASE_PARSE);
   node_t *ast = parse(tokens);
+  if (optimize)
+    fold(ast);
   // dump_ast(ast);
 
-  if (argc >= 3) {
-    output_file_path = malloc(sizeof(char) * (strlen(argv[2]) + 5));
-    strcpy(output_file_path, argv[2]);
-    strcat(output_file_path, ".s");
+  arena_set_phase(arena, PHASE_IR);
+  ir_func_t *ir = gen_ir(ast);
+#ifdef DEBUG
+  verify_ir(ir);
+#endif
+
+  if (emit == EMIT_IR) {
+    verify_ir(ir);
+    dump_ir(ir, stdout);
+  } else if (run) {
+    arena_set_phase(arena, PHASE_CODEGEN);
+    run_program(ir);
+  } else if (interpret || (output_file_path && emit == EMIT_KATC)) {
+    arena_set_phase(arena, PHASE_CODEGEN);
+    gen_katc(ir);
+  } else if (output_file_path && (emit == EMIT_ASM || use_toolchain)) {
     output_file = fopen(output_file_path, "w");
 
-    codegen(ast);
+    arena_set_phase(arena, PHASE_CODEGEN);
+    codegen(ir);
 
     fclose(output_file);
+  } else if (output_file_path) {
+    arena_set_phase(arena, PHASE_CODEGEN);
+    build(ir);
+  }
 
-    execl("/usr/bin/gcc", "gcc", "-m32", output_file_path, "-o", argv[2], (char *) NULL);
+  if (show_stats) {
+    arena_report(arena, stderr);
+    if (optimize)
+      fold_report(stderr);
+    if (use_peephole && (output_file_path || run) && !interpret && emit != EMIT_KATC)
+      peephole_report(stderr);
   }
 
+  delete_arena(arena);
+  unload_source(source);
+}
+
+int main(int argc, char *argv[])
+{
+  char *paths[2] = { NULL, NULL };
+  int paths_num = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--stats")) {
+      show_stats = true;
+    } else if (!strcmp(argv[i], "-O")) {
+      optimize = true;
+    } else if (!strcmp(argv[i], "--emit=ir")) {
+      emit = EMIT_IR;
+    } else if (!strcmp(argv[i], "--emit=obj")) {
+      emit = EMIT_OBJ;
+    } else if (!strcmp(argv[i], "--emit=katc")) {
+      emit = EMIT_KATC;
+    } else if (!strcmp(argv[i], "--emit=asm")) {
+      emit = EMIT_ASM;
+    } else if (!strcmp(argv[i], "--toolchain")) {
+      use_toolchain = true;
+    } else if (!strcmp(argv[i], "--no-regalloc")) {
+      use_regalloc = false;
+    } else if (!strcmp(argv[i], "--no-peephole")) {
+      use_peephole = false;
+    } else if (!strcmp(argv[i], "--target=i386")) {
+      target = TARGET_I386;
+    } else if (!strcmp(argv[i], "--target=x86_64")) {
+      target = TARGET_X86_64;
+    } else if (!strcmp(argv[i], "--run")) {
+      // the host runs x86_64 code only
+      run = true;
+      target = TARGET_X86_64;
+    } else if (!strcmp(argv[i], "--vm")) {
+      interpret = true;
+    } else if (!strcmp(argv[i], "--no-fuse")) {
+      use_fusion = false;
+    } else if ((run || interpret) && paths_num == 1) {
+      run_args = argv + i;
+      run_args_num = argc - i;
+      break;
+    } else if (paths_num < 2) {
+      paths[paths_num++] = argv[i];
+    } else {
+      fprintf(stderr, "usage: kat [-O] [--stats] [--emit=ir|asm|obj|katc] [--toolchain] [--no-regalloc] [--no-peephole] [--no-fuse] [--target=i386|x86_64] [source] [output]\n"
+                      "       kat [-O] [--stats] [--no-regalloc] [--no-peephole] --run source [args]\n"
+                      "       kat [-O] [--stats] [--no-fuse] --vm source|file.katc [args]\n");
+      exit(1);
+    }
+  }
+
+  // the assembly is written to output.s, and the object to output.o
+  if (paths[1] && emit != EMIT_IR) {
+    char *suffix = emit == EMIT_ASM || use_toolchain ? ".s" : emit == EMIT_OBJ ? ".o" : emit == EMIT_KATC ? ".katc" : "";
+    output_file_path = malloc(sizeof(char) * (strlen(paths[1]) + 6));
+    strcpy(output_file_path, paths[1]);
+    strcat(output_file_path, suffix);
+  }
+
+  // bytecode compiled before is mapped and interpreted, without compiling anything
+  if (interpret && paths[0] && is_katc(paths[0])) {
+    bc_prog_t *bc = load_bytecode(paths[0]);
+    int32_t *args = parse_run_args();
+    run_status = run_bytecode(bc, args, run_args_num);
+    free(args);
+    unload_bytecode(bc);
+    return run_status;
+  }
+
+  // read source from stdin if no source file is given (or given "-")
+  compile(paths[0] ? paths[0] : "-");
+  if (run || interpret)
+    return run_status;
+
+  // x86_64 code is linked natively, and needs no 32-bit libraries
+  if (paths[1] && emit == EMIT_EXE && use_toolchain && target == TARGET_X86_64)
+    execl("/usr/bin/gcc", "gcc", output_file_path, "-o", paths[1], (char *) NULL);
+  if (paths[1] && emit == EMIT_EXE && use_toolchain)
+    execl("/usr/bin/gcc", "gcc", "-m32", output_file_path, "-o", paths[1], (char *) NULL);
+
   return 0;
 }
@@ -1,61 +1,33 @@
+#include "arena.h"
 #include "hashmap.h"
 #include "lex.h"
 #include "parse.h"
-#include "stack.h"
 #include "symbol.h"
 #include "scope.h"
+#include "vec.h"
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdnoreturn.h>
 
-static char *type_list[] = {
-  [KAT_INT]  = "int",
-  [KAT_CHAR] = "char",
-  [KAT_STR]  = "str",
-  [KAT_BOOL] = "bool",
-  [KAT_NIL]  = "nil"
-};
-
-static bool is_valid_type(char *type)
-{
-  for (unsigned i = 0; i < sizeof(type_list) / sizeof(*type_list); i++) {
-    if (!strcmp(type, type_list[i]))
-      return true;
-  }
-  return false;
-}
-
+// tokens are stored contiguously and terminated by TK_EOF
+// the next token of EOF is itself
 static token_t *peek(token_t **token)
 {
   if (token)
-    return (*token)->next;
+    return (*token)->type == TK_EOF ? *token : *token + 1;
   return NULL;
 }
 
-// match the token with the given string
-static bool expect_str(token_t **token, const char *str)
-{
-  return ((*token)->len == strlen(str) &&
-          !memcmp((*token)->begin, str, sizeof(char) * (*token)->len));
-}
-
 // match the token with the given token type
 static bool expect_type(token_t **token, TK_TYPE tok_type)
 {
   return (*token)->type == tok_type;
 }
 
-// match the token with the given string
-static bool expect_next_str(token_t **token, const char *str)
-{
-  token_t *next_tok = peek(token);
-  return (next_tok->len == strlen(str) &&
-          !memcmp(next_tok->begin, str, sizeof(char) * next_tok->len));
-}
-
 // match the token with the given token type
 static bool expect_next_type(token_t **token, TK_TYPE tok_type)
 {
@@ -67,7 +39,7 @@ static bool expect_next_type(token_t **token, TK_TYPE tok_type)
 static bool advance(token_t **token)
 {
   if (token && (*token)->type != TK_EOF) {
-    *token = (*token)->next;
+    (*token)++;
     return true;
   }
   return false;
@@ -76,9 +48,9 @@ static bool advance(token_t **token)
 // consume current token
 // if match, consume the current token and return true
 // otherwise, do nothing and return false
-static bool consume(token_t **token, const char *str)
+static bool consume(token_t **token, TK_TYPE tok_type)
 {
-  if ((*token)->type != TK_EOF && expect_str(token, str)) {
+  if ((*token)->type != TK_EOF && expect_type(token, tok_type)) {
     advance(token);
     return true;
   }
@@ -89,94 +61,87 @@ static bool consume(token_t **token, const char *str)
 // so the type getter is hard coded
 static KAT_TYPE tok2type(token_t *token)
 {
-  if (!expect_type(&token, TK_KW) && !expect_type(&token, TK_ID)) {
-    fprintf(stderr, "expected type name at line %ld\n", token->line);
+  if (!is_kw_type(token->type) && !expect_type(&token, TK_ID)) {
+    fprintf(stderr, "expected type name at line %ld\n", tok_line(token));
     exit(1);
   }
 
-  if (expect_str(&token, "int"))
-    return KAT_INT;
-  if (expect_str(&token, "char"))
-    return KAT_CHAR;
-  if (expect_str(&token, "str"))
-    return KAT_STR;
-  if (expect_str(&token, "bool"))
-    return KAT_BOOL;
+  switch (token->type) {
+    case TK_KW_INT:  return KAT_INT;
+    case TK_KW_CHAR: return KAT_CHAR;
+    case TK_KW_STR:  return KAT_STR;
+    case TK_KW_BOOL: return KAT_BOOL;
+    default: break;
+  }
 
   fprintf(stderr, "unknown data type \"");
-  fwrite(token->begin, sizeof(char), token->len, stderr);
-  fprintf(stderr, "\" at line %ld\n", token->line);
+  fwrite(tok_begin(token), sizeof(char), token->len, stderr);
+  fprintf(stderr, "\" at line %ld\n", tok_line(token));
   exit(1);
 }
 
-static type_t *make_type(token_t *type_tok)
+// the canonical type named by the token, nil if there is no token
+static type_t *get_type(token_t *type_tok)
 {
-  type_t *type = calloc(1, sizeof(type_t));
-  type->name = type_tok == NULL ? "nil" : tok2cstr(type_tok);
-  type->kind = type_tok == NULL ? KAT_NIL : tok2type(type_tok);
-  switch (type->kind) {
-    case KAT_INT: type->size = 4; break;
-    case KAT_CHAR: type->size = 4; break;
-    case KAT_STR: type->size = 4; break;
-    case KAT_BOOL: type->size = 4; break;
-    case KAT_NIL: type->size = 0; break;
-  }
-  type->next = NULL;
-  return type;
+  return basic_type(type_tok == NULL ? KAT_NIL : tok2type(type_tok));
+}
+
+// size of the node up to the given field
+#define NODE_SIZE(field) (offsetof(node_t, field) + sizeof(((node_t *) 0)->field))
+
+// nodes only take the header and the fields of their kind
+static node_t *make_node(ND_TYPE node_type)
+{
+  static const size_t node_size[] = {
+    [ND_NIL] = NODE_SIZE(next),
+    [ND_PROG] = NODE_SIZE(body),
+    [ND_VAR] = NODE_SIZE(var),
+    [ND_FUNC] = NODE_SIZE(body),
+    [ND_EXPR] = NODE_SIZE(rhs),
+    [ND_FNCALL] = NODE_SIZE(params),
+    [ND_DECL_STMT] = NODE_SIZE(rhs),
+    [ND_EXPR_STMT] = NODE_SIZE(rhs),
+    [ND_IF] = NODE_SIZE(else_stmt),
+    [ND_WHILE] = NODE_SIZE(while_stmt),
+    [ND_RETURN] = NODE_SIZE(rhs),
+    [ND_NUM] = NODE_SIZE(ival),
+  };
+
+  node_t *node = arena_calloc(curr_arena, 1, node_size[node_type]);
+  node->type = node_type;
+  return node;
+}
+
+node_t *make_num_node(int64_t ival)
+{
+  node_t *num_node = make_node(ND_NUM);
+  num_node->ival = ival;
+  return num_node;
 }
 
 // make node for new declared variable
 static node_t *make_decl_var_node(token_t *var_tok, token_t *type_tok)
 {
-  node_t *var_node = calloc(1, sizeof(node_t));
-  var_node->type = ND_VAR;
-  var_node->var = make_var_symbol(var_tok, make_type(type_tok));
-  var_node->params = NULL;
-  var_node->body = NULL;
-  var_node->lhs = NULL;
-  var_node->op = NULL;
-  var_node->rhs = NULL;
-  var_node->cond = NULL;
-  var_node->if_stmt = NULL;
-  var_node->else_stmt = NULL;
-  var_node->while_stmt = NULL;
-  var_node->next = NULL;
+  node_t *var_node = make_node(ND_VAR);
+  var_node->var = make_var_symbol(var_tok, get_type(type_tok));
   return var_node;
 }
 
 // make node for variable reference
 static node_t *make_ref_var_node(token_t *var_tok)
 {
-  node_t *var_node = calloc(1, sizeof(node_t));
-  var_node->type = ND_VAR;
-  var_node->var = find_symbol_by_tok(var_scope, var_tok);
-  var_node->params = NULL;
-  var_node->body = NULL;
-  var_node->lhs = NULL;
-  var_node->op = NULL;
-  var_node->rhs = NULL;
-  var_node->cond = NULL;
-  var_node->if_stmt = NULL;
-  var_node->else_stmt = NULL;
-  var_node->while_stmt = NULL;
-  var_node->next = NULL;
+  node_t *var_node = make_node(ND_VAR);
+  var_node->var = find_symbol_by_tok(NS_VAR, var_tok);
   return var_node;
 }
 
-static node_t *make_node(ND_TYPE node_type)
-{
-  node_t *node = calloc(1, sizeof(node_t));
-  node->type = node_type;
-  return node;
-}
-
 /* parsing part */
 
-static token_t *find_right_close_paren(token_t *token);
 static node_t *parse_fncall(token_t **token);
 static node_t *parse_expr_list(token_t **token);
-static node_t *parse_op(token_t **token, int arity);
-static node_t *parse_expr(token_t **token, token_t *end_token);
+static node_t *parse_unary(token_t **token);
+static node_t *parse_binary(token_t **token, int min_precedence);
+static node_t *parse_expr(token_t **token);
 static node_t *parse_expr_stmt(token_t **token);
 static node_t *parse_decl_stmt(token_t **token);
 static node_t *parse_stmt_block(token_t **token, bool is_func_body);
@@ -185,35 +150,6 @@ static node_t *parse_while(token_t **token);
 static node_t *parse_return(token_t **token);
 static node_t *parse_func(token_t **token);
 
-// find the matching right paren
-static token_t *find_right_close_paren(token_t *token)
-{
-  token_t *save = token;
-  stack_t *paren_stack = new_stack(32, sizeof(ND_TYPE));
-  while (true) {
-    if (expect_type(&token, TK_EOF)) {
-      fprintf(stderr, "expected \")\" at line %ld\n", save->line);
-      exit(1);
-    }
-
-    if (expect_str(&token, "(")) {
-      push(paren_stack, &(ND_TYPE) {ND_LPAREN});
-      token = token->next;
-      continue;
-    } else if (expect_str(&token, ")")) {
-      pop(paren_stack, NULL);
-      if (is_empty(paren_stack))
-        break;
-      token = token->next;
-      continue;
-    } else {
-      token = token->next;
-      continue;
-    }
-  }
-  return token;
-}
-
 // parse expression list
 // expression-list = "(" [expression {"," expression }] ")" ;
 static node_t *parse_expr_list(token_t **token)
@@ -221,15 +157,23 @@ static node_t *parse_expr_list(token_t **token)
   node_t expr_head = { .next = NULL };
   node_t *curr_expr = &expr_head;
 
-  if (expect_str(token, "(")) {
-    token_t *right_close_paren = find_right_close_paren(*token);
+  if (expect_type(token, TK_LPAREN)) {
+    // unmatched left paren is matched with EOF by the lexer
+    token_t *right_close_paren = tok_match(*token);
+    if (expect_type(&right_close_paren, TK_EOF)) {
+      fprintf(stderr, "expected \")\" at line %ld\n", tok_line(*token));
+      exit(1);
+    }
     advance(token);
+    if ((*token) == right_close_paren)  // empty expression list
+      goto end_expr_list;
   parse_next_expr:
-    curr_expr->next = parse_expr(token, right_close_paren);
+    curr_expr->next = parse_expr(token);
     curr_expr = curr_expr->next;
-    if (consume(token, ","))
+    if (consume(token, TK_COMMA))
       goto parse_next_expr;
-    consume(token, ")");
+  end_expr_list:
+    consume(token, TK_RPAREN);
   }
 
   return expr_head.next;
@@ -240,22 +184,22 @@ static node_t *parse_expr_list(token_t **token)
 static node_t *parse_fncall(token_t **token)
 {
   if (expect_type(token, TK_ID)) {
-    symbol_t *var_symbol = find_symbol_by_tok(var_scope, *token);
+    symbol_t *var_symbol = find_symbol_by_tok(NS_VAR, *token);
     if (var_symbol) {
-      fprintf(stderr, "variable \"%s\" cannot be called as a function at line %ld\n", tok2cstr(*token), (*token)->line);
+      fprintf(stderr, "variable \"%s\" cannot be called as a function at line %ld\n", tok_atom(*token)->name, tok_line(*token));
       exit(1);
     }
 
-    symbol_t *func_symbol = find_symbol_by_tok(func_scope, *token);
+    symbol_t *func_symbol = find_symbol_by_tok(NS_FUNC, *token);
     if (!func_symbol) {
-      fprintf(stderr, "use of undeclared function \"%s\" at line %ld\n", tok2cstr(*token), (*token)->line);
+      fprintf(stderr, "use of undeclared function \"%s\" at line %ld\n", tok_atom(*token)->name, tok_line(*token));
       exit(1);
     }
 
     advance(token);
 
-    if (!expect_str(token, "(")) {
-      fprintf(stderr, "expected \"(\" in call of function %s at line %ld\n", tok2cstr(*token), (*token)->line);
+    if (!expect_type(token, TK_LPAREN)) {
+      fprintf(stderr, "expected \"(\" in call of function %s at line %ld\n", func_symbol->name, tok_line(*token));
       exit(1);
     }
 
@@ -264,7 +208,7 @@ static node_t *parse_fncall(token_t **token)
 
     // TODO: check if the params match (types)
     // // expected param types
-    // type_t *params_type = func_symbol->params_type;
+    // type_t **params_type = func_symbol->func_type->sig + 1;
 
     // parse params, which is a expression list "(" expr {"," expr} ")"
     fncall_node->params = parse_expr_list(token);
@@ -274,204 +218,141 @@ static node_t *parse_fncall(token_t **token)
   }
 }
 
-// parse operator
-// operator = "+" | "-" | "*" | "/" | "&&" | "||" | ">" | "<" | ">=" | "<=" | "==" | "!=" ;
-// currently we hard coding these operators and their properties (unary or binary, precedence, associativity, etc.)
-// it's better to use a hashmap store these information
-static node_t *parse_op(token_t **token, int arity)
+// operator table, indexed by token type
+// unary operators only differ from binary ones by arity,
+// binary operators with higher precedence bind tighter, and all of them are left associative
+static const struct {
+  ND_TYPE unary;
+  ND_TYPE binary;
+  int precedence;   // precedence of the binary operator
+} op_table[TK_PUNCT + 1] = {
+  [TK_LOGAND] = { ND_NIL, ND_LOGAND, 1 },
+  [TK_LOGOR]  = { ND_NIL, ND_LOGOR,  1 },
+  [TK_GT]     = { ND_NIL, ND_GT,     2 },
+  [TK_LT]     = { ND_NIL, ND_LT,     2 },
+  [TK_GE]     = { ND_NIL, ND_GE,     2 },
+  [TK_LE]     = { ND_NIL, ND_LE,     2 },
+  [TK_EQ]     = { ND_NIL, ND_EQ,     2 },
+  [TK_NE]     = { ND_NIL, ND_NE,     2 },
+  [TK_PLUS]   = { ND_POS, ND_ADD,    3 },
+  [TK_MINUS]  = { ND_NEG, ND_SUB,    3 },
+  [TK_STAR]   = { ND_NIL, ND_MUL,    4 },
+  [TK_SLASH]  = { ND_NIL, ND_DIV,    4 },
+};
+
+static node_t *make_expr_node(ND_TYPE op, node_t *lhs, node_t *rhs)
 {
-  if (consume(token, "+")) {
-    switch (arity) {
-      case 1: return make_node(ND_POS);
-      case 2: return make_node(ND_ADD);
-      default:
-        fprintf(stderr, "internal error in %s at line %d\n", __FILE__, __LINE__);
-        exit(1);
-    }
-  }
-  if (consume(token, "-")) {
-    switch (arity) {
-      case 1: return make_node(ND_NEG);
-      case 2: return make_node(ND_SUB);
-      default:
-        fprintf(stderr, "internal error in %s at line %d\n", __FILE__, __LINE__);
-        exit(1);
-    }
-  }
-  if (consume(token, "*"))  return make_node(ND_MUL);
-  if (consume(token, "/"))  return make_node(ND_DIV);
-  if (consume(token, "&&")) return make_node(ND_LOGAND);
-  if (consume(token, "||")) return make_node(ND_LOGOR);
-  if (consume(token, ">"))  return make_node(ND_GT);
-  if (consume(token, "<"))  return make_node(ND_LT);
-  if (consume(token, ">=")) return make_node(ND_GE);
-  if (consume(token, "<=")) return make_node(ND_LE);
-  if (consume(token, "==")) return make_node(ND_EQ);
-  if (consume(token, "!=")) return make_node(ND_NE);
+  node_t *expr_node = make_node(ND_EXPR);
+  expr_node->op = op;
+  expr_node->lhs = lhs;
+  expr_node->rhs = rhs;
 
-  return NULL;
-}
+  // TODO:
+  // type checking
+  // * if lhs and rhs has consistent types
+  // * if types of operands of op match lhs and rhs
 
-static int get_precedence(node_t *op_node)
-{
-  switch (op_node->type) {
-    case ND_LOGAND:
-    case ND_LOGOR:
-      return 1;
-    case ND_GT:
-    case ND_LT:
-    case ND_GE:
-    case ND_LE:
-    case ND_EQ:
-    case ND_NE:
-      return 2;
-    case ND_ADD:
-    case ND_SUB:
-      return 3;
-    case ND_MUL:
-    case ND_DIV:
-      return 4;
-    case ND_FNCALL:
-      return 5;
-    case ND_POS:
-    case ND_NEG:
-      return 6;
-    case ND_LPAREN:
-    case ND_RPAREN:
-      return 7;
-    default:
-      return -1;
-  }
+  return expr_node;
 }
 
-// parse expression
-// expression = primary {operator primary} ;
-static node_t *parse_expr(token_t **token, token_t *end_token)
+// parse unary expression
+// unary = ("+" | "-") unary | primary ;
+// primary = "(" expression ")" | number | identifier | function-call ;
+// the operand of an unary operator is kept in rhs, and lhs is null
+static node_t *parse_unary(token_t **token)
 {
-  // operator-precedence parsing
-  // expr_stack, op_stack, lookahead
-  // - if lookahead is an operator:
-  //   * it has an lower or equal (<=) precedence over the top of op_stack,
-  //     then we pop operands from expr_stack, and make a node with type ND_EXPR,
-  //     and fill the pointer lhs, op, rhs
-  //   * it has an higher (>) precedence than the top of op_stack,
-  //     then we push it onto op_stack
-  // - if lookahead is a primary:
-  //   * parse it and return its node, and push the node onto expr_stack
-
-  stack_t *expr_stack = new_stack(32, sizeof(node_t *));
-  stack_t *op_stack = new_stack(32, sizeof(node_t *));
-
-  while (!expect_str(token, ",") && !expect_str(token, "{") && !expect_str(token, ";") && (*token) != end_token) {
-    if (expect_str(token, "(")) { // left paren
-      node_t *lparen_node = make_node(ND_LPAREN);
-      push(op_stack, &lparen_node);
-      advance(token);
-      continue;
-    }
+  ND_TYPE op = op_table[(*token)->type].unary;
+  if (op != ND_NIL) {
+    advance(token);
+    return make_expr_node(op, NULL, parse_unary(token));
+  }
 
-    if (expect_str(token, ")")) { // right paren
-      node_t *top = NULL;
-      gettop(op_stack, &top);
-      if (!top) {
-        fprintf(stderr, "mismatched parentheses at line %ld\n", (*token)->line);
-        exit(1);
-      }
-      while (top->type != ND_LPAREN) {
-        node_t *expr_node = make_node(ND_EXPR);
-        pop(expr_stack, &(expr_node->rhs));
-        pop(expr_stack, &(expr_node->lhs));
-        pop(op_stack, &(expr_node->op));
-
-        // TODO:
-        // type checking
-        // * if lhs and rhs has consistent types
-        // * if types of operands of op match lhs and rhs
-
-        push(expr_stack, &expr_node);
-        gettop(op_stack, &top);
-      }
-      pop(op_stack, NULL);
+  switch ((*token)->type) {
+    case TK_LPAREN: {
       advance(token);
-      continue;
-    }
-
-    if (expect_type(token, TK_PUNCT)) // operator
-    {
-      // kat only supports binary operator currently
-      node_t *op = parse_op(token, 2);
-      if (!op) {
-        fprintf(stderr, "invalid expression at line %ld\n", (*token)->line);
+      node_t *expr_node = parse_expr(token);
+      if (!consume(token, TK_RPAREN)) {
+        fprintf(stderr, "mismatched parentheses at line %ld\n", tok_line(*token));
         exit(1);
       }
-      node_t *top = NULL;
-      gettop(op_stack, &top);
-      while (top && top->type != ND_LPAREN && get_precedence(top) >= get_precedence(op)) {
-        node_t *expr_node = make_node(ND_EXPR);
-        pop(expr_stack, &(expr_node->rhs));
-        pop(expr_stack, &(expr_node->lhs));
-        pop(op_stack, &(expr_node->op));
-
-        // TODO:
-        // type checking
-        // * if lhs and rhs has consistent types
-        // * if types of operands of op match lhs and rhs
-
-        push(expr_stack, &expr_node);
-        gettop(op_stack, &top);
-      }
-      push(op_stack, &op);
-      continue;
+      return expr_node;
     }
 
-    if (expect_type(token, TK_NUM)) { // number
-      node_t *num_node = make_node(ND_NUM);
+    case TK_NUM: {
       // kat only supports integer numeric value currently
-      num_node->ival = (*token)->ival;
-      push(expr_stack, &num_node);
+      node_t *num_node = make_num_node(tok_literal(*token)->ival);
       advance(token);
-      continue;
+      return num_node;
     }
 
-    if (expect_type(token, TK_ID)) {  // variable or function call
+    case TK_ID: { // variable or function call
       token_t *next_tok = peek(token);
-      if (expect_str(&next_tok, "(")) { // function call
-        node_t *fncall_node = parse_fncall(token);
-        push(expr_stack, &fncall_node);
-      } else {  // variable
-        symbol_t *var_symbol = find_symbol_by_tok(var_scope, *token);
-        if (!var_symbol) {
-          fprintf(stderr, "use of undeclared variable \"%s\" at line %ld\n", tok2cstr(*token), (*token)->line);
-          exit(1);
-        }
-        node_t *var_node = make_ref_var_node(*token);
-        push(expr_stack, &var_node);
-        advance(token);
+      if (expect_type(&next_tok, TK_LPAREN))  // function call
+        return parse_fncall(token);
+
+      symbol_t *var_symbol = find_symbol_by_tok(NS_VAR, *token);
+      if (!var_symbol) {
+        fprintf(stderr, "use of undeclared variable \"%s\" at line %ld\n", tok_atom(*token)->name, tok_line(*token));
+        exit(1);
       }
-      continue;
+      node_t *var_node = make_ref_var_node(*token);
+      advance(token);
+      return var_node;
     }
-  }
 
-  // handle the remaining operators
-  while (!is_empty(op_stack)) {
-    node_t *top = NULL;
-    gettop(op_stack, &top);
-    if (top->type == ND_LPAREN) {
-      fprintf(stderr, "mismatched parentheses at line %ld\n", (*token)->line);
+    default:
+      fprintf(stderr, "invalid expression at line %ld\n", tok_line(*token));
       exit(1);
+  }
+}
+
+// parse binary expression whose operators have at least the given precedence
+// precedence climbing: the rhs of an operator only takes operators binding tighter,
+// so operators of the same precedence associate to the left
+static node_t *parse_binary(token_t **token, int min_precedence)
+{
+  node_t *lhs = parse_unary(token);
+
+  while (true) {
+    TK_TYPE type = (*token)->type;
+    ND_TYPE op = op_table[type].binary;
+
+    if (op == ND_NIL) {
+      // these tokens end an expression
+      switch (type) {
+        case TK_RPAREN:
+          // a stray right paren is matched with itself by the lexer
+          if (tok_match(*token) == *token) {
+            fprintf(stderr, "mismatched parentheses at line %ld\n", tok_line(*token));
+            exit(1);
+          }
+          return lhs;
+        case TK_COMMA:
+        case TK_LBRACE:
+        case TK_SEMI:
+        case TK_EOF:
+          return lhs;
+        default:
+          fprintf(stderr, "invalid expression at line %ld\n", tok_line(*token));
+          exit(1);
+      }
     }
 
-    node_t *expr_node = make_node(ND_EXPR);
-    pop(expr_stack, &(expr_node->rhs));
-    pop(expr_stack, &(expr_node->lhs));
-    pop(op_stack, &(expr_node->op));
-    push(expr_stack, &expr_node);
+    int precedence = op_table[type].precedence;
+    if (precedence < min_precedence)
+      return lhs;
+
+    advance(token);
+    lhs = make_expr_node(op, lhs, parse_binary(token, precedence + 1));
   }
+}
 
-  // return the top of expr_stack
-  node_t *expr_node = NULL;
-  gettop(expr_stack, &expr_node);
-  return expr_node;
+// parse expression
+// expression = unary {operator unary} ;
+// operator = "+" | "-" | "*" | "/" | "&&" | "||" | ">" | "<" | ">=" | "<=" | "==" | "!=" ;
+static node_t *parse_expr(token_t **token)
+{
+  return parse_binary(token, 1);
 }
 
 // parse expression statement
@@ -479,17 +360,17 @@ static node_t *parse_expr(token_t **token, token_t *end_token)
 // [identifier "="] expression ";" ;
 static node_t *parse_expr_stmt(token_t **token)
 {
-  if (expect_type(token, TK_ID) && expect_next_str(token, "=")) {
+  if (expect_type(token, TK_ID) && expect_next_type(token, TK_ASSIGN)) {
     // TODO:
     // * check if the identifier is a left value
-    symbol_t *var_symbol = find_symbol_by_tok(var_scope, *token);
-    symbol_t *func_symbol = find_symbol_by_tok(func_scope, *token);
+    symbol_t *var_symbol = find_symbol_by_tok(NS_VAR, *token);
+    symbol_t *func_symbol = find_symbol_by_tok(NS_FUNC, *token);
     if (!var_symbol) {
-      fprintf(stderr, "use of undeclared variable \"%s\" at line %ld\n", tok2cstr(*token), (*token)->line);
+      fprintf(stderr, "use of undeclared variable \"%s\" at line %ld\n", tok_atom(*token)->name, tok_line(*token));
       exit(1);
     }
     if (func_symbol) {
-      fprintf(stderr, "function \"%s\" cannot be used as a variable at line %ld\n", tok2cstr(var_symbol->token), var_symbol->token->line);
+      fprintf(stderr, "function \"%s\" cannot be used as a variable at line %ld\n", var_symbol->name, tok_line(var_symbol->token));
       exit(1);
     }
 
@@ -497,25 +378,25 @@ static node_t *parse_expr_stmt(token_t **token)
 
     advance(token);
 
-    consume(token, "=");
+    consume(token, TK_ASSIGN);
 
-    node_t *expr_node = parse_expr(token, NULL);
+    node_t *expr_node = parse_expr(token);
 
-    if (!consume(token, ";")) {
-      fprintf(stderr, "an expression statement must end with \";\" at line %ld\n", (*token)->line);
+    if (!consume(token, TK_SEMI)) {
+      fprintf(stderr, "an expression statement must end with \";\" at line %ld\n", tok_line(*token));
       exit(1);
     }
 
     node_t *expr_stmt_node = make_node(ND_EXPR_STMT);
     expr_stmt_node->lhs = var_node;
-    expr_stmt_node->op = make_node(ND_ASSIGN);
+    expr_stmt_node->op = ND_ASSIGN;
     expr_stmt_node->rhs = expr_node;
     return expr_stmt_node;
   } else {
-    node_t *expr_node = parse_expr(token, NULL);
+    node_t *expr_node = parse_expr(token);
 
-    if (!consume(token, ";")) {
-      fprintf(stderr, "an expression statement must end with \";\" at line %ld\n", (*token)->line);
+    if (!consume(token, TK_SEMI)) {
+      fprintf(stderr, "an expression statement must end with \";\" at line %ld\n", tok_line(*token));
       exit(1);
     }
 
@@ -532,57 +413,57 @@ static node_t *parse_decl_stmt(token_t **token)
 {
   // kat does not support multiple declarations statement currently
   // each declaration must be divided one by one
-  if (consume(token, "let")) {
+  if (consume(token, TK_KW_LET)) {
     token_t *var_tok = NULL;
-    node_t *op_node = NULL;
+    ND_TYPE op = ND_NIL;
     node_t *expr_node = NULL;
 
     if (expect_type(token, TK_ID)) {
       var_tok = *token;
       advance(token);
     } else {
-      fprintf(stderr, "expected variable name at line %ld\n", (*token)->line);
+      fprintf(stderr, "expected variable name at line %ld\n", tok_line(*token));
       exit(1);
     }
 
-    if (!consume(token, ":")) {
-      fprintf(stderr, "expected declaration seperator at line %ld\n", (*token)->line);
+    if (!consume(token, TK_COLON)) {
+      fprintf(stderr, "expected declaration seperator at line %ld\n", tok_line(*token));
       exit(1);
     }
 
-    symbol_t *var_symbol = find_symbol_by_tok(var_scope, var_tok);
-    symbol_t *func_symbol = find_symbol_by_tok(func_scope, var_tok);
+    symbol_t *var_symbol = find_symbol_by_tok(NS_VAR, var_tok);
+    symbol_t *func_symbol = find_symbol_by_tok(NS_FUNC, var_tok);
     if (var_symbol) {
-      fprintf(stderr, "redeclaration of \"%s\" at line %ld\n", var_symbol->name, var_tok->line);
-      fprintf(stderr, "variable \"%s\" was first defined at line %ld\n", var_symbol->name, var_symbol->token->line);
+      fprintf(stderr, "redeclaration of \"%s\" at line %ld\n", var_symbol->name, tok_line(var_tok));
+      fprintf(stderr, "variable \"%s\" was first defined at line %ld\n", var_symbol->name, tok_line(var_symbol->token));
       exit(1);
     }
     if (func_symbol) {
-      fprintf(stderr, "\"%s\" is a function and cannot be declared as a variable at line %ld\n", func_symbol->name, var_tok->line);
-      fprintf(stderr, "function \"%s\" was first defined at line %ld\n", func_symbol->name, func_symbol->token->line);
+      fprintf(stderr, "\"%s\" is a function and cannot be declared as a variable at line %ld\n", func_symbol->name, tok_line(var_tok));
+      fprintf(stderr, "function \"%s\" was first defined at line %ld\n", func_symbol->name, tok_line(func_symbol->token));
       exit(1);
     }
 
     node_t *var_node = make_decl_var_node(var_tok, *token);
-    add_symbol(var_scope, var_node->var);
+    add_symbol(NS_VAR, var_node->var);
     advance(token);
 
-    if (consume(token, "=")) {  // the declared variable is initialized
-      op_node = make_node(ND_ASSIGN);
-      expr_node = parse_expr(token, NULL);
+    if (consume(token, TK_ASSIGN)) {  // the declared variable is initialized
+      op = ND_ASSIGN;
+      expr_node = parse_expr(token);
 
       // TODO: type checking
       // * see if the type of the expression is consistent with the variable
     }
 
-    if (!consume(token, ";")) { // the declared variable is unintialized
-      fprintf(stderr, "a declaration statement should end with \";\" at line %ld\n", (*token)->line);
+    if (!consume(token, TK_SEMI)) { // the declared variable is unintialized
+      fprintf(stderr, "a declaration statement should end with \";\" at line %ld\n", tok_line(*token));
       exit(1);
     }
 
     node_t *decl = make_node(ND_DECL_STMT);
     decl->lhs = var_node;
-    decl->op = op_node;
+    decl->op = op;
     decl->rhs = expr_node;
     return decl;
   } else {
@@ -595,12 +476,12 @@ static node_t *parse_decl_stmt(token_t **token)
 // "if" condition block {"elif" block} ["else" block] ;
 static node_t *parse_if(token_t **token)
 {
-  if (consume(token, "if")) {
-    node_t *if_cond_node = parse_expr(token, NULL);
+  if (consume(token, TK_KW_IF)) {
+    node_t *if_cond_node = parse_expr(token);
     node_t *if_stmt_node = parse_stmt_block(token, false);
 
     node_t *else_stmt_node = NULL;
-    if (consume(token, "else"))
+    if (consume(token, TK_KW_ELSE))
       else_stmt_node = parse_stmt_block(token, false);
 
     node_t *if_node = make_node(ND_IF);
@@ -618,9 +499,9 @@ static node_t *parse_if(token_t **token)
 // "while" condition block ;
 static node_t *parse_while(token_t **token)
 {
-  if (consume(token, "while")) {
+  if (consume(token, TK_KW_WHILE)) {
     node_t *while_node = make_node(ND_WHILE);
-    node_t *while_cond_node = parse_expr(token, NULL);
+    node_t *while_cond_node = parse_expr(token);
     node_t *while_stmt_node = parse_stmt_block(token, false);
     while_node->cond = while_cond_node;
     while_node->while_stmt = while_stmt_node;
@@ -632,12 +513,12 @@ static node_t *parse_while(token_t **token)
 
 static node_t *parse_return(token_t **token)
 {
-  if (consume(token, "return")) {
+  if (consume(token, TK_KW_RETURN)) {
     node_t *return_node = make_node(ND_RETURN);
-    return_node->rhs = parse_expr(token, NULL);
+    return_node->rhs = parse_expr(token);
 
-    if (!consume(token, ";")) {
-      fprintf(stderr, "expected ending \";\" for return statement at line %ld\n", (*token)->line);
+    if (!consume(token, TK_SEMI)) {
+      fprintf(stderr, "expected ending \";\" for return statement at line %ld\n", tok_line(*token));
       exit(1);
     }
 
@@ -649,83 +530,79 @@ static node_t *parse_return(token_t **token)
 // block = "{" {statement} "}" ;
 static node_t *parse_stmt_block(token_t **token, bool is_func_body)
 {
-  if (consume(token, "{")) {
+  if (expect_type(token, TK_LBRACE)) {
+    // unmatched left brace is matched with EOF by the lexer
+    token_t *right_close_brace = tok_match(*token);
+    advance(token);
+
     node_t stmt_head = { .next = NULL };
     node_t *curr_stmt = &stmt_head;
 
     if (!is_func_body)
       enter_scope();
 
-    while (!consume(token, "}")) {
-      if (expect_str(token, "let")) {
-        curr_stmt->next = parse_decl_stmt(token);
-        curr_stmt = curr_stmt->next;
-        continue;
-      }
-
-      if (expect_str(token, "if")) {
-        curr_stmt->next = parse_if(token);
-        curr_stmt = curr_stmt->next;
-        continue;
-      }
-
-      if (expect_str(token, "while")) {
-        curr_stmt->next = parse_while(token);
-        curr_stmt = curr_stmt->next;
-        continue;
-      }
-
-      // TODO: parse break/continue/return statement
-      if (expect_str(token, "return")) {
-        curr_stmt->next = parse_return(token);
-        curr_stmt = curr_stmt->next;
-        continue;
+    while ((*token) != right_close_brace) {
+      // TODO: parse break/continue statement
+      switch ((*token)->type) {
+        case TK_KW_LET:    curr_stmt->next = parse_decl_stmt(token); break;
+        case TK_KW_IF:     curr_stmt->next = parse_if(token); break;
+        case TK_KW_WHILE:  curr_stmt->next = parse_while(token); break;
+        case TK_KW_RETURN: curr_stmt->next = parse_return(token); break;
+        case TK_EOF:
+          fprintf(stderr, "expected \"}\" at the end of statement block at line %ld\n", tok_line(*token));
+          exit(1);
+        default:           curr_stmt->next = parse_expr_stmt(token); break;
       }
-
-      curr_stmt->next = parse_expr_stmt(token);
       curr_stmt = curr_stmt->next;
     }
 
+    if (!consume(token, TK_RBRACE)) {
+      fprintf(stderr, "expected \"}\" at the end of statement block at line %ld\n", tok_line(*token));
+      exit(1);
+    }
+
     leave_scope();
 
     curr_stmt->next = NULL;
     return stmt_head.next;
   } else {
-    fprintf(stderr, "a statement block must begin with \"{\" at line %ld\n", (*token)->line);
+    fprintf(stderr, "a statement block must begin with \"{\" at line %ld\n", tok_line(*token));
     exit(1);
   }
 }
 
+// types of params, gathered to intern the signature of function
+DEFINE_SMALL_VEC(type_vec, type_t *, 8)
+
 // function = "func" identifier "(" parameter-list ")" ["=>", type] block ;
 // parameter-list = [parameter {"," parameter}] ;
 // parameter = identifier ":" type ;
 // block = "{" {statement} "}" ;
 static node_t *parse_func(token_t **token)
 {
-  if (consume(token, "func")) {
+  if (consume(token, TK_KW_FUNC)) {
     // parse function name
     token_t *func_tok = NULL;
     if (expect_type(token, TK_ID)) {
       func_tok = *token;
       advance(token);
     } else {
-      fprintf(stderr, "expected function name at line %ld\n", (*token)->line);
+      fprintf(stderr, "expected function name at line %ld\n", tok_line(*token));
       exit(1);
     }
 
     enter_scope();
 
     // parse parameter list
-    size_t params_num = 0;
     node_t params_head = { .next = NULL };
     node_t *curr_param = &params_head;
-    type_t types_head = { .next = NULL };
-    type_t *curr_type = &types_head;
-    if (consume(token, "(")) {
+    type_vec_t params_type;
+    type_vec_init(&params_type);
+    if (consume(token, TK_LPAREN)) {
       // if the next token is ")" then the function has no parameters
       // we consume ")" and do nothing
       // otherwise the function has parameters
-      if (!consume(token, ")")) {
+      if (!consume(token, TK_RPAREN)) {
         while (true) {
           token_t *var_tok = NULL;
           token_t *type_tok = NULL;
@@ -733,76 +610,74 @@ static node_t *parse_func(token_t **token)
             var_tok = *token;
             advance(token);
           } else {
-            fprintf(stderr, "expected parameter name for function %s at line %ld\n", tok2cstr(func_tok), (*token)->line);
+            fprintf(stderr, "expected parameter name for function %s at line %ld\n", tok_atom(func_tok)->name, tok_line(*token));
             exit(1);
           }
 
-          if (!consume(token, ":")) {
-            fprintf(stderr, "expected name-type seperator \":\" for function %s at line %ld\n", tok2cstr(func_tok), (*token)->line);
+          if (!consume(token, TK_COLON)) {
+            fprintf(stderr, "expected name-type seperator \":\" for function %s at line %ld\n", tok_atom(func_tok)->name, tok_line(*token));
             exit(1);
           }
 
-          if (expect_type(token, TK_KW) || expect_type(token, TK_ID)) {
+          if (is_kw_type((*token)->type) || expect_type(token, TK_ID)) {
             type_tok = *token;
             advance(token);
           } else {
-            fprintf(stderr, "expected type specifier for parameter for function %s at line %ld\n", tok2cstr(func_tok), (*token)->line);
+            fprintf(stderr, "expected type specifier for parameter for function %s at line %ld\n", tok_atom(func_tok)->name, tok_line(*token));
             exit(1);
           }
 
-          symbol_t *var_symbol = find_symbol_by_tok(var_scope, var_tok);
+          symbol_t *var_symbol = find_symbol_by_tok(NS_VAR, var_tok);
           if (var_symbol) {
-            fprintf(stderr, "redeclaration of parameter \"%s\" at line %ld\n", var_symbol->name, var_tok->line);
+            fprintf(stderr, "redeclaration of parameter \"%s\" at line %ld\n", var_symbol->name, tok_line(var_tok));
             exit(1);
           }
 
-          params_num++;
-
-          curr_type->next = make_type(type_tok);
-          curr_type = curr_type->next;
+          type_t *param_type = get_type(type_tok);
+          type_vec_push(&params_type, param_type);
 
-          if (!is_valid_type(curr_type->name)) {
-            fprintf(stderr, "invalid type for parameter \"%s\" at line %ld", tok2cstr(var_tok), var_tok->line);
+          if (param_type == basic_type(KAT_NIL)) {
+            fprintf(stderr, "invalid type for parameter \"%s\" at line %ld", tok_atom(var_tok)->name, tok_line(var_tok));
             exit(1);
           }
 
           curr_param->next = make_decl_var_node(var_tok, type_tok);
           curr_param = curr_param->next;
-          add_symbol(var_scope, curr_param->var);
+          add_symbol(NS_VAR, curr_param->var);
 
-          if (consume(token, ")")) {
+          if (consume(token, TK_RPAREN)) {
             break;
-          } else if (consume(token, ",")) {
+          } else if (consume(token, TK_COMMA)) {
             continue;
           } else {
-            fprintf(stderr, "expected right paren \")\" at the end of parameter list for function %s at line %ld\n", tok2cstr(func_tok), (*token)->line);
+            fprintf(stderr, "expected right paren \")\" at the end of parameter list for function %s at line %ld\n", tok_atom(func_tok)->name, tok_line(*token));
             exit(1);
           }
         }
       }
     } else {
-      fprintf(stderr, "expected left paren \"(\" at line %ld\n", (*token)->len);
+      fprintf(stderr, "expected left paren \"(\" at line %ld\n", tok_line(*token));
       exit(1);
     }
 
     // parse return type
     type_t *return_type = NULL;
-    if (consume(token, "=>")) {
-      return_type = make_type(*token);
+    if (consume(token, TK_ARROW)) {
+      return_type = get_type(*token);
       advance(token);
     } else {
-      return_type = make_type(NULL);
+      return_type = get_type(NULL);
     }
 
     // make a symbol of function definition and add it to symbol table
-    symbol_t *func_symbol = find_symbol_by_tok(func_scope, func_tok);
+    symbol_t *func_symbol = find_symbol_by_tok(NS_FUNC, func_tok);
     if (func_symbol) {
-      fprintf(stderr, "redeclaration of function \"%s\" at line %ld\n", func_symbol->name, func_tok->line);
-      fprintf(stderr, "function \"%s\" was first defined at line %ld\n", func_symbol->name, func_symbol->token->line);
+      fprintf(stderr, "redeclaration of function \"%s\" at line %ld\n", func_symbol->name, tok_line(func_tok));
+      fprintf(stderr, "function \"%s\" was first defined at line %ld\n", func_symbol->name, tok_line(func_symbol->token));
       exit(1);
     }
-    func_symbol = make_fn_symbol(func_tok, return_type, types_head.next, params_num);
-    add_symbol(func_scope, func_symbol);
+    func_symbol = make_fn_symbol(func_tok, func_type(return_type, params_type.data, params_type.size));
+    add_symbol(NS_FUNC, func_symbol);
 
     // parse function body
     // do not enter new scope
@@ -814,7 +689,7 @@ static node_t *parse_func(token_t **token)
     func_node->body = func_body;
     return func_node;
   } else {
-    fprintf(stderr, "a function must begin with \"func\" at line %ld\n", (*token)->line);
+    fprintf(stderr, "a function must begin with \"func\" at line %ld\n", tok_line(*token));
     exit(1);
   }
 }
@@ -824,7 +699,8 @@ node_t *parse(token_t *token_list)
   node_t *tree = make_node(ND_PROG);
   token_t *token = token_list;
 
-  func_scope->symbol_table = new_hashmap(128);
+  init_scope();
+  init_types();
 
   node_t func_head = { .next = NULL };
   node_t *curr_func = &func_head;
@@ -841,7 +717,7 @@ node_t *parse(token_t *token_list)
 
 static void dump(int depth, char *fmt, ...) __attribute__((format(printf, 2, 3)));
 static void dump_num(node_t *node, int depth);
-static void dump_op(node_t *node, int depth);
+static void dump_op(ND_TYPE op, int depth);
 static void dump_fncall(node_t *node, int depth);
 static void dump_var(node_t *node, int depth);
 static void dump_expr(node_t *node, int depth);
@@ -868,11 +744,13 @@ static void dump_num(node_t *node, int depth)
   dump(depth, "Num: %ld\n", node->ival);
 }
 
-// dump operator node
-static void dump_op(node_t *node, int depth)
+// dump operator
+static void dump_op(ND_TYPE op, int depth)
 {
   static char *op_list[] = {
     [ND_ASSIGN] = "Assign: =",
+    [ND_POS] = "Positive: +",
+    [ND_NEG] = "Negative: -",
     [ND_ADD] = "Add: +",
     [ND_SUB] = "Subtract: -",
     [ND_MUL] = "Multiply: *",
@@ -886,7 +764,7 @@ static void dump_op(node_t *node, int depth)
     [ND_GT] = "GreaterThan: >",
     [ND_GE] = "GreaterThanOrEqualTo: >="
   };
-  dump(depth, "%s\n", op_list[node->type]);
+  dump(depth, "%s\n", op_list[op]);
 }
 
 // dump function call node
@@ -897,15 +775,7 @@ static void dump_fncall(node_t *node, int depth)
   for (node_t *param = node->params; param != NULL; param = param->next)
   {
     dump(depth + 1, "param%d:\n", ++n);
-    switch (param->type) {
-      case ND_EXPR: dump_expr(param, depth + 2); break;
-      case ND_NUM: dump_num(param, depth + 2); break;
-      case ND_VAR: dump_var(param, depth + 2); break;
-      case ND_FNCALL: dump_fncall(param, depth + 2); break;
-      default:
-        fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
-        exit(1);
-    }
+    dump_expr(param, depth + 2);
   }
 }
 
@@ -914,31 +784,54 @@ static void dump_var(node_t *node, int depth)
 {
   dump(depth, "Variable: %s %s\n",
        node->var ? node->var->name : "nil",
-       node->var ? type_list[node->var->type->kind] : "nil");
+       node->var ? node->var->type->name : "nil");
 }
 
+// a frame either dumps a node, or the operator of an expression node
+typedef struct dump_frame_t
+{
+  node_t *node;
+  int depth;
+  bool is_op;
+} dump_frame_t;
+
+DEFINE_SMALL_VEC(dump_stack, dump_frame_t, 64)
+
 // dump expression
+// operands of an expression are expressions, numbers, variables or function calls
+// the tree is walked iteratively, so that deep expressions do not overflow the native stack
 static void dump_expr(node_t *node, int depth)
 {
-  dump(depth, "Expr:\n");
-  switch (node->lhs->type) {
-    case ND_EXPR: dump_expr(node->lhs, depth + 1); break;
-    case ND_NUM: dump_num(node->lhs, depth + 1); break;
-    case ND_VAR: dump_var(node->lhs, depth + 1); break;
-    case ND_FNCALL: dump_fncall(node->lhs, depth + 1); break;
-    default:
-      fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
-      exit(1);
-  }
-  dump_op(node->op, depth + 1);
-  switch (node->rhs->type) {
-    case ND_EXPR: dump_expr(node->rhs, depth + 1); break;
-    case ND_NUM: dump_num(node->rhs, depth + 1); break;
-    case ND_VAR: dump_var(node->rhs, depth + 1); break;
-    case ND_FNCALL: dump_fncall(node->rhs, depth + 1); break;
-    default:
-      fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
-      exit(1);
+  dump_stack_t stack;
+  dump_stack_init(&stack);
+  dump_stack_push(&stack, (dump_frame_t) { node, depth, false });
+
+  while (!dump_stack_empty(&stack)) {
+    dump_frame_t frame = dump_stack_pop(&stack);
+    node = frame.node;
+    depth = frame.depth;
+
+    if (frame.is_op) {
+      dump_op(node->op, depth);
+      continue;
+    }
+
+    switch (node->type) {
+      case ND_EXPR: break;
+      case ND_NUM: dump_num(node, depth); continue;
+      case ND_VAR: dump_var(node, depth); continue;
+      case ND_FNCALL: dump_fncall(node, depth); continue;
+      default:
+        fprintf(stderr, "not implemented yet in %s at line %d\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    // lhs, operator and rhs are dumped in order, so they are pushed in reverse
+    dump(depth, "Expr:\n");
+    dump_stack_push(&stack, (dump_frame_t) { node->rhs, depth + 1, false });
+    dump_stack_push(&stack, (dump_frame_t) { node, depth + 1, true });
+    if (node->lhs)  // unary expression has no lhs
+      dump_stack_push(&stack, (dump_frame_t) { node->lhs, depth + 1, false });
   }
 }
 
@@ -946,48 +839,22 @@ static void dump_expr(node_t *node, int depth)
 static void dump_expr_stmt(node_t *node, int depth)
 {
   dump(depth, "ExprStmt:\n");
-  if (node->op != NULL) { // assignment
+  if (node->op == ND_ASSIGN) { // assignment
     dump_var(node->lhs, depth + 1);
     dump_op(node->op, depth + 1);
-    switch (node->rhs->type) {
-      case ND_EXPR: dump_expr(node->rhs, depth + 1); break;
-      case ND_VAR: dump_expr(node->rhs, depth + 1); break;
-      case ND_NUM: dump_num(node->rhs, depth + 1); break;
-      case ND_FNCALL: dump_fncall(node->rhs, depth + 1); break;
-      default:
-        fprintf(stderr, "not implemnted in %s at line %d\n", __FILE__, __LINE__);
-        exit(1);
-    }
-  } else {  // just expression
-    switch (node->rhs->type) {
-      case ND_EXPR: dump_expr(node->rhs, depth + 1); break;
-      case ND_VAR: dump_expr(node->rhs, depth + 1); break;
-      case ND_NUM: dump_num(node->rhs, depth + 1); break;
-      case ND_FNCALL: dump_fncall(node->rhs, depth + 1); break;
-      default:
-        fprintf(stderr, "not implemnted in %s at line %d\n", __FILE__, __LINE__);
-        exit(1);
-    }
   }
+  dump_expr(node->rhs, depth + 1);
 }
 
 // dump declaration statement
 static void dump_decl_stmt(node_t *node, int depth)
 {
   dump(depth, "DeclStmt ");
-  if (node->op != NULL) { // initialized declaration
+  if (node->op == ND_ASSIGN) { // initialized declaration
     fprintf(stdout, "(initialized):\n");
     dump_var(node->lhs, depth + 1);
     dump_op(node->op, depth + 1);
-    switch (node->rhs->type) {
-      case ND_EXPR: dump_expr(node->rhs, depth + 1); break;
-      case ND_VAR: dump_expr(node->rhs, depth + 1); break;
-      case ND_NUM: dump_num(node->rhs, depth + 1); break;
-      case ND_FNCALL: dump_fncall(node->rhs, depth + 1); break;
-      default:
-        fprintf(stderr, "not implemnted in %s at line %d\n", __FILE__, __LINE__);
-        exit(1);
-    }
+    dump_expr(node->rhs, depth + 1);
   } else {  // uninitialized declaration
     fprintf(stdout, "(uninitialized):\n");
     dump_var(node->lhs, depth + 1);
@@ -1022,10 +889,7 @@ static void dump_while_stmt(node_t *node, int depth)
 static void dump_return_stmt(node_t *node, int depth)
 {
   dump(depth, "ReturnStmt:\n");
-  if (node->rhs->type == ND_EXPR)
-    dump_expr(node->rhs, depth + 1);
-  else if (node->rhs->type == ND_NUM)
-    dump_num(node->rhs, depth + 1);
+  dump_expr(node->rhs, depth + 1);
 }
 
 // dump block of statements
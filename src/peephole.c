@@ -0,0 +1,477 @@
+#include "x86.h"
+#include "arena.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// peephole optimization over the instructions of a function
+//
+// each rule looks at a short window of instructions starting at one of them,
+// and rewrites it in place, the instructions deleted become X86_NOP until the pass ends
+// the rules are tried at every instruction, and the pass repeats until no rule applies,
+// since one rewrite often exposes another (e.g. a jump threaded to the next label)
+//
+// codegen never keeps the flags live across a label or a jump:
+// every jcc and setcc follows the cmp or test it depends on in the same block,
+// so the rules changing the flags only look that far for their readers
+
+// how far the rules look ahead, which keeps the pass linear in long blocks
+#define WINDOW 32
+
+typedef struct rule_t
+{
+  char *name;
+  bool (*apply)(x86_vec_t *code, size_t i);  // try the rule at instruction i
+  size_t hits;
+} rule_t;
+
+// instructions of the compilation, before and after the rules
+static size_t ins_before;
+static size_t ins_after;
+
+// position of the code at the labels of blocks in current function, by the ids of labels
+// that is the first instruction after the label and the labels following it
+static size_t *labels;
+static uint32_t labels_num;
+
+static x86_ins_t *at(x86_vec_t *code, size_t i)
+{
+  return x86_vec_at(code, i);
+}
+
+// the first instruction after i which is not deleted, code->size if there is none
+static size_t next_live(x86_vec_t *code, size_t i)
+{
+  do {
+    i++;
+  } while (i < code->size && at(code, i)->op == X86_NOP);
+  return i;
+}
+
+static void delete(x86_vec_t *code, size_t i)
+{
+  at(code, i)->op = X86_NOP;
+}
+
+static bool is_imm(x86_opd_t opd, int64_t imm)
+{
+  return opd.kind == X86_OPD_IMM && opd.imm == imm;
+}
+
+// labels, jumps, directives and raw text end a window, nothing is known across them
+static bool is_barrier(x86_ins_t *ins)
+{
+  switch (ins->op) {
+    case X86_LABEL:
+    case X86_TEXT:
+    case X86_SECTION:
+    case X86_GLOBAL:
+    case X86_STRING:
+    case X86_SYSCALL:
+    case X86_JMP:
+    case X86_JCC:
+    case X86_RET:
+      return true;
+    default:
+      return false;
+  }
+}
+
+#define REG_BIT(reg) ((uint32_t) 1 << (reg))
+
+// registers live at return, the return value and the ones preserved for the caller
+static uint32_t ret_live()
+{
+  uint32_t live = REG_BIT(X86_EAX) | REG_BIT(X86_EBX) | REG_BIT(X86_ESP) | REG_BIT(X86_EBP);
+  if (target == TARGET_X86_64)
+    return live | REG_BIT(X86_R12) | REG_BIT(X86_R13) | REG_BIT(X86_R14) | REG_BIT(X86_R15);
+  return live | REG_BIT(X86_ESI) | REG_BIT(X86_EDI);
+}
+
+// registers read by call, the arguments in registers (x86_64), and %eax,
+// which holds the number of vector registers used by varargs
+static uint32_t call_reads()
+{
+  if (target == TARGET_X86_64)
+    return REG_BIT(X86_ESP) | REG_BIT(X86_EAX) | REG_BIT(X86_EDI) | REG_BIT(X86_ESI) | REG_BIT(X86_EDX) |
+           REG_BIT(X86_ECX) | REG_BIT(X86_R8) | REG_BIT(X86_R9);
+  return REG_BIT(X86_ESP);
+}
+
+// registers clobbered by call, the ones not preserved by the callee
+static uint32_t call_writes()
+{
+  uint32_t clobbered = REG_BIT(X86_EAX) | REG_BIT(X86_ECX) | REG_BIT(X86_EDX);
+  if (target == TARGET_X86_64)
+    return clobbered | REG_BIT(X86_ESI) | REG_BIT(X86_EDI) | REG_BIT(X86_R8) | REG_BIT(X86_R9) |
+           REG_BIT(X86_R10) | REG_BIT(X86_R11);
+  return clobbered;
+}
+
+// registers used by the operand, as a value or as the base of memory
+static uint32_t opd_regs(x86_opd_t opd)
+{
+  return opd.kind == X86_OPD_REG || opd.kind == X86_OPD_MEM ? REG_BIT(opd.reg) : 0;
+}
+
+// registers read by the instruction
+static uint32_t reads(x86_ins_t *ins)
+{
+  switch (ins->op) {
+    case X86_MOV:
+    case X86_MOVZB:
+      return opd_regs(ins->src) | (ins->dst.kind == X86_OPD_MEM ? opd_regs(ins->dst) : 0);
+    case X86_LEA:
+      return opd_regs(ins->src);
+    case X86_XOR:
+      // xorl %r, %r only writes %r
+      if (ins->src.kind == X86_OPD_REG && x86_same_opd(ins->src, ins->dst))
+        return 0;
+      return opd_regs(ins->src) | opd_regs(ins->dst);
+    case X86_ADD:
+    case X86_SUB:
+    case X86_IMUL:
+    case X86_SHL:
+    case X86_CMP:
+    case X86_TEST:
+      return opd_regs(ins->src) | opd_regs(ins->dst);
+    case X86_NEG:
+    case X86_SETCC:  // the upper bytes are kept
+      return opd_regs(ins->dst);
+    case X86_CLTD:
+      return REG_BIT(X86_EAX);
+    case X86_IDIV:
+      return REG_BIT(X86_EAX) | REG_BIT(X86_EDX) | opd_regs(ins->dst);
+    case X86_PUSH:
+      return opd_regs(ins->src) | REG_BIT(X86_ESP);
+    case X86_POP:
+      return REG_BIT(X86_ESP);
+    case X86_CALL:
+      return call_reads();
+    default:
+      return UINT32_MAX;
+  }
+}
+
+// registers overwritten by the instruction
+static uint32_t writes(x86_ins_t *ins)
+{
+  switch (ins->op) {
+    case X86_MOV:
+    case X86_MOVZB:
+    case X86_LEA:
+    case X86_ADD:
+    case X86_SUB:
+    case X86_IMUL:
+    case X86_XOR:
+    case X86_SHL:
+    case X86_NEG:
+      return ins->dst.kind == X86_OPD_REG ? REG_BIT(ins->dst.reg) : 0;
+    case X86_CLTD:
+      return REG_BIT(X86_EDX);
+    case X86_IDIV:
+      return REG_BIT(X86_EAX) | REG_BIT(X86_EDX);
+    case X86_POP:
+      return REG_BIT(X86_ESP) | (ins->dst.kind == X86_OPD_REG ? REG_BIT(ins->dst.reg) : 0);
+    case X86_PUSH:
+      return REG_BIT(X86_ESP);
+    case X86_CALL:
+      return call_writes();
+    default:
+      return 0;
+  }
+}
+
+// true if the flags set by instruction i are never read
+static bool flags_dead(x86_vec_t *code, size_t i)
+{
+  size_t j = i;
+  for (int n = 0; n < WINDOW; n++) {
+    j = next_live(code, j);
+    if (j == code->size)
+      return true;
+    switch (at(code, j)->op) {
+      case X86_JCC:
+      case X86_SETCC:
+        return false;
+      case X86_ADD:
+      case X86_SUB:
+      case X86_IMUL:
+      case X86_XOR:
+      case X86_SHL:
+      case X86_NEG:
+      case X86_CMP:
+      case X86_TEST:
+      case X86_IDIV:
+      case X86_CALL:
+        return true;
+      default:
+        if (is_barrier(at(code, j)))
+          return true;
+    }
+  }
+  return false;
+}
+
+/* rules */
+
+// movl %r, %r =>
+static bool self_move(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_MOV || ins->src.kind != X86_OPD_REG || !x86_same_opd(ins->src, ins->dst))
+    return false;
+  delete(code, i);
+  return true;
+}
+
+// movl x, %r, where %r is overwritten before it is read =>
+static bool dead_move(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_MOV || ins->dst.kind != X86_OPD_REG)
+    return false;
+  if (ins->dst.reg == X86_ESP || ins->dst.reg == X86_EBP)
+    return false;
+
+  uint32_t reg = REG_BIT(ins->dst.reg);
+  size_t j = i;
+  for (int n = 0; n < WINDOW; n++) {
+    j = next_live(code, j);
+    if (j < code->size && at(code, j)->op == X86_RET && !(reg & ret_live())) {
+      delete(code, i);
+      return true;
+    }
+    if (j == code->size || is_barrier(at(code, j)) || reads(at(code, j)) & reg)
+      return false;
+    if (writes(at(code, j)) & reg) {
+      delete(code, i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// movl %r, m; movl m, %s => movl %r, m; movl %r, %s
+// movl m, %r; movl %r, m => movl m, %r
+static bool reload(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  size_t j = next_live(code, i);
+  if (ins->op != X86_MOV || j == code->size)
+    return false;
+  x86_ins_t *next = at(code, j);
+  if (next->op != X86_MOV || !x86_same_opd(ins->dst, next->src))
+    return false;
+
+  if (ins->src.kind == X86_OPD_REG && ins->dst.kind == X86_OPD_MEM && next->dst.kind == X86_OPD_REG) {
+    next->src = ins->src;
+    return true;
+  }
+  if (ins->src.kind == X86_OPD_MEM && ins->dst.kind == X86_OPD_REG && x86_same_opd(ins->src, next->dst)) {
+    delete(code, j);
+    return true;
+  }
+  return false;
+}
+
+// movl $0, %r => xorl %r, %r
+static bool zero(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_MOV || !is_imm(ins->src, 0) || ins->dst.kind != X86_OPD_REG || !flags_dead(code, i))
+    return false;
+  ins->op = X86_XOR;
+  ins->src = ins->dst;
+  return true;
+}
+
+// cmpl $0, %r => testl %r, %r
+static bool test_zero(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_CMP || !is_imm(ins->src, 0) || ins->dst.kind != X86_OPD_REG)
+    return false;
+  ins->op = X86_TEST;
+  ins->src = ins->dst;
+  return true;
+}
+
+// addl $0, x; subl $0, x; imull $1, x =>
+static bool identity(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  bool is_identity = ((ins->op == X86_ADD || ins->op == X86_SUB) && is_imm(ins->src, 0)) ||
+                     (ins->op == X86_IMUL && is_imm(ins->src, 1));
+  if (!is_identity || !flags_dead(code, i))
+    return false;
+  delete(code, i);
+  return true;
+}
+
+// imull $2^k, x => shll $k, x
+static bool mul_pow2(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_IMUL || ins->src.kind != X86_OPD_IMM || !flags_dead(code, i))
+    return false;
+  uint32_t imm = ins->src.imm;
+  if (imm < 2 || (imm & (imm - 1)))
+    return false;
+  ins->op = X86_SHL;
+  ins->src = x86_imm(__builtin_ctz(imm));
+  return true;
+}
+
+// jmp l; l: =>
+static bool jump_next(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_JMP && ins->op != X86_JCC)
+    return false;
+  for (size_t j = next_live(code, i); j < code->size && at(code, j)->op == X86_LABEL; j = next_live(code, j)) {
+    if (x86_same_opd(at(code, j)->src, ins->src)) {
+      delete(code, i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// jcc l1; jmp l2; l1: => jncc l2; l1:
+static bool branch_over(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  size_t j = next_live(code, i);
+  if (ins->op != X86_JCC || j == code->size || at(code, j)->op != X86_JMP)
+    return false;
+  size_t k = next_live(code, j);
+  if (k == code->size || at(code, k)->op != X86_LABEL || !x86_same_opd(at(code, k)->src, ins->src))
+    return false;
+  ins->cc = x86_negate_cc(ins->cc);
+  ins->src = at(code, j)->src;
+  delete(code, j);
+  return true;
+}
+
+// the jump at the label of target, code->size if the label is followed by something else
+static size_t jump_at(x86_vec_t *code, x86_opd_t target)
+{
+  if (target.kind != X86_OPD_LABEL || target.id >= labels_num)
+    return code->size;
+  size_t j = labels[target.id];
+  while (j < code->size && (at(code, j)->op == X86_LABEL || at(code, j)->op == X86_NOP))
+    j = next_live(code, j);
+  return j < code->size && at(code, j)->op == X86_JMP ? j : code->size;
+}
+
+// jmp l1; ... l1: jmp l2 => jmp l2; ... l1: jmp l2
+// the chain of jumps is followed to its end, unless it is a loop,
+// and the jumps along it are retargeted too, so that every chain is walked once
+static bool jump_thread(x86_vec_t *code, size_t i)
+{
+  x86_ins_t *ins = at(code, i);
+  if (ins->op != X86_JMP && ins->op != X86_JCC)
+    return false;
+
+  x86_opd_t target = ins->src;
+  uint32_t hops = 0;
+  for (size_t j = jump_at(code, target); j < code->size; j = jump_at(code, target)) {
+    target = at(code, j)->src;
+    if (++hops > labels_num)
+      return false;
+  }
+  if (hops == 0)
+    return false;
+
+  x86_opd_t label = ins->src;
+  for (size_t j = jump_at(code, label); j < code->size; j = jump_at(code, label)) {
+    label = at(code, j)->src;
+    at(code, j)->src = target;
+  }
+  ins->src = target;
+  return true;
+}
+
+static rule_t rules[] = {
+  { "self-move", self_move, 0 },
+  { "dead-move", dead_move, 0 },
+  { "reload", reload, 0 },
+  { "zero", zero, 0 },
+  { "test-zero", test_zero, 0 },
+  { "identity", identity, 0 },
+  { "mul-pow2", mul_pow2, 0 },
+  { "jump-next", jump_next, 0 },
+  { "branch-over", branch_over, 0 },
+  { "jump-thread", jump_thread, 0 },
+};
+
+#define RULES_NUM (sizeof(rules) / sizeof(rules[0]))
+
+static size_t count_ins(x86_vec_t *code)
+{
+  size_t num = 0;
+  for (size_t i = 0; i < code->size; i++) {
+    X86_OP op = at(code, i)->op;
+    num += op != X86_NOP && op != X86_LABEL && op != X86_TEXT;
+  }
+  return num;
+}
+
+// index the labels of blocks, which are never deleted
+static void index_labels(x86_vec_t *code)
+{
+  labels_num = 0;
+  for (size_t i = 0; i < code->size; i++) {
+    x86_ins_t *ins = at(code, i);
+    if (ins->op == X86_LABEL && ins->src.kind == X86_OPD_LABEL && ins->src.id >= labels_num)
+      labels_num = ins->src.id + 1;
+  }
+  labels = arena_alloc(curr_arena, sizeof(size_t) * (labels_num + 1));
+  for (uint32_t id = 0; id < labels_num; id++)
+    labels[id] = code->size;
+  size_t pos = code->size;
+  for (size_t i = code->size; i-- > 0;) {
+    x86_ins_t *ins = at(code, i);
+    if (ins->op != X86_LABEL)
+      pos = i;
+    else if (ins->src.kind == X86_OPD_LABEL)
+      labels[ins->src.id] = pos;
+  }
+}
+
+// rewrite the instructions of function with the rules
+void peephole(x86_vec_t *code)
+{
+  ins_before += count_ins(code);
+  index_labels(code);
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < code->size; i++) {
+      for (size_t r = 0; r < RULES_NUM && at(code, i)->op != X86_NOP; r++) {
+        if (rules[r].apply(code, i)) {
+          rules[r].hits++;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  size_t num = 0;
+  for (size_t i = 0; i < code->size; i++) {
+    if (at(code, i)->op != X86_NOP)
+      *at(code, num++) = *at(code, i);
+  }
+  code->size = num;
+  ins_after += count_ins(code);
+}
+
+void peephole_report(FILE *fp)
+{
+  for (size_t r = 0; r < RULES_NUM; r++)
+    fprintf(fp, "%-12s %10zu hits\n", rules[r].name, rules[r].hits);
+  fprintf(fp, "%-12s %10zu -> %zu\n", "instructions", ins_before, ins_after);
+}
@@ -0,0 +1,332 @@
+#include "regalloc.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// linear scan register allocation (Poletto and Sarkar)
+//
+// instructions are numbered in layout order, instruction i reads its operands at 2i
+// and writes its dst at 2i+1, so a value last read by an instruction does not overlap
+// with the value it writes, and both may take the same register
+// the live interval of a value is the hull of the positions where it is live,
+// a value used in one block only is live between its first and last occurrence,
+// the others are extended over the blocks they are live in or out of,
+// which are computed by the usual backward dataflow over bitsets of these values
+// intervals are visited in order of start, and when all the registers are taken,
+// the interval ending last is spilled to memory for its whole lifetime
+
+#define NOWHERE UINT32_MAX
+
+typedef struct interval_t
+{
+  uint32_t value;
+  uint32_t start;
+  uint32_t end;
+  bool crosses_call;  // a call happens inside the interval, which clobbers %ecx and %edx
+  bool crosses_div;   // a division happens inside the interval, which clobbers %edx
+} interval_t;
+
+DEFINE_VEC(pos_vec, uint32_t)
+
+// state of current allocation
+static ir_func_t *func;
+static uint32_t *starts;
+static uint32_t *ends;
+static uint32_t *homes;   // the block a value is first seen in
+static bool *globals;     // if a value is seen in more than one block
+
+static void touch(uint32_t value, uint32_t pos, uint32_t bb)
+{
+  if (pos < starts[value])
+    starts[value] = pos;
+  if (pos > ends[value] || ends[value] == NOWHERE)
+    ends[value] = pos;
+  if (homes[value] == NOWHERE)
+    homes[value] = bb;
+  else if (homes[value] != bb)
+    globals[value] = true;
+}
+
+static bool is_value(operand_t opd)
+{
+  return opd.kind == OPD_TEMP || opd.kind == OPD_VAR;
+}
+
+static int compare_intervals(const void *x, const void *y)
+{
+  const interval_t *a = x;
+  const interval_t *b = y;
+  if (a->start != b->start)
+    return a->start < b->start ? -1 : 1;
+  return a->value < b->value ? -1 : a->value > b->value;
+}
+
+// true if one of the instructions (calls or divisions) happens between start and end
+// such an instruction i clobbers the registers between 2i and 2i+1
+static bool crosses(pos_vec_t *clobbers, uint32_t start, uint32_t end)
+{
+  // the first one not before start
+  size_t lo = 0, hi = clobbers->size;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (*pos_vec_at(clobbers, mid) < start)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < clobbers->size && *pos_vec_at(clobbers, lo) + 1 <= end;
+}
+
+static reg_set_t i386_regs = {
+  .regs = { X86_EBX, X86_ESI, X86_EDI, X86_ECX, X86_EDX },
+  .num = 5,
+  .callee_saved = 3,
+};
+
+// %esi and %edi pass arguments, which makes them caller-saved on x86_64
+static reg_set_t x86_64_regs = {
+  .regs = { X86_EBX, X86_R12, X86_R13, X86_R14, X86_R15,
+            X86_ESI, X86_EDI, X86_R8, X86_R9, X86_R10, X86_R11, X86_ECX, X86_EDX },
+  .num = 13,
+  .callee_saved = 5,
+};
+
+// the registers to allocate on target
+reg_set_t *target_regs()
+{
+  return target == TARGET_X86_64 ? &x86_64_regs : &i386_regs;
+}
+
+// true if the value of interval survives in the register
+static bool fits(int reg, interval_t *interval)
+{
+  reg_set_t *set = target_regs();
+  if (reg >= set->callee_saved && interval->crosses_call)
+    return false;
+  return set->regs[reg] != X86_EDX || !interval->crosses_div;
+}
+
+// compute the live intervals of values, return the number of them
+static uint32_t build_intervals(interval_t *intervals)
+{
+  uint32_t values_num = ir_values_num(func);
+  uint32_t blocks_num = func->blocks.size;
+  uint32_t *bb_starts = arena_alloc(curr_arena, sizeof(uint32_t) * blocks_num);
+  uint32_t *bb_ends = arena_alloc(curr_arena, sizeof(uint32_t) * blocks_num);
+  pos_vec_t calls, divs;
+  pos_vec_init(&calls);
+  pos_vec_init(&divs);
+
+  // parameters are defined on entry
+  for (size_t i = 0; i < func->params.size; i++)
+    touch(func->temps_num + i, 1, 0);
+
+  uint32_t pos = 2;
+  for (uint32_t b = 0; b < blocks_num; b++) {
+    bb_t *bb = *bb_vec_at(&func->blocks, b);
+    bb_starts[b] = pos;
+    for (size_t j = 0; j < bb->ins.size; j++, pos += 2) {
+      ins_t *ins = ins_vec_at(&bb->ins, j);
+      operand_t buf[2], *reads;
+      uint32_t reads_num = ir_reads(ins, buf, &reads);
+      for (uint32_t k = 0; k < reads_num; k++) {
+        if (is_value(reads[k]))
+          touch(ir_value(func, reads[k]), pos, b);
+      }
+      if (ir_writes(ins))
+        touch(ir_value(func, ins->dst), pos + 1, b);
+      if (ins->op == IR_CALL)
+        pos_vec_push(&calls, pos);
+      if (ins->op == IR_DIV)
+        pos_vec_push(&divs, pos);
+    }
+    bb_ends[b] = pos - 1;
+  }
+
+  // number the values seen in more than one block
+  uint32_t *global_index = arena_alloc(curr_arena, sizeof(uint32_t) * (values_num + 1));
+  uint32_t globals_num = 0;
+  for (uint32_t v = 0; v < values_num; v++)
+    global_index[v] = globals[v] ? globals_num++ : NOWHERE;
+
+  // liveness of the global values
+  if (globals_num > 0 && blocks_num > 1) {
+    size_t words = (globals_num + 63) / 64;
+    uint64_t *use = arena_calloc(curr_arena, blocks_num * words, sizeof(uint64_t));
+    uint64_t *def = arena_calloc(curr_arena, blocks_num * words, sizeof(uint64_t));
+    uint64_t *in = arena_calloc(curr_arena, blocks_num * words, sizeof(uint64_t));
+    uint64_t *out = arena_calloc(curr_arena, blocks_num * words, sizeof(uint64_t));
+
+    for (uint32_t b = 0; b < blocks_num; b++) {
+      bb_t *bb = *bb_vec_at(&func->blocks, b);
+      uint64_t *bb_use = use + b * words;
+      uint64_t *bb_def = def + b * words;
+      for (size_t j = 0; j < bb->ins.size; j++) {
+        ins_t *ins = ins_vec_at(&bb->ins, j);
+        operand_t buf[2], *reads;
+        uint32_t reads_num = ir_reads(ins, buf, &reads);
+        for (uint32_t k = 0; k < reads_num; k++) {
+          if (!is_value(reads[k]))
+            continue;
+          uint32_t g = global_index[ir_value(func, reads[k])];
+          if (g != NOWHERE && !(bb_def[g / 64] >> (g % 64) & 1))
+            bb_use[g / 64] |= (uint64_t) 1 << (g % 64);
+        }
+        if (ir_writes(ins)) {
+          uint32_t g = global_index[ir_value(func, ins->dst)];
+          if (g != NOWHERE)
+            bb_def[g / 64] |= (uint64_t) 1 << (g % 64);
+        }
+      }
+    }
+
+    // parameters are defined on entry
+    for (size_t i = 0; i < func->params.size; i++) {
+      uint32_t g = global_index[func->temps_num + i];
+      if (g != NOWHERE)
+        def[g / 64] |= (uint64_t) 1 << (g % 64);
+    }
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (uint32_t b = blocks_num; b-- > 0;) {
+        bb_t *bb = *bb_vec_at(&func->blocks, b);
+        uint64_t *bb_out = out + b * words;
+        uint64_t *bb_in = in + b * words;
+        for (size_t w = 0; w < words; w++) {
+          uint64_t live = 0;
+          for (uint32_t s = 0; s < bb->succ_num; s++)
+            live |= in[bb->succ[s]->id * words + w];
+          bb_out[w] = live;
+          live = use[b * words + w] | (live & ~def[b * words + w]);
+          if (live != bb_in[w]) {
+            bb_in[w] = live;
+            changed = true;
+          }
+        }
+      }
+    }
+
+    // extend the intervals over the blocks that values are live in or out of
+    uint32_t *values = arena_alloc(curr_arena, sizeof(uint32_t) * globals_num);
+    for (uint32_t v = 0; v < values_num; v++) {
+      if (global_index[v] != NOWHERE)
+        values[global_index[v]] = v;
+    }
+    for (uint32_t b = 0; b < blocks_num; b++) {
+      for (size_t w = 0; w < words; w++) {
+        uint64_t live_in = in[b * words + w];
+        uint64_t live_out = out[b * words + w];
+        for (uint64_t bits = live_in | live_out; bits; bits &= bits - 1) {
+          int bit = __builtin_ctzll(bits);
+          uint32_t v = values[w * 64 + bit];
+          if (live_in >> bit & 1 && bb_starts[b] < starts[v])
+            starts[v] = bb_starts[b];
+          if (live_out >> bit & 1 && bb_ends[b] > ends[v])
+            ends[v] = bb_ends[b];
+        }
+      }
+    }
+  }
+
+  uint32_t num = 0;
+  for (uint32_t v = 0; v < values_num; v++) {
+    if (starts[v] == NOWHERE)
+      continue;
+    intervals[num].value = v;
+    intervals[num].start = starts[v];
+    intervals[num].end = ends[v];
+    intervals[num].crosses_call = crosses(&calls, starts[v], ends[v]);
+    intervals[num].crosses_div = crosses(&divs, starts[v], ends[v]);
+    num++;
+  }
+  return num;
+}
+
+// allocate registers to the values of function
+alloc_t *regalloc(ir_func_t *ir_func)
+{
+  func = ir_func;
+  uint32_t values_num = ir_values_num(func);
+  alloc_t *alloc = spill_all(func);
+
+  starts = arena_alloc(curr_arena, sizeof(uint32_t) * (values_num + 1));
+  ends = arena_alloc(curr_arena, sizeof(uint32_t) * (values_num + 1));
+  homes = arena_alloc(curr_arena, sizeof(uint32_t) * (values_num + 1));
+  globals = arena_calloc(curr_arena, values_num + 1, sizeof(bool));
+  memset(starts, 0xff, sizeof(uint32_t) * (values_num + 1));
+  memset(ends, 0xff, sizeof(uint32_t) * (values_num + 1));
+  memset(homes, 0xff, sizeof(uint32_t) * (values_num + 1));
+
+  interval_t *intervals = arena_alloc(curr_arena, sizeof(interval_t) * (values_num + 1));
+  uint32_t intervals_num = build_intervals(intervals);
+  qsort(intervals, intervals_num, sizeof(interval_t), compare_intervals);
+
+  // active intervals sorted by end, one for each register at most
+  int regs_num = target_regs()->num;
+  interval_t *active[REG_MAX];
+  int active_num = 0;
+  bool taken[REG_MAX] = { false };
+
+  for (uint32_t i = 0; i < intervals_num; i++) {
+    interval_t *curr = intervals + i;
+
+    // expire the intervals ended before current one
+    int expired = 0;
+    while (expired < active_num && active[expired]->end < curr->start) {
+      taken[alloc->regs[active[expired]->value]] = false;
+      expired++;
+    }
+    memmove(active, active + expired, sizeof(interval_t *) * (active_num - expired));
+    active_num -= expired;
+
+    // caller-saved registers are tried first, as they cost no save and restore
+    int reg = REG_NONE;
+    for (int r = regs_num; r-- > 0;) {
+      if (!taken[r] && fits(r, curr)) {
+        reg = r;
+        break;
+      }
+    }
+
+    // spill the interval ending last, among current one and the active ones it could replace
+    if (reg == REG_NONE) {
+      int victim = -1;
+      for (int k = active_num - 1; k >= 0; k--) {
+        if (fits(alloc->regs[active[k]->value], curr)) {
+          victim = k;
+          break;
+        }
+      }
+      if (victim < 0 || active[victim]->end <= curr->end)
+        continue;
+      reg = alloc->regs[active[victim]->value];
+      alloc->regs[active[victim]->value] = REG_NONE;
+      memmove(active + victim, active + victim + 1, sizeof(interval_t *) * (active_num - victim - 1));
+      active_num--;
+    }
+
+    alloc->regs[curr->value] = reg;
+    alloc->used[reg] = true;
+    taken[reg] = true;
+    int k = active_num++;
+    while (k > 0 && active[k - 1]->end > curr->end) {
+      active[k] = active[k - 1];
+      k--;
+    }
+    active[k] = curr;
+  }
+
+  return alloc;
+}
+
+// place all the values in memory
+alloc_t *spill_all(ir_func_t *ir_func)
+{
+  uint32_t values_num = ir_values_num(ir_func);
+  alloc_t *alloc = arena_calloc(curr_arena, 1, sizeof(alloc_t));
+  alloc->regs = arena_alloc(curr_arena, values_num + 1);
+  memset(alloc->regs, REG_NONE, values_num + 1);
+  return alloc;
+}
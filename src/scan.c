@@ -0,0 +1,337 @@
+#include "scan.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+/* scalar versions */
+
+static bool isspace_byte(char c)
+{
+  return c == ' ' || c == '\t' || c == '\f' || c == '\r' || c == '\n';
+}
+
+static bool isident_byte(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static char *skip_space_scalar(char *p)
+{
+  while (isspace_byte(*p))
+    p++;
+  return p;
+}
+
+static char *skip_ident_scalar(char *p)
+{
+  while (isident_byte(*p))
+    p++;
+  return p;
+}
+
+static char *find_quote_scalar(char *p, char quote)
+{
+  while (*p != quote && *p != '\\' && *p != '\n' && *p != '\0')
+    p++;
+  return p;
+}
+
+static char *find_newline_scalar(char *p)
+{
+  while (*p != '\n' && *p != '\0')
+    p++;
+  return p;
+}
+
+static char *find_comment_end_scalar(char *p)
+{
+  while (*p != '\0' && !(p[0] == '*' && p[1] == '/'))
+    p++;
+  return p;
+}
+
+#ifdef SCAN_X86
+
+/* sse2 versions, 16 bytes a time */
+
+// mask of whitespace bytes
+static inline unsigned space_mask_sse2(__m128i v)
+{
+  __m128i m = _mm_or_si128(
+    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')))));
+  return _mm_movemask_epi8(m);
+}
+
+// mask of identifier bytes
+// bytes >= 0x80 are negative as signed bytes, so they fall out of every range
+static inline unsigned ident_mask_sse2(__m128i v)
+{
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+
+static char *skip_space_sse2(char *p)
+{
+  while (true) {
+    unsigned mask = ~space_mask_sse2(_mm_loadu_si128((__m128i *) p)) & 0xffff;
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+}
+
+static char *skip_ident_sse2(char *p)
+{
+  while (true) {
+    unsigned mask = ~ident_mask_sse2(_mm_loadu_si128((__m128i *) p)) & 0xffff;
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+}
+
+static char *find_quote_sse2(char *p, char quote)
+{
+  while (true) {
+    __m128i v = _mm_loadu_si128((__m128i *) p);
+    __m128i m = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(quote)), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+    unsigned mask = _mm_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+}
+
+static char *find_newline_sse2(char *p)
+{
+  while (true) {
+    __m128i v = _mm_loadu_si128((__m128i *) p);
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    unsigned mask = _mm_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+}
+
+static char *find_comment_end_sse2(char *p)
+{
+  while (true) {
+    __m128i v = _mm_loadu_si128((__m128i *) p);
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    unsigned mask = _mm_movemask_epi8(m);
+    while (mask) {
+      char *q = p + __builtin_ctz(mask);
+      if (*q == '\0' || q[1] == '/')
+        return q;
+      mask &= mask - 1;
+    }
+    p += 16;
+  }
+}
+
+/* avx2 versions, 32 bytes a time */
+
+__attribute__((target("avx2")))
+static inline unsigned space_mask_avx2(__m256i v)
+{
+  __m256i m = _mm256_or_si256(
+    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')))));
+  return _mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned ident_mask_avx2(__m256i v)
+{
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+  __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+}
+
+__attribute__((target("avx2")))
+static char *skip_space_avx2(char *p)
+{
+  while (true) {
+    unsigned mask = ~space_mask_avx2(_mm256_loadu_si256((__m256i *) p));
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+}
+
+__attribute__((target("avx2")))
+static char *skip_ident_avx2(char *p)
+{
+  while (true) {
+    unsigned mask = ~ident_mask_avx2(_mm256_loadu_si256((__m256i *) p));
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+}
+
+__attribute__((target("avx2")))
+static char *find_quote_avx2(char *p, char quote)
+{
+  while (true) {
+    __m256i v = _mm256_loadu_si256((__m256i *) p);
+    __m256i m = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(quote)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+    unsigned mask = _mm256_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+}
+
+__attribute__((target("avx2")))
+static char *find_newline_avx2(char *p)
+{
+  while (true) {
+    __m256i v = _mm256_loadu_si256((__m256i *) p);
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    unsigned mask = _mm256_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+}
+
+__attribute__((target("avx2")))
+static char *find_comment_end_avx2(char *p)
+{
+  while (true) {
+    __m256i v = _mm256_loadu_si256((__m256i *) p);
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    unsigned mask = _mm256_movemask_epi8(m);
+    while (mask) {
+      char *q = p + __builtin_ctz(mask);
+      if (*q == '\0' || q[1] == '/')
+        return q;
+      mask &= mask - 1;
+    }
+    p += 32;
+  }
+}
+
+#endif
+
+/* runtime dispatch */
+
+// the scanners start as resolvers, which select the best version
+// supported by the cpu on first use, unless scan_select is called before
+
+static void scan_resolve()
+{
+  scan_select(scan_detect());
+}
+
+static char *skip_space_resolve(char *p)
+{
+  scan_resolve();
+  return skip_space(p);
+}
+
+static char *skip_ident_resolve(char *p)
+{
+  scan_resolve();
+  return skip_ident(p);
+}
+
+static char *find_quote_resolve(char *p, char quote)
+{
+  scan_resolve();
+  return find_quote(p, quote);
+}
+
+static char *find_newline_resolve(char *p)
+{
+  scan_resolve();
+  return find_newline(p);
+}
+
+static char *find_comment_end_resolve(char *p)
+{
+  scan_resolve();
+  return find_comment_end(p);
+}
+
+char *(*skip_space)(char *p) = skip_space_resolve;
+char *(*skip_ident)(char *p) = skip_ident_resolve;
+char *(*find_quote)(char *p, char quote) = find_quote_resolve;
+char *(*find_newline)(char *p) = find_newline_resolve;
+char *(*find_comment_end)(char *p) = find_comment_end_resolve;
+
+// the best instruction set supported by the running cpu
+SCAN_ISA scan_detect()
+{
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SCAN_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SCAN_SSE2;
+#endif
+  return SCAN_SCALAR;
+}
+
+void scan_select(SCAN_ISA isa)
+{
+  switch (isa) {
+#ifdef SCAN_X86
+    case SCAN_AVX2:
+      skip_space = skip_space_avx2;
+      skip_ident = skip_ident_avx2;
+      find_quote = find_quote_avx2;
+      find_newline = find_newline_avx2;
+      find_comment_end = find_comment_end_avx2;
+      break;
+    case SCAN_SSE2:
+      skip_space = skip_space_sse2;
+      skip_ident = skip_ident_sse2;
+      find_quote = find_quote_sse2;
+      find_newline = find_newline_sse2;
+      find_comment_end = find_comment_end_sse2;
+      break;
+#endif
+    default:
+      skip_space = skip_space_scalar;
+      skip_ident = skip_ident_scalar;
+      find_quote = find_quote_scalar;
+      find_newline = find_newline_scalar;
+      find_comment_end = find_comment_end_scalar;
+      break;
+  }
+}
+
+const char *scan_isa_name(SCAN_ISA isa)
+{
+  static const char *names[] = {
+    [SCAN_SCALAR] = "scalar",
+    [SCAN_SSE2] = "sse2",
+    [SCAN_AVX2] = "avx2",
+  };
+  return names[isa];
+}
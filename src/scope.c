@@ -1,58 +1,47 @@
 #include "scope.h"
+#include "arena.h"
 #include "lex.h"
+#include "vec.h"
 #include <stdio.h>
 #include <stdlib.h>
 
-// variable scope
-// the current scope is the head of scope list
-scope_t *var_scope = &(scope_t) {
-  .symbol_table = NULL,
-  .next = NULL
-};
+// one symbol table for the whole compilation, mapping atoms to their bindings
+static hashmap_t *symbol_table;
 
-// function scope
-// only one function scope in the program
-scope_t *func_scope = &(scope_t) {
-  .symbol_table = NULL,
-  .next = NULL
-};
+DEFINE_VEC(binding_vec, binding_t *)
+DEFINE_VEC(size_vec, size_t)
 
-// dump symbol table
+// undo log of variable bindings
+// each variable added pushes its binding, and leaving a scope pops
+// the bindings pushed since the scope was entered, unshadowing the outer variables
+static binding_vec_t undo_log;
+
+// sizes of undo log when the enclosing scopes were entered
+static size_vec_t scope_marks;
+
+// dump symbol table of the current scope
 static void dump_symbol_table()
 {
-  hashmap_t *table = var_scope->symbol_table;
-  for (unsigned i = 0; i < table->capcity; i++) {
-    if (table->bucket[i].used == true) {
-      symbol_t *symbol = (symbol_t *) table->bucket[i].val;
-      if (symbol->is_var == true) {
-        fprintf(stdout, "%s %s\n", symbol->name, symbol->type->name);
-      } else if (symbol->is_func == true) {
-        fprintf(stdout, "%s (", symbol->name);
-        for (type_t *param = symbol->params_type; param != NULL; param = param->next)
-          fprintf(stdout, "%s%s", param->name, param->next == NULL ? ")" : ", ");
-        fprintf(stdout, " => %s\n", symbol->return_type->name);
-      }
-    }
+  size_t mark = size_vec_empty(&scope_marks) ? 0 : *size_vec_top(&scope_marks);
+  for (size_t i = mark; i < undo_log.size; i++) {
+    symbol_t *symbol = (*binding_vec_at(&undo_log, i))->var;
+    fprintf(stdout, "%s %s\n", symbol->name, symbol->type->name);
   }
   fputc('\n', stdout);
 }
 
-// make a new scope
-#define MAX_SYMBOL_NUM 128
-static scope_t *make_scope()
+// start a new symbol table for the compilation
+void init_scope()
 {
-  scope_t *new_scope = calloc(1, sizeof(scope_t));
-  new_scope->symbol_table = new_hashmap(MAX_SYMBOL_NUM);
-  new_scope->next = NULL;
-  return new_scope;
+  symbol_table = new_hashmap(1024);
+  binding_vec_init(&undo_log);
+  size_vec_init(&scope_marks);
 }
 
 // enter block scope
 void enter_scope()
 {
-  scope_t *new_scope = make_scope();
-  new_scope->next = var_scope;
-  var_scope = new_scope;
+  size_vec_push(&scope_marks, undo_log.size);
 }
 
 // leave block scope
@@ -62,41 +51,56 @@ void leave_scope()
   // #ifdef DEBUG
   //   dump_symbol_table();
   // #endif
-  var_scope = var_scope->next;
+
+  size_t mark = size_vec_pop(&scope_marks);
+  while (undo_log.size > mark) {
+    binding_t *binding = binding_vec_pop(&undo_log);
+    binding->var = binding->var->next;
+  }
 }
 
-// add a new symbol to scope
-void add_symbol(scope_t *scope, symbol_t *symbol)
+// the binding of atom, made on first use
+static binding_t *get_binding(atom_t *atom)
 {
-  hashmap_add_cstr(scope->symbol_table, symbol->name, symbol);
+  entry_t *entry = hashmap_get_atom(symbol_table, atom);
+  if (entry)
+    return entry->val;
+
+  binding_t *binding = arena_calloc(curr_arena, 1, sizeof(binding_t));
+  hashmap_add_atom(symbol_table, atom, binding);
+  return binding;
 }
 
-// delete a symbol to scope
-void del_symbol(scope_t *scope, symbol_t *symbol)
+// add a new symbol to the current scope
+// a variable shadows the variable of the same name in outer scopes until its scope is left
+void add_symbol(SYM_NS ns, symbol_t *symbol)
 {
-  hashmap_remove_cstr(scope->symbol_table, symbol->name);
+  binding_t *binding = get_binding(symbol->atom);
+  switch (ns) {
+    case NS_VAR:
+      symbol->next = binding->var;
+      binding->var = symbol;
+      binding_vec_push(&undo_log, binding);
+      break;
+    case NS_FUNC:
+      binding->func = symbol;
+      break;
+  }
 }
 
-// find a symbol given its name
-// iterate through scopes
+// find the visible symbol given its atom
 // if not found return null pointer
-symbol_t *find_symbol_by_name(scope_t *scope, char *symbol_name)
+symbol_t *find_symbol_by_atom(SYM_NS ns, atom_t *atom)
 {
-  for (scope_t *curr = scope; curr && curr->symbol_table != NULL; curr = curr->next) {
-    entry_t *entry = hashmap_get_cstr(curr->symbol_table, symbol_name);
-    if (entry)
-      return (symbol_t *) entry->val;
-  }
-  return NULL;
+  entry_t *entry = hashmap_get_atom(symbol_table, atom);
+  if (!entry)
+    return NULL;
+  binding_t *binding = entry->val;
+  return ns == NS_VAR ? binding->var : binding->func;
 }
 
-// find a symbol given its token
-symbol_t *find_symbol_by_tok(scope_t *scope, token_t *token)
+// find a symbol given its identifier token
+symbol_t *find_symbol_by_tok(SYM_NS ns, token_t *token)
 {
-  for (scope_t *curr = scope; curr && curr->symbol_table != NULL; curr = curr->next) {
-    entry_t *entry = hashmap_get(curr->symbol_table, token->begin, token->len);
-    if (entry)
-      return (symbol_t *) entry->val;
-  }
-  return NULL;
+  return find_symbol_by_atom(ns, tok_atom(token));
 }
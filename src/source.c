@@ -0,0 +1,111 @@
+#define _DEFAULT_SOURCE
+#include "source.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read the whole stream (stdin, pipe, tty, ...) into a heap buffer
+static source_t *read_source(int fd)
+{
+  size_t capacity = 1 << 16;
+  size_t len = 0;
+  char *buf = malloc(capacity);
+
+  while (true) {
+    // every read asks for at least one byte, since reading none looks like end of file
+    if (capacity - len <= SOURCE_PADDING) {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+    }
+    ssize_t n = read(fd, buf + len, capacity - len - SOURCE_PADDING);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "cannot read source: %s\n", strerror(errno));
+      exit(1);
+    }
+    if (n == 0)
+      break;
+    len += n;
+  }
+  memset(buf + len, 0, SOURCE_PADDING);
+
+  source_t *source = calloc(1, sizeof(source_t));
+  source->buf = buf;
+  source->len = len;
+  source->size = capacity;
+  source->mapped = false;
+  return source;
+}
+
+// map the regular file read-only
+// the file is mapped over an anonymous reservation that is large enough
+// to hold the padding, so the bytes past the end of file are always zero,
+// even if the file size is a multiple of page size
+static source_t *map_source(int fd, size_t len)
+{
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t size = (len + SOURCE_PADDING + page_size - 1) & ~(page_size - 1);
+
+  char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+  if (mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, size);
+    return NULL;
+  }
+  madvise(base, len, MADV_SEQUENTIAL);
+
+  source_t *source = calloc(1, sizeof(source_t));
+  source->buf = base;
+  source->len = len;
+  source->size = size;
+  source->mapped = true;
+  return source;
+}
+
+// load the source text of the given path
+// read from stdin if path is null or "-"
+source_t *load_source(char *path)
+{
+  if (path == NULL || !strcmp(path, "-"))
+    return read_source(STDIN_FILENO);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open source file \"%s\": %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "cannot stat source file \"%s\": %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  // only regular files can be mapped, others (fifo, char device, ...) are read
+  source_t *source = NULL;
+  if (S_ISREG(st.st_mode) && st.st_size > 0)
+    source = map_source(fd, st.st_size);
+  if (!source)
+    source = read_source(fd);
+
+  close(fd);
+  return source;
+}
+
+void unload_source(source_t *source)
+{
+  if (source) {
+    if (source->mapped)
+      munmap(source->buf, source->size);
+    else
+      free(source->buf);
+    free(source);
+  }
+}
@@ -1,15 +1,73 @@
 #include "lex.h"
 #include "symbol.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+// the basic types, shared by all compilations
+static type_t basic_types[KAT_FUNC] = {
+  [KAT_INT]  = { .name = "int",  .size = 4, .kind = KAT_INT },
+  [KAT_CHAR] = { .name = "char", .size = 4, .kind = KAT_CHAR },
+  [KAT_STR]  = { .name = "str",  .size = 4, .kind = KAT_STR },
+  [KAT_BOOL] = { .name = "bool", .size = 4, .kind = KAT_BOOL },
+  [KAT_NIL]  = { .name = "nil",  .size = 0, .kind = KAT_NIL },
+};
+
+// function types of the compilation, keyed by the bytes of their signature
+static hashmap_t *func_types;
+
+// start a new table of function types for the compilation
+void init_types()
+{
+  func_types = new_hashmap(64);
+}
+
+// the canonical type of a basic kind
+type_t *basic_type(KAT_TYPE kind)
+{
+  return basic_types + kind;
+}
+
+// the canonical function type of the signature
+// since the types in a signature are canonical, the signature is identified by its pointers
+type_t *func_type(type_t *return_type, type_t **params_type, size_t params_num)
+{
+  // the signature is copied to the arena only when it is new
+  type_t *local_sig[16];
+  size_t len = sizeof(type_t *) * (params_num + 1);
+  type_t **sig = params_num < 16 ? local_sig : arena_alloc(curr_arena, len);
+  sig[0] = return_type;
+  memcpy(sig + 1, params_type, sizeof(type_t *) * params_num);
+
+  entry_t *entry = hashmap_get(func_types, (char *) sig, len);
+  if (entry)
+    return entry->val;
+
+  if (sig == local_sig) {
+    sig = arena_alloc(curr_arena, len);
+    memcpy(sig, local_sig, len);
+  }
+
+  type_t *type = arena_alloc(curr_arena, sizeof(type_t));
+  type->name = "func";
+  type->size = 4;
+  type->kind = KAT_FUNC;
+  type->return_type = return_type;
+  type->params_num = params_num;
+  type->sig = sig;
+  hashmap_add(func_types, (char *) sig, len, type);
+  return type;
+}
 
 symbol_t *make_var_symbol(token_t *var_tok, type_t *var_type)
 {
-  symbol_t *symbol = calloc(1, sizeof(symbol_t));
+  symbol_t *symbol = arena_calloc(curr_arena, 1, sizeof(symbol_t));
   symbol->is_var = true;
   symbol->is_func = false;
-  symbol->name = tok2cstr(var_tok);
+  symbol->atom = tok_atom(var_tok);
+  symbol->name = symbol->atom->name;
   symbol->type = var_type;
   symbol->token = var_tok;
   switch (var_type->kind) {
@@ -18,20 +76,21 @@ symbol_t *make_var_symbol(token_t *var_tok, type_t *var_type)
     case KAT_STR: symbol->offset = -4; break;
     case KAT_BOOL: symbol->offset = -1; break;
     case KAT_NIL: symbol->offset = 0; break;
+    case KAT_FUNC: symbol->offset = -4; break;
   }
   symbol->next = NULL;
   return symbol;
 }
 
-symbol_t *make_fn_symbol(token_t *func_tok, type_t *return_type, type_t *params_type, size_t params_num)
+symbol_t *make_fn_symbol(token_t *func_tok, type_t *func_type)
 {
-  symbol_t *symbol = calloc(1, sizeof(symbol_t));
+  symbol_t *symbol = arena_calloc(curr_arena, 1, sizeof(symbol_t));
   symbol->is_var = false;
   symbol->is_func = true;
-  symbol->name = tok2cstr(func_tok);
-  symbol->return_type = return_type;
-  symbol->params_num = params_num;
-  symbol->params_type = params_type;
+  symbol->atom = tok_atom(func_tok);
+  symbol->name = symbol->atom->name;
+  symbol->return_type = func_type->return_type;
+  symbol->func_type = func_type;
   // TODO: offset is sum of params offset plus return address
   symbol->token = func_tok;
   symbol->next = NULL;
@@ -0,0 +1,220 @@
+#include "bytecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+
+// interpreter of bytecode
+//
+// with gcc and clang the handlers are threaded: each one ends with a computed goto
+// to the handler of the next instruction, so every handler has its own indirect branch,
+// which the branch predictor learns separately, other compilers dispatch with a switch
+// the program is verified before it runs (see verify_bytecode), only the stack is checked here
+
+#if defined(__GNUC__)
+#define VM_THREADED
+#endif
+
+// registers of all the frames, and calls in progress
+#define VM_STACK_SIZE (1 << 22)
+#define VM_FRAMES_NUM (1 << 20)
+
+typedef struct frame_t
+{
+  bc_ins_t *ret;   // the instruction returned to
+  int32_t *base;   // the window of caller
+  uint16_t dst;    // the register of caller the result goes to
+} frame_t;
+
+static noreturn void vm_error(char *msg)
+{
+  fflush(stdout);
+  fprintf(stderr, "%s\n", msg);
+  exit(1);
+}
+
+// arithmetic wraps around as it does on x86
+#define WRAP(expr) ((int32_t) (uint32_t) (expr))
+
+// run the program, passing args to main, return what main returns
+int run_bytecode(bc_prog_t *prog, int32_t *args, int args_num)
+{
+  bc_func_t *main_func = prog->funcs + prog->main;
+  if ((size_t) args_num != main_func->params_num) {
+    fprintf(stderr, "main takes %u arguments, but %d are given\n", main_func->params_num, args_num);
+    exit(1);
+  }
+
+  int32_t *stack = calloc(VM_STACK_SIZE, sizeof(int32_t));
+  frame_t *frames = malloc(sizeof(frame_t) * VM_FRAMES_NUM);
+  if (!stack || !frames)
+    vm_error("cannot allocate the stack of vm");
+  memcpy(stack, args, sizeof(int32_t) * args_num);
+
+  int32_t *base = stack;
+  int32_t *stack_end = stack + VM_STACK_SIZE;
+  frame_t *frame = frames;
+  frame_t *frames_end = frames + VM_FRAMES_NUM;
+  bc_ins_t *code = prog->code;
+  bc_ins_t *pc = code + main_func->entry;
+  int32_t status;
+
+#define A base[pc->a]
+#define B base[pc->b]
+#define C base[pc->c]
+
+#ifdef VM_THREADED
+  static void *handlers[BC_OP_NUM] = {
+    [BC_MOV] = &&op_BC_MOV,     [BC_LOADI] = &&op_BC_LOADI, [BC_NEG] = &&op_BC_NEG,
+    [BC_ADD] = &&op_BC_ADD,     [BC_ADDI] = &&op_BC_ADDI,   [BC_SUB] = &&op_BC_SUB,
+    [BC_MUL] = &&op_BC_MUL,     [BC_DIV] = &&op_BC_DIV,     [BC_EQ] = &&op_BC_EQ,
+    [BC_NE] = &&op_BC_NE,       [BC_LT] = &&op_BC_LT,       [BC_LE] = &&op_BC_LE,
+    [BC_GT] = &&op_BC_GT,       [BC_GE] = &&op_BC_GE,       [BC_JMP] = &&op_BC_JMP,
+    [BC_JZ] = &&op_BC_JZ,       [BC_JNZ] = &&op_BC_JNZ,     [BC_BEQ] = &&op_BC_BEQ,
+    [BC_BNE] = &&op_BC_BNE,     [BC_BLT] = &&op_BC_BLT,     [BC_BLE] = &&op_BC_BLE,
+    [BC_BGT] = &&op_BC_BGT,     [BC_BGE] = &&op_BC_BGE,     [BC_BEQI] = &&op_BC_BEQI,
+    [BC_BNEI] = &&op_BC_BNEI,   [BC_BLTI] = &&op_BC_BLTI,   [BC_BLEI] = &&op_BC_BLEI,
+    [BC_BGTI] = &&op_BC_BGTI,   [BC_BGEI] = &&op_BC_BGEI,   [BC_CALL] = &&op_BC_CALL,
+    [BC_RET] = &&op_BC_RET,     [BC_PRINT] = &&op_BC_PRINT, [BC_HELLO] = &&op_BC_HELLO,
+  };
+#define CASE(op) op_##op:
+#define DISPATCH() goto *handlers[pc->op];
+#define NEXT(n)                \
+  do {                         \
+    pc += (n);                 \
+    goto *handlers[pc->op];    \
+  } while (0)
+#define GOTO(target)                   \
+  do {                                 \
+    pc = code + (target);              \
+    goto *handlers[pc->op];            \
+  } while (0)
+#else
+#define CASE(op) case op:
+#define DISPATCH() dispatch: switch (pc->op)
+#define NEXT(n)                \
+  do {                         \
+    pc += (n);                 \
+    goto dispatch;             \
+  } while (0)
+#define GOTO(target)           \
+  do {                         \
+    pc = code + (target);      \
+    goto dispatch;             \
+  } while (0)
+#endif
+
+#define BINARY(op, expr) \
+  CASE(op) {             \
+    A = (expr);          \
+    NEXT(1);             \
+  }
+// compare-and-branch, the target is in the next slot
+#define BRANCH(op, cmp, rhs)     \
+  CASE(op) {                     \
+    if (A cmp (rhs))             \
+      GOTO(pc[1].target);        \
+    NEXT(2);                     \
+  }
+
+  DISPATCH()
+  {
+    CASE(BC_MOV) {
+      A = B;
+      NEXT(1);
+    }
+    CASE(BC_LOADI) {
+      A = pc->imm;
+      NEXT(1);
+    }
+    CASE(BC_NEG) {
+      A = WRAP(0u - (uint32_t) B);
+      NEXT(1);
+    }
+    BINARY(BC_ADD, WRAP((uint32_t) B + (uint32_t) C))
+    BINARY(BC_ADDI, WRAP((uint32_t) B + (uint32_t) (int16_t) pc->c))
+    BINARY(BC_SUB, WRAP((uint32_t) B - (uint32_t) C))
+    BINARY(BC_MUL, WRAP((uint32_t) B * (uint32_t) C))
+    CASE(BC_DIV) {
+      if (C == 0)
+        vm_error("division by zero");
+      if (B == INT32_MIN && C == -1)
+        vm_error("division overflow");
+      A = B / C;
+      NEXT(1);
+    }
+    BINARY(BC_EQ, B == C)
+    BINARY(BC_NE, B != C)
+    BINARY(BC_LT, B < C)
+    BINARY(BC_LE, B <= C)
+    BINARY(BC_GT, B > C)
+    BINARY(BC_GE, B >= C)
+    CASE(BC_JMP) {
+      GOTO(pc->target);
+    }
+    CASE(BC_JZ) {
+      if (!A)
+        GOTO(pc->target);
+      NEXT(1);
+    }
+    CASE(BC_JNZ) {
+      if (A)
+        GOTO(pc->target);
+      NEXT(1);
+    }
+    BRANCH(BC_BEQ, ==, B)
+    BRANCH(BC_BNE, !=, B)
+    BRANCH(BC_BLT, <, B)
+    BRANCH(BC_BLE, <=, B)
+    BRANCH(BC_BGT, >, B)
+    BRANCH(BC_BGE, >=, B)
+    BRANCH(BC_BEQI, ==, pc->imm)
+    BRANCH(BC_BNEI, !=, pc->imm)
+    BRANCH(BC_BLTI, <, pc->imm)
+    BRANCH(BC_BLEI, <=, pc->imm)
+    BRANCH(BC_BGTI, >, pc->imm)
+    BRANCH(BC_BGEI, >=, pc->imm)
+    CASE(BC_CALL) {
+      bc_func_t *callee = prog->funcs + pc->c;
+      int32_t *callee_base = base + pc->b;
+      if (frame == frames_end || callee_base + callee->regs_num > stack_end)
+        vm_error("stack overflow");
+      *frame++ = (frame_t) { .ret = pc + 1, .base = base, .dst = pc->a };
+      base = callee_base;
+      GOTO(callee->entry);
+    }
+    CASE(BC_RET) {
+      int32_t val = A;
+      if (frame == frames) {
+        status = val;
+        goto done;
+      }
+      frame--;
+      pc = frame->ret;
+      base = frame->base;
+      base[frame->dst] = val;
+      NEXT(0);
+    }
+    CASE(BC_PRINT) {
+      printf("%d\n", A);
+      NEXT(1);
+    }
+    CASE(BC_HELLO) {
+      printf("hello, friends :^)\n");
+      NEXT(1);
+    }
+#ifndef VM_THREADED
+    default: vm_error("unknown opcode");
+#endif
+  }
+
+#undef A
+#undef B
+#undef C
+
+done:
+  fflush(stdout);
+  free(stack);
+  free(frames);
+  return status;
+}
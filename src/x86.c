@@ -0,0 +1,177 @@
+#include "x86.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+TARGET target = TARGET_I386;
+
+static char *reg_names[X86_REG_NUM] = {
+  "%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+  "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d",
+};
+
+static char *wide_reg_names[X86_REG_NUM] = {
+  "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+  "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15",
+};
+
+// the low bytes of registers, on i386 only the first four have one
+static char *byte_reg_names[X86_REG_NUM] = {
+  "%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil",
+  "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b",
+};
+
+static char *cc_names[X86_CC_NUM] = {
+  [X86_CC_E]  = "e",
+  [X86_CC_NE] = "ne",
+  [X86_CC_L]  = "l",
+  [X86_CC_LE] = "le",
+  [X86_CC_G]  = "g",
+  [X86_CC_GE] = "ge",
+};
+
+// mnemonics, which take the suffix of operand size (l or q) if they have one,
+// and jcc and setcc are completed by their condition codes
+static struct {
+  char *name;
+  bool sized;
+} ops[X86_OP_NUM] = {
+  [X86_MOV]   = { "mov",   true },
+  [X86_MOVZB] = { "movzb", true },
+  [X86_MOVB]  = { "movb",  false },
+  [X86_LEA]   = { "lea",   true },
+  [X86_ADD]   = { "add",   true },
+  [X86_SUB]   = { "sub",   true },
+  [X86_IMUL]  = { "imul",  true },
+  [X86_XOR]   = { "xor",   true },
+  [X86_SHL]   = { "shl",   true },
+  [X86_NEG]   = { "neg",   true },
+  [X86_CMP]   = { "cmp",   true },
+  [X86_TEST]  = { "test",  true },
+  [X86_SETCC] = { "set",   false },
+  [X86_CLTD]  = { "cltd",  false },
+  [X86_IDIV]  = { "idiv",  true },
+  [X86_PUSH]  = { "push",  true },
+  [X86_POP]   = { "pop",   true },
+  [X86_CALL]  = { "call",  false },
+  [X86_JMP]   = { "jmp",   false },
+  [X86_JCC]   = { "j",     false },
+  [X86_RET]   = { "ret",   false },
+  [X86_SYSCALL] = { "syscall", false },
+};
+
+bool x86_same_opd(x86_opd_t x, x86_opd_t y)
+{
+  if (x.kind != y.kind)
+    return false;
+  switch (x.kind) {
+    case X86_OPD_NONE: return true;
+    case X86_OPD_REG: return x.reg == y.reg;
+    case X86_OPD_IMM: return x.imm == y.imm;
+    case X86_OPD_MEM: return x.reg == y.reg && x.disp == y.disp;
+    case X86_OPD_SYM: return x.sym == y.sym;
+    case X86_OPD_LABEL: return x.sym == y.sym && x.id == y.id;
+    case X86_OPD_RIP: return x.sym == y.sym;
+  }
+  return false;
+}
+
+// the condition code true when cc is false
+X86_CC x86_negate_cc(X86_CC cc)
+{
+  static X86_CC negated[X86_CC_NUM] = {
+    [X86_CC_E]  = X86_CC_NE,
+    [X86_CC_NE] = X86_CC_E,
+    [X86_CC_L]  = X86_CC_GE,
+    [X86_CC_LE] = X86_CC_G,
+    [X86_CC_G]  = X86_CC_LE,
+    [X86_CC_GE] = X86_CC_L,
+  };
+  return negated[cc];
+}
+
+// the width of register operand is 8, 32 or 64 bits
+// symbols are addresses (immediates) unless they are the targets of calls and jumps
+static void print_opd(x86_opd_t opd, int width, bool is_target, FILE *fp)
+{
+  // addresses are as wide as the machine
+  char **base_names = target == TARGET_X86_64 ? wide_reg_names : reg_names;
+  switch (opd.kind) {
+    case X86_OPD_REG:
+      fputs(width == 8 ? byte_reg_names[opd.reg] : width == 64 ? wide_reg_names[opd.reg] : reg_names[opd.reg], fp);
+      break;
+    case X86_OPD_IMM: fprintf(fp, "$%ld", opd.imm); break;
+    case X86_OPD_MEM: fprintf(fp, "%d(%s)", opd.disp, base_names[opd.reg]); break;
+    case X86_OPD_SYM: fprintf(fp, is_target ? "%s" : "$%s", opd.sym); break;
+    case X86_OPD_LABEL: fprintf(fp, ".L%s.%u", opd.sym, opd.id); break;
+    case X86_OPD_RIP: fprintf(fp, "%s(%%rip)", opd.sym); break;
+    case X86_OPD_NONE:
+      fprintf(stderr, "missing operand in %s at line %d\n", __FILE__, __LINE__);
+      exit(1);
+  }
+}
+
+// print the string as an .asciz directive, escaping what gas would not read as it is
+static void print_string(char *str, FILE *fp)
+{
+  fputs("  .asciz \"", fp);
+  for (unsigned char *c = (unsigned char *) str; *c; c++) {
+    if (*c == '\n')
+      fputs("\\n", fp);
+    else if (*c == '"' || *c == '\\')
+      fprintf(fp, "\\%c", *c);
+    else if (*c < ' ' || *c > '~')
+      fprintf(fp, "\\%03o", *c);
+    else
+      fputc(*c, fp);
+  }
+  fputs("\"\n", fp);
+}
+
+// print the instruction as a line of assembly
+void print_x86(x86_ins_t *ins, FILE *fp)
+{
+  switch (ins->op) {
+    case X86_NOP:
+      return;
+    case X86_LABEL:
+      print_opd(ins->src, 32, true, fp);
+      fputs(":\n", fp);
+      return;
+    case X86_TEXT:
+      fprintf(fp, "%s\n", ins->src.sym);
+      return;
+    case X86_SECTION:
+      fprintf(fp, ".section %s\n", ins->src.sym);
+      return;
+    case X86_GLOBAL:
+      fprintf(fp, ".type %s, @function\n.globl %s\n", ins->src.sym, ins->src.sym);
+      return;
+    case X86_STRING:
+      print_string(ins->src.sym, fp);
+      return;
+    case X86_SYSCALL:
+      fputs(target == TARGET_X86_64 ? "  syscall\n" : "  int $0x80\n", fp);
+      return;
+    default:
+      break;
+  }
+
+  bool wide = ins->wide || (target == TARGET_X86_64 && (ins->op == X86_PUSH || ins->op == X86_POP));
+  fprintf(fp, "  %s", ops[ins->op].name);
+  if (ins->op == X86_JCC || ins->op == X86_SETCC)
+    fputs(cc_names[ins->cc], fp);
+  else if (ops[ins->op].sized)
+    fputc(wide ? 'q' : 'l', fp);
+
+  int width = wide ? 64 : 32;
+  bool is_target = ins->op == X86_CALL || ins->op == X86_JMP || ins->op == X86_JCC;
+  if (ins->src.kind != X86_OPD_NONE) {
+    fputc(' ', fp);
+    print_opd(ins->src, ins->op == X86_MOVZB || ins->op == X86_MOVB ? 8 : width, is_target, fp);
+  }
+  if (ins->dst.kind != X86_OPD_NONE) {
+    fputs(ins->src.kind != X86_OPD_NONE ? ", " : " ", fp);
+    print_opd(ins->dst, ins->op == X86_SETCC ? 8 : width, is_target, fp);
+  }
+  fputc('\n', fp);
+}